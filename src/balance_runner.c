@@ -0,0 +1,543 @@
+// Plays thousands of complete games headlessly with a scripted bot, across all cores, and prints the distributions
+// of survival time, score and boss kills for each set of balance parameters. Each set is a comma separated list of
+// overrides for values from the content pack, e.g.
+//
+//   balance_runner -n 2000 default enemy_credit_exponent=1.4 enemy_credit_exponent=1.4,boss.max_health=400
+//
+// Games are seeded from their index, so results don't depend on the number of threads (including the collision
+// threads). Run with -h for options
+#define LOOP_SHOOTER_NO_MAIN
+#include "game.c"
+
+#include <time.h>
+
+#define BALANCE_FRAME_TIME (1.0f / 60)  // Games are simulated at a fixed 60 updates per second
+#define MAX_PARAMETER_SETS 32
+#define MAX_OVERRIDES 16
+
+#define BOT_THREAT_RADIUS 6.0f  // Enemies and projectiles further away than this are ignored when kiting
+#define BOT_WALL_MARGIN 4.0f    // The bot starts steering away from the edge of the game area this close to it
+#define BOT_CENTRE_PULL 0.002f  // Weak pull towards the centre, so the bot doesn't idle in a corner
+
+typedef enum ParameterTarget {
+  PARAMETER_CONSTANTS,     // A field of Constants
+  PARAMETER_BOSS_TYPE,     // A field of the boss's BossType
+  PARAMETER_UPGRADE_LEVEL  // The number of times an upgrade has been bought before the game
+} ParameterTarget;
+
+typedef struct Parameter {
+  const char *name;        // Name used for the parameter on the command line
+  ParameterTarget target;  // What the parameter changes
+  size_t offset;           // Offset of the field in its struct, or the PackUpgradeStat for upgrade levels
+  bool is_int;             // Whether the field is an int rather than a float
+} Parameter;
+
+#define CONSTANT_FLOAT(name) {#name, PARAMETER_CONSTANTS, offsetof(Constants, name), false}
+#define CONSTANT_INT(name) {#name, PARAMETER_CONSTANTS, offsetof(Constants, name), true}
+#define BOSS_FLOAT(name) {"boss." #name, PARAMETER_BOSS_TYPE, offsetof(BossType, name), false}
+#define BOSS_INT(name) {"boss." #name, PARAMETER_BOSS_TYPE, offsetof(BossType, name), true}
+#define UPGRADE_LEVEL(name, stat) {"upgrade_level." #name, PARAMETER_UPGRADE_LEVEL, stat, true}
+
+static const Parameter PARAMETERS[] = {
+    CONSTANT_FLOAT(enemy_credit_multiplier),
+    CONSTANT_FLOAT(enemy_credit_exponent),
+    CONSTANT_FLOAT(initial_enemy_credits),
+    CONSTANT_FLOAT(enemy_spawn_interval_min),
+    CONSTANT_FLOAT(enemy_spawn_interval_max),
+    CONSTANT_FLOAT(enemy_first_spawn_interval),
+    CONSTANT_INT(enemy_spawn_min_wave_size),
+    CONSTANT_FLOAT(enemy_spawn_additional_enemy_chance),
+    CONSTANT_FLOAT(enemy_update_interval),
+    CONSTANT_FLOAT(enemy_update_chance),
+    CONSTANT_FLOAT(enemy_lod_radius),
+    CONSTANT_INT(enemy_lod_interval),
+    CONSTANT_FLOAT(player_base_speed),
+    CONSTANT_FLOAT(player_base_size),
+    CONSTANT_FLOAT(player_base_firerate),
+    CONSTANT_FLOAT(player_base_projectile_speed),
+    CONSTANT_FLOAT(player_base_projectile_size),
+    CONSTANT_FLOAT(player_base_projectile_damage),
+    CONSTANT_FLOAT(upgrade_cost_multiplier),
+    BOSS_INT(initial_score_to_spawn),
+    BOSS_FLOAT(max_health),
+    BOSS_FLOAT(speed),
+    BOSS_FLOAT(size),
+    BOSS_FLOAT(firerate),
+    BOSS_INT(shots_per_burst),
+    BOSS_FLOAT(projectile_speed),
+    BOSS_FLOAT(projectile_size),
+    BOSS_FLOAT(moving_duration),
+    BOSS_FLOAT(stationary_duration),
+    BOSS_INT(num_enemies_spawned_on_defeat),
+    BOSS_INT(boss_points_on_defeat),
+    BOSS_INT(score_on_defeat),
+    UPGRADE_LEVEL(firerate, PACK_UPGRADE_STAT_FIRERATE),
+    UPGRADE_LEVEL(projectile_speed, PACK_UPGRADE_STAT_PROJECTILE_SPEED),
+    UPGRADE_LEVEL(projectile_size, PACK_UPGRADE_STAT_PROJECTILE_SIZE),
+    UPGRADE_LEVEL(projectile_damage, PACK_UPGRADE_STAT_PROJECTILE_DAMAGE),
+};
+#define NUM_PARAMETERS (sizeof PARAMETERS / sizeof *PARAMETERS)
+
+typedef struct ParameterSet {
+  const char *description;  // The set as given on the command line
+  int num_overrides;
+  const Parameter *parameters[MAX_OVERRIDES];  // Parameters overridden by this set
+  float values[MAX_OVERRIDES];                 // Value of each overridden parameter
+} ParameterSet;
+
+typedef struct GameResult {
+  float survival_time;      // Seconds of game time before the player was defeated (or the time limit)
+  int score;                // Score at the end of the game (which is also the money earned)
+  int boss_kills;           // Number of times the boss was defeated
+  bool reached_time_limit;  // Whether the game was cut off by the time limit rather than the player dying
+} GameResult;
+
+// Everything the worker threads need to play the games of one parameter set. Only `next_game` and `results` are
+// written once the workers have started
+typedef struct BalanceRun {
+  const Constants *constants;
+  const EnemyType *enemy_types;
+  const BossType *boss_types;
+  const Upgrade *upgrades;  // Shop upgrades, with the levels bought before each game
+  int num_upgrades;
+
+  int num_games;       // Number of games to play
+  uint64_t base_seed;  // Game i is seeded with base_seed + i
+  float max_time;      // Games are stopped after this many seconds of game time
+  int collision_threads;  // Threads each game's collision detection is split between (1 for none)
+
+  pthread_mutex_t mutex;  // Protects next_game
+  int next_game;          // Index of the next game for a worker to play
+  GameResult *results;    // Result of each game, indexed by game
+} BalanceRun;
+
+/*-----------*/
+/* Utilities */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+double get_wall_time() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+int get_default_thread_count() {
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (int)count : 1;
+}
+
+const Parameter *find_parameter(const char *name, size_t length) {
+  for (size_t i = 0; i < NUM_PARAMETERS; i++) {
+    if (strlen(PARAMETERS[i].name) == length && strncmp(PARAMETERS[i].name, name, length) == 0)
+      return PARAMETERS + i;
+  }
+  return NULL;
+}
+
+int compare_floats(const void *a, const void *b) {
+  float x = *(const float *)a, y = *(const float *)b;
+  return (x > y) - (x < y);
+}
+/*---------------------------------------------------------------------------------------------------------------*/
+
+/*----------------*/
+/* Parameter sets */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+// Parse a parameter set of the form "name=value,name=value" (or "default" for no overrides). Exits on failure
+ParameterSet parameter_set_parse(const char *description) {
+  ParameterSet set = {.description = description};
+  if (strcmp(description, "default") == 0) return set;
+
+  const char *item = description;
+  while (*item) {
+    size_t item_length = strcspn(item, ",");
+    const char *equals = memchr(item, '=', item_length);
+    const Parameter *parameter = equals ? find_parameter(item, equals - item) : NULL;
+    if (!parameter) {
+      fprintf(stderr, "Unknown parameter in \"%.*s\". Run with -l to list parameters.\n", (int)item_length, item);
+      exit(EXIT_FAILURE);
+    }
+    if (set.num_overrides == MAX_OVERRIDES) {
+      fprintf(stderr, "Too many overrides in parameter set \"%s\".\n", description);
+      exit(EXIT_FAILURE);
+    }
+
+    char *end;
+    float value = strtof(equals + 1, &end);
+    if (end == equals + 1 || end != item + item_length) {
+      fprintf(stderr, "Invalid value in \"%.*s\".\n", (int)item_length, item);
+      exit(EXIT_FAILURE);
+    }
+
+    set.parameters[set.num_overrides] = parameter;
+    set.values[set.num_overrides] = value;
+    set.num_overrides++;
+
+    item += item_length;
+    if (*item == ',') item++;
+  }
+  return set;
+}
+
+// Apply a parameter set's overrides to copies of the loaded content
+void parameter_set_apply(const ParameterSet *set, Constants *constants, BossType *boss_type, Upgrade *upgrades,
+                         int num_upgrades) {
+  for (int i = 0; i < set->num_overrides; i++) {
+    const Parameter *parameter = set->parameters[i];
+    float value = set->values[i];
+
+    unsigned char *base = NULL;
+    switch (parameter->target) {
+      case PARAMETER_CONSTANTS:
+        base = (unsigned char *)constants;
+        break;
+      case PARAMETER_BOSS_TYPE:
+        base = (unsigned char *)boss_type;
+        break;
+      case PARAMETER_UPGRADE_LEVEL:
+        for (int j = 0; j < num_upgrades; j++) {
+          if (upgrades[j].stat == (PackUpgradeStat)parameter->offset) upgrades[j].level = (int)value;
+        }
+        continue;
+    }
+
+    if (parameter->is_int)
+      *(int *)(base + parameter->offset) = (int)value;
+    else
+      *(float *)(base + parameter->offset) = value;
+  }
+}
+/*---------------------------------------------------------------------------------------------------------------*/
+
+/*-----*/
+/* Bot */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+// Add a push away from `threat_pos` to `push`, which gets stronger the closer the threat is
+void bot_add_threat(Vector2 *push, Vector2 player_pos, Vector2 threat_pos, float threat_size, float weight) {
+  Vector2 away = Vector2Subtract(player_pos, threat_pos);
+  float distance = fmaxf(Vector2Length(away) - threat_size, 0.05f);
+  if (distance > BOT_THREAT_RADIUS) return;
+
+  *push = Vector2Add(*push, Vector2Scale(sim_normalise(away), weight / (distance * distance)));
+}
+
+// Get the bot's controls for the next update. The bot kites away from nearby enemies, boss shots and the walls,
+// and aims at the boss while it is active, and otherwise at the closest enemy
+PlayerInput bot_get_input(const GameState *game_state, const BossType *boss_types, const Constants *constants) {
+  const Player *player = &game_state->player;
+  const EnemyManager *enemy_manager = &game_state->enemy_manager;
+  const ProjectilePool *enemy_projectiles = game_state->projectile_manager.pools + ALLEGIANCE_ENEMIES;
+  const Boss *boss = &game_state->boss;
+
+  Vector2 push = Vector2Zero();
+  Vector2 aim_pos = Vector2Add(player->pos, (Vector2){1, 0});
+  float closest_distance = INFINITY;
+
+  for (int i = 0, enemies_counted = 0; i < enemy_manager->capacity && enemies_counted < enemy_manager->enemy_count;
+       i++) {
+    const Enemy *enemy = enemy_manager->enemies + i;
+    if (!enemy->is_active) continue;
+    enemies_counted++;
+
+    bot_add_threat(&push, player->pos, enemy->pos, enemy->size, 1);
+
+    float distance = Vector2Distance(player->pos, enemy->pos);
+    if (distance < closest_distance) {
+      closest_distance = distance;
+      aim_pos = enemy->pos;
+    }
+  }
+
+  if (boss->is_active) {
+    const BossType *boss_type = boss_types + boss->type;
+    bot_add_threat(&push, player->pos, boss->pos, boss_type->size, 2);
+    aim_pos = boss->pos;  // Enemies keep spawning while the boss is up, so it has to be the priority
+  }
+
+  for (int i = 0, projectiles_counted = 0;
+       i < enemy_projectiles->capacity && projectiles_counted < enemy_projectiles->projectile_count; i++) {
+    const Projectile *projectile = enemy_projectiles->projectiles + i;
+    if (!projectile->is_active) continue;
+    projectiles_counted++;
+
+    Vector2 projectile_pos = projectile_get_position(projectile, game_state->time);
+    bot_add_threat(&push, player->pos, projectile_pos, projectile->size, 0.5);
+  }
+
+  // Steer away from the edges of the game area, which the bot would otherwise get pinned against
+  Vector2 half_area = Vector2Scale(constants->game_area_dimensions, 0.5);
+  float wall_distances[4] = {player->pos.x + half_area.x, half_area.x - player->pos.x, player->pos.y + half_area.y,
+                             half_area.y - player->pos.y};
+  Vector2 wall_normals[4] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+  for (int i = 0; i < 4; i++) {
+    float distance = fmaxf(wall_distances[i] - player->size, 0.05f);
+    if (distance < BOT_WALL_MARGIN) push = Vector2Add(push, Vector2Scale(wall_normals[i], 0.5f / distance));
+  }
+  push = Vector2Add(push, Vector2Scale(player->pos, -BOT_CENTRE_PULL));
+
+  return (PlayerInput){.move_direction = sim_normalise(push), .aim_pos = aim_pos, .is_firing = true};
+}
+/*---------------------------------------------------------------------------------------------------------------*/
+
+/*---------------*/
+/* Running games */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+// Play one complete game with the bot, using `events` as the updates' scratch event buffer. Collisions are found
+// on `collision_workers` too, unless it is NULL
+GameResult balance_run_game(GameState *game_state, GameEventBuffer *events, CollisionWorkers *collision_workers,
+                            const BalanceRun *run, uint64_t seed) {
+  start_game(game_state, run->boss_types, seed, NULL, run->constants);
+
+  GameResult result = {0};
+  while (!game_state->player.is_defeated && game_state->time < run->max_time) {
+    PlayerInput input = bot_get_input(game_state, run->boss_types, run->constants);
+    bool boss_was_active = game_state->boss.is_active;
+    game_state_update(game_state, &input, BALANCE_FRAME_TIME, run->enemy_types, run->boss_types, events,
+                      collision_workers, run->constants);
+    if (boss_was_active && !game_state->boss.is_active && !game_state->player.is_defeated) result.boss_kills++;
+  }
+
+  result.survival_time = game_state->time;
+  result.score = game_state->player.score;
+  result.reached_time_limit = !game_state->player.is_defeated;
+  return result;
+}
+
+// Worker thread. Takes games from the run until none are left
+void *balance_run_worker(void *arg) {
+  BalanceRun *run = arg;
+
+  GameState game_state = {0};
+  initialise_game(&game_state.player, &game_state.enemy_manager, &game_state.projectile_manager, run->constants);
+  for (int i = 0; i < run->num_upgrades; i++) {
+    Upgrade upgrade = run->upgrades[i];
+    upgrade.base_stat = *player_get_upgradeable_stat(&game_state.player, upgrade.stat);
+    upgrade_apply_level(&upgrade, &game_state.player, run->constants);
+  }
+  GameEventBuffer events = {0};
+  CollisionWorkers collision_workers;
+  CollisionWorkers *workers = NULL;
+  if (run->collision_threads > 1) {
+    collision_workers_init(&collision_workers, run->collision_threads);
+    workers = &collision_workers;
+  }
+
+  while (true) {
+    pthread_mutex_lock(&run->mutex);
+    int game = run->next_game++;
+    pthread_mutex_unlock(&run->mutex);
+    if (game >= run->num_games) break;
+
+    run->results[game] = balance_run_game(&game_state, &events, workers, run, run->base_seed + game);
+  }
+
+  cleanup_game(&game_state.enemy_manager, &game_state.projectile_manager);
+  game_event_buffer_cleanup(&events);
+  if (workers) collision_workers_cleanup(workers);
+  return NULL;
+}
+/*---------------------------------------------------------------------------------------------------------------*/
+
+/*-----------*/
+/* Reporting */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+// Print the mean, 10th/50th/90th percentiles and maximum of some values. Sorts the values
+void print_distribution(const char *label, float *values, int count) {
+  qsort(values, count, sizeof *values, compare_floats);
+  double sum = 0;
+  for (int i = 0; i < count; i++) sum += values[i];
+
+  printf("  %-18s mean %8.1f  p10 %8.1f  p50 %8.1f  p90 %8.1f  max %8.1f\n", label, sum / count,
+         values[count / 10], values[count / 2], values[count * 9 / 10], values[count - 1]);
+}
+
+// Get the total cost of buying an upgrade `level` times from scratch
+float get_upgrade_total_cost(const Upgrade *upgrade, const Constants *constants) {
+  float total = 0;
+  for (int level = 0; level < upgrade->level; level++) {
+    total += upgrade->base_cost * sim_pow(constants->upgrade_cost_multiplier, level);
+  }
+  return total;
+}
+
+void print_results(const BalanceRun *run, double wall_time, int num_threads) {
+  float *values = malloc(run->num_games * sizeof *values);
+  if (!values) {
+    fprintf(stderr, "Unable to allocate memory for results.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  int num_time_limited = 0;
+  for (int i = 0; i < run->num_games; i++) {
+    values[i] = run->results[i].survival_time;
+    num_time_limited += run->results[i].reached_time_limit;
+  }
+  printf("  games              %d (%d reached the %.0f s time limit)\n", run->num_games, num_time_limited,
+         run->max_time);
+  print_distribution("survival time (s)", values, run->num_games);
+
+  for (int i = 0; i < run->num_games; i++) values[i] = run->results[i].score;
+  print_distribution("score", values, run->num_games);
+  free(values);
+
+  int boss_kill_counts[4] = {0};  // Number of games with 0, 1, 2 and 3+ boss kills
+  for (int i = 0; i < run->num_games; i++) {
+    boss_kill_counts[run->results[i].boss_kills < 3 ? run->results[i].boss_kills : 3]++;
+  }
+  printf("  boss kills         0: %5.1f%%  1: %5.1f%%  2: %5.1f%%  3+: %5.1f%%\n",
+         100.0 * boss_kill_counts[0] / run->num_games, 100.0 * boss_kill_counts[1] / run->num_games,
+         100.0 * boss_kill_counts[2] / run->num_games, 100.0 * boss_kill_counts[3] / run->num_games);
+
+  // Relate the upgrades the bot started with to how much a game earns
+  float upgrade_costs[2] = {0};  // Indexed by UpgradeType
+  for (int i = 0; i < run->num_upgrades; i++) {
+    upgrade_costs[run->upgrades[i].type] += get_upgrade_total_cost(run->upgrades + i, run->constants);
+  }
+  if (upgrade_costs[UPGRADE_TYPE_MONEY] > 0 || upgrade_costs[UPGRADE_TYPE_BOSS_POINTS] > 0) {
+    printf("  upgrades cost      $%.0f and %.0f boss points\n", upgrade_costs[UPGRADE_TYPE_MONEY],
+           upgrade_costs[UPGRADE_TYPE_BOSS_POINTS]);
+  }
+
+  printf("  throughput         %.1f games/s (%.1f games/s per core)\n", run->num_games / wall_time,
+         run->num_games / wall_time / num_threads);
+}
+/*---------------------------------------------------------------------------------------------------------------*/
+
+void print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options] [parameter set...]\n"
+          "  -n <games>    Games to play per parameter set (default 1000)\n"
+          "  -j <threads>  Worker threads (default: one per core)\n"
+          "  -c <threads>  Threads to split each game's collision detection between (default 1)\n"
+          "  -s <seed>     Seed of the first game (default 1)\n"
+          "  -t <seconds>  Stop games after this much game time (default 600)\n"
+          "  -p <path>     Content pack to load (default " CONTENT_PACK_PATH ")\n"
+          "  -l            List the parameters which can be overridden\n"
+          "  -h            Show this help\n"
+          "A parameter set is \"default\" or a comma separated list of name=value overrides.\n",
+          program);
+}
+
+int main(int argc, char **argv) {
+  int num_games = 1000;
+  int num_threads = get_default_thread_count();
+  int collision_threads = 1;
+  uint64_t base_seed = 1;
+  float max_time = 600;
+  const char *pack_path = CONTENT_PACK_PATH;
+  ParameterSet sets[MAX_PARAMETER_SETS];
+  int num_sets = 0;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (strcmp(arg, "-n") == 0 && has_value) {
+      num_games = atoi(argv[++i]);
+    } else if (strcmp(arg, "-j") == 0 && has_value) {
+      num_threads = atoi(argv[++i]);
+    } else if (strcmp(arg, "-c") == 0 && has_value) {
+      collision_threads = atoi(argv[++i]);
+    } else if (strcmp(arg, "-s") == 0 && has_value) {
+      base_seed = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "-t") == 0 && has_value) {
+      max_time = strtof(argv[++i], NULL);
+    } else if (strcmp(arg, "-p") == 0 && has_value) {
+      pack_path = argv[++i];
+    } else if (strcmp(arg, "-l") == 0) {
+      for (size_t j = 0; j < NUM_PARAMETERS; j++) printf("%s\n", PARAMETERS[j].name);
+      return EXIT_SUCCESS;
+    } else if (strcmp(arg, "-h") == 0) {
+      print_usage(argv[0]);
+      return EXIT_SUCCESS;
+    } else if (arg[0] == '-') {
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    } else if (num_sets == MAX_PARAMETER_SETS) {
+      fprintf(stderr, "Too many parameter sets (the maximum is %d).\n", MAX_PARAMETER_SETS);
+      return EXIT_FAILURE;
+    } else {
+      sets[num_sets++] = parameter_set_parse(arg);
+    }
+  }
+  if (num_sets == 0) sets[num_sets++] = parameter_set_parse("default");
+  if (num_games <= 0 || num_threads <= 0 || collision_threads <= 0 || max_time <= 0) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  // Load the content once. Each parameter set is applied to a copy
+  GameColours game_colours = {0};
+  Constants loaded_constants = {.game_colours = &game_colours, .screen_dimensions = {16, 9}};
+  EnemyType enemy_types[MAX_ENEMY_TYPES] = {0};
+  BossType loaded_boss_types[1] = {0};
+  Player loaded_player = {0};
+  Upgrade loaded_upgrades[PACK_NUM_UPGRADE_STATS] = {0};
+  Shop shop = {.upgrades = loaded_upgrades, .num_upgrades = PACK_NUM_UPGRADE_STATS};
+  if (!content_pack_load(pack_path, &game_colours, &loaded_constants, enemy_types, loaded_boss_types, &shop,
+                         &loaded_player, false)) {
+    fprintf(stderr, "Unable to load content from %s.\n", pack_path);
+    return EXIT_FAILURE;
+  }
+
+  int total_threads = num_threads * collision_threads;  // Used to report the throughput per core
+  printf("Playing %d games per parameter set on %d threads", num_games, num_threads);
+  if (collision_threads > 1) printf(" (with collisions split between %d threads)", collision_threads);
+  printf("\n");
+
+  pthread_t *threads = malloc(num_threads * sizeof *threads);
+  GameResult *results = malloc(num_games * sizeof *results);
+  if (!threads || !results) {
+    fprintf(stderr, "Unable to allocate memory for the run.\n");
+    return EXIT_FAILURE;
+  }
+
+  int total_games = 0;
+  double total_wall_time = 0;
+  for (int i = 0; i < num_sets; i++) {
+    Constants constants = loaded_constants;
+    BossType boss_types[1] = {loaded_boss_types[0]};
+    Upgrade upgrades[PACK_NUM_UPGRADE_STATS];
+    memcpy(upgrades, loaded_upgrades, sizeof upgrades);
+    parameter_set_apply(sets + i, &constants, boss_types, upgrades, PACK_NUM_UPGRADE_STATS);
+
+    BalanceRun run = {.constants = &constants,
+                      .enemy_types = enemy_types,
+                      .boss_types = boss_types,
+                      .upgrades = upgrades,
+                      .num_upgrades = PACK_NUM_UPGRADE_STATS,
+                      .num_games = num_games,
+                      .base_seed = base_seed,
+                      .max_time = max_time,
+                      .collision_threads = collision_threads,
+                      .results = results};
+    pthread_mutex_init(&run.mutex, NULL);
+
+    double start_time = get_wall_time();
+    for (int j = 0; j < num_threads; j++) {
+      if (pthread_create(threads + j, NULL, balance_run_worker, &run) != 0) {
+        fprintf(stderr, "Unable to start worker thread.\n");
+        return EXIT_FAILURE;
+      }
+    }
+    for (int j = 0; j < num_threads; j++) pthread_join(threads[j], NULL);
+    double wall_time = get_wall_time() - start_time;
+    pthread_mutex_destroy(&run.mutex);
+
+    printf("\nParameter set %d: %s\n", i + 1, sets[i].description);
+    print_results(&run, wall_time, total_threads);
+
+    total_games += num_games;
+    total_wall_time += wall_time;
+  }
+
+  printf("\nThroughput: %.1f games/s per core (%d games in %.2f s on %d threads)\n",
+         total_games / total_wall_time / total_threads, total_games, total_wall_time, total_threads);
+
+  free(threads);
+  free(results);
+  return EXIT_SUCCESS;
+}
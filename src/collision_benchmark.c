@@ -0,0 +1,170 @@
+// Times finding the player's projectiles' hits on a crowd of enemies, on one thread and then split between more
+// threads, e.g.
+//
+//   collision_benchmark -e 2000 -n 2000 -f 200 -j 4
+//
+// Every multithreaded run is checked against the single-threaded one, and must find exactly the same hits in the
+// same order. Prints the time per frame, the speed-up over one thread and the speed-up per core for each thread
+// count. Run with -h for options
+#define LOOP_SHOOTER_NO_MAIN
+#include "game.c"
+
+#include <time.h>
+
+#define BENCHMARK_FRAME_TIME (1.0f / 60)  // Projectiles move on by one 60th of a second each frame
+#define BENCHMARK_LOOP_FRAMES 60          // Projectiles go back to where they started after this many frames
+
+double get_wall_time() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Whether two event buffers hold the same hits in the same order
+bool events_match(const GameEventBuffer *a, const GameEventBuffer *b) {
+  if (a->count != b->count) return false;
+  for (int i = 0; i < a->count; i++) {
+    const GameEvent *x = a->events + i, *y = b->events + i;
+    if (x->type != y->type || x->projectile != y->projectile || x->enemy != y->enemy) return false;
+  }
+  return true;
+}
+
+// Time detecting collisions for `num_frames` frames on `num_threads` threads, returning the seconds per frame. The
+// single-threaded run records the hits of each frame of the loop in `expected`, and checks the repeats of the loop
+// against them. Other runs check every frame, and a negative time is returned if any hits differ
+double time_detection(const ProjectilePool *pool, const EnemyManager *enemy_manager, const Boss *boss,
+                      const BossType *boss_types, int num_frames, int num_threads, GameEventBuffer *expected) {
+  CollisionWorkers workers;
+  if (num_threads > 1) collision_workers_init(&workers, num_threads);
+  GameEventBuffer events = {0};
+
+  double total_time = 0;
+  bool is_matching = true;
+  for (int frame = 0; frame < num_frames; frame++) {
+    float time = (frame % BENCHMARK_LOOP_FRAMES) * BENCHMARK_FRAME_TIME;
+    game_event_buffer_clear(&events);
+
+    double start_time = get_wall_time();
+    if (num_threads > 1) {
+      collision_workers_detect(&workers, pool, enemy_manager, boss, boss_types, time, &events);
+    } else {
+      player_projectiles_detect_collisions(pool, 0, pool->capacity, enemy_manager, boss, boss_types, time,
+                                           &events);
+    }
+    total_time += get_wall_time() - start_time;
+
+    GameEventBuffer *frame_expected = expected + frame % BENCHMARK_LOOP_FRAMES;
+    if (frame >= BENCHMARK_LOOP_FRAMES || num_threads > 1) {
+      is_matching = is_matching && events_match(&events, frame_expected);
+    } else {
+      for (int i = 0; i < events.count; i++) game_event_buffer_push(frame_expected, events.events[i]);
+    }
+  }
+
+  game_event_buffer_cleanup(&events);
+  if (num_threads > 1) collision_workers_cleanup(&workers);
+  return is_matching ? total_time / num_frames : -1;
+}
+
+void print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -e <enemies>      Active enemies (default 2000)\n"
+          "  -n <projectiles>  Active player projectiles (default 2000)\n"
+          "  -f <frames>       Frames to time for each thread count (default 200, at least %d)\n"
+          "  -j <threads>      Most threads to split detection between (default: one per core)\n"
+          "  -h                Show this help\n",
+          program, BENCHMARK_LOOP_FRAMES);
+}
+
+int main(int argc, char **argv) {
+  int num_enemies = 2000;
+  int num_projectiles = 2000;
+  int num_frames = 200;
+  long num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+  int max_threads = num_cores > 0 ? (int)num_cores : 1;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (strcmp(arg, "-e") == 0 && has_value) {
+      num_enemies = atoi(argv[++i]);
+    } else if (strcmp(arg, "-n") == 0 && has_value) {
+      num_projectiles = atoi(argv[++i]);
+    } else if (strcmp(arg, "-f") == 0 && has_value) {
+      num_frames = atoi(argv[++i]);
+    } else if (strcmp(arg, "-j") == 0 && has_value) {
+      max_threads = atoi(argv[++i]);
+    } else if (strcmp(arg, "-h") == 0) {
+      print_usage(argv[0]);
+      return EXIT_SUCCESS;
+    } else {
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (num_enemies <= 0 || num_projectiles <= 0 || max_threads <= 0) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (num_frames < BENCHMARK_LOOP_FRAMES) {
+    // The single threaded run records the hits of a whole loop, which the other thread counts are checked against
+    fprintf(stderr, "Need at least %d frames (-f), one full loop of the projectiles, to check the hits.\n",
+            BENCHMARK_LOOP_FRAMES);
+    return EXIT_FAILURE;
+  }
+
+  // Scatter the enemies and projectiles over a game area at random, with the projectiles flying in random
+  // directions. The boss is left out, as it is a single circle test per projectile
+  Constants constants = {.game_area_dimensions = {32, 18}, .initial_max_enemies = 1, .initial_max_projectiles = 1};
+  Vector2 half_area = Vector2Scale(constants.game_area_dimensions, 0.5);
+  RandomState random;
+  random_seed(&random, 1);
+
+  EnemyManager enemy_manager = {0};
+  ProjectileManager projectile_manager = {0};
+  Player player = {0};
+  initialise_game(&player, &enemy_manager, &projectile_manager, &constants);
+  for (int i = 0; i < num_enemies; i++) {
+    Enemy enemy = {.pos = {get_random_float(&random, -half_area.x, half_area.x),
+                           get_random_float(&random, -half_area.y, half_area.y)},
+                   .size = get_random_float(&random, 0.2, 0.6),
+                   .is_active = true};
+    enemy_manager_add_enemy(&enemy_manager, enemy);
+  }
+  ProjectilePool *pool = projectile_manager.pools + ALLEGIANCE_PLAYER;
+  for (int i = 0; i < num_projectiles; i++) {
+    Projectile projectile = {.spawn_pos = {get_random_float(&random, -half_area.x, half_area.x),
+                                           get_random_float(&random, -half_area.y, half_area.y)},
+                             .vel = Vector2Scale(sim_unit_vector(get_random_float(&random, 0, 1)), 5),
+                             .size = 0.1,
+                             .is_active = true};
+    projectile_pool_add_projectile(pool, projectile, &constants);
+  }
+  Boss boss = {0};
+  BossType boss_types[1] = {0};
+
+  printf("Detecting collisions between %d projectiles and %d enemies for %d frames\n", num_projectiles,
+         num_enemies, num_frames);
+  printf("  %7s  %8s  %8s  %8s\n", "threads", "ms/frame", "speed-up", "per core");
+
+  GameEventBuffer expected[BENCHMARK_LOOP_FRAMES] = {0};
+  double single_thread_time = 0;
+  for (int num_threads = 1; num_threads <= max_threads; num_threads++) {
+    double frame_time =
+        time_detection(pool, &enemy_manager, &boss, boss_types, num_frames, num_threads, expected);
+    if (frame_time < 0) {
+      fprintf(stderr, "Detection on %d threads found different hits to one thread.\n", num_threads);
+      return EXIT_FAILURE;
+    }
+    if (num_threads == 1) single_thread_time = frame_time;
+
+    double speed_up = single_thread_time / frame_time;
+    printf("  %7d  %8.3f  %8.2f  %8.2f\n", num_threads, 1e3 * frame_time, speed_up, speed_up / num_threads);
+  }
+
+  for (int i = 0; i < BENCHMARK_LOOP_FRAMES; i++) game_event_buffer_cleanup(expected + i);
+  cleanup_game(&enemy_manager, &projectile_manager);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,163 @@
+#ifndef CONTENT_PACK_H
+#define CONTENT_PACK_H
+
+#include <stdint.h>
+
+// Binary content pack format shared by the game and pack_compiler. A pack is laid out as:
+//
+//   PackHeader
+//   uint32_t colours[num_colours]          (0xRRGGBBAA, in PACK_COLOURS order)
+//   PackConstants
+//   PackEnemyType enemy_types[num_enemy_types]
+//   PackBossType
+//   PackUpgrade upgrades[num_upgrades]
+//
+// Every field is 4 bytes wide so the records have no padding. Values are stored in native byte order (all the
+// platforms we build for are little endian). Colours elsewhere in the pack are stored as indices into the colour
+// table and enemy type references as indices into the enemy type table (-1 for none)
+
+#define CONTENT_PACK_MAGIC 0x4B50534C  // "LSPK" when read as bytes
+#define CONTENT_PACK_VERSION 2
+
+#define MAX_ENEMY_TYPES 16  // Upper limit on the number of enemy types in a pack
+
+// Names of the colours in the game's palette, in the order they appear in GameColours and the pack colour table
+#define PACK_COLOURS(X) \
+  X(red_1)              \
+  X(red_2)              \
+  X(red_3)              \
+  X(blue_1)             \
+  X(blue_2)             \
+  X(blue_3)             \
+  X(blue_4)             \
+  X(green_1)            \
+  X(green_2)            \
+  X(green_3)            \
+  X(yellow_1)           \
+  X(yellow_2)           \
+  X(yellow_3)           \
+  X(pink_1)             \
+  X(pink_2)             \
+  X(brown_1)            \
+  X(brown_2)            \
+  X(white)              \
+  X(grey_1)             \
+  X(grey_2)             \
+  X(grey_3)             \
+  X(grey_4)             \
+  X(grey_5)             \
+  X(grey_6)             \
+  X(black)
+
+#define PACK_COLOUR_COUNT_ONE(name) +1
+#define PACK_NUM_COLOURS (0 PACK_COLOURS(PACK_COLOUR_COUNT_ONE))
+
+// Player stats which can be upgraded in the shop. The shop screen lays out its upgrades in this order
+typedef enum PackUpgradeStat {
+  PACK_UPGRADE_STAT_FIRERATE,
+  PACK_UPGRADE_STAT_PROJECTILE_SPEED,
+  PACK_UPGRADE_STAT_PROJECTILE_SIZE,
+  PACK_UPGRADE_STAT_PROJECTILE_DAMAGE,
+  PACK_NUM_UPGRADE_STATS
+} PackUpgradeStat;
+
+typedef struct PackHeader {
+  uint32_t magic;            // Always CONTENT_PACK_MAGIC
+  uint32_t version;          // Always CONTENT_PACK_VERSION
+  uint32_t size;             // Total size of the pack in bytes (including this header)
+  uint32_t num_colours;      // Number of entries in the colour table. Always PACK_NUM_COLOURS
+  uint32_t num_enemy_types;  // Number of enemy types in the pack (at most MAX_ENEMY_TYPES)
+  uint32_t num_upgrades;     // Number of shop upgrades in the pack. Always PACK_NUM_UPGRADE_STATS
+} PackHeader;
+
+// Subset of the game's Constants which is loaded from the pack. See Constants for descriptions of the fields
+typedef struct PackConstants {
+  float game_area_dimensions[2];
+  int32_t target_fps;
+
+  float player_start_pos[2];
+  float player_base_speed;
+  float player_base_size;
+  int32_t player_colour;
+
+  float player_base_firerate;
+  float player_base_projectile_speed;
+  float player_base_projectile_size;
+  float player_base_projectile_damage;
+  int32_t player_projectile_colour;
+
+  float upgrade_cost_multiplier;
+
+  int32_t initial_max_enemies;
+  float enemy_spawn_interval_min;
+  float enemy_spawn_interval_max;
+  float enemy_first_spawn_interval;
+  int32_t enemy_spawn_min_wave_size;
+  float enemy_spawn_additional_enemy_chance;
+  float initial_enemy_credits;
+  float enemy_credit_multiplier;
+  float enemy_credit_exponent;
+
+  float enemy_update_interval;
+  float enemy_update_chance;
+  float enemy_lod_radius;
+  int32_t enemy_lod_interval;
+
+  int32_t initial_max_projectiles;
+
+  float font_spacing;
+  float background_square_size;
+  int32_t background_square_colour;
+  int32_t background_colour;
+  int32_t boss_health_bar_colour;
+  int32_t boss_health_bar_background_colour;
+  int32_t boss_health_bar_opacity;
+} PackConstants;
+
+typedef struct PackEnemyType {
+  float credit_cost;
+  float min_speed;
+  float max_speed;
+  float min_size;
+  float max_size;
+  int32_t colour;
+  int32_t turns_into;  // Index of the enemy type this type turns into, which must come earlier in the table
+} PackEnemyType;
+
+typedef struct PackBossType {
+  int32_t initial_score_to_spawn;
+  float max_health;
+  float speed;
+  float size;
+  int32_t colour;
+
+  float firerate;
+  int32_t shots_per_burst;
+  float projectile_speed;
+  float projectile_size;
+  int32_t projectile_colour;
+
+  float moving_duration;
+  float stationary_duration;
+
+  int32_t num_enemies_spawned_on_defeat;
+  int32_t enemy_type_spawned_on_defeat;
+  int32_t boss_points_on_defeat;
+  int32_t score_on_defeat;
+} PackBossType;
+
+typedef struct PackUpgrade {
+  int32_t type;          // 0 for money, 1 for boss points (matches UpgradeType)
+  float cost;            // Cost of the first purchase
+  float stat_increment;  // Increment of the stat as a fraction of its base value
+  int32_t stat;          // PackUpgradeStat that this upgrade increases
+} PackUpgrade;
+
+// Size in bytes of a pack with the given number of enemy types
+static inline uint32_t content_pack_expected_size(uint32_t num_enemy_types) {
+  return sizeof(PackHeader) + PACK_NUM_COLOURS * sizeof(uint32_t) + sizeof(PackConstants) +
+         num_enemy_types * sizeof(PackEnemyType) + sizeof(PackBossType) +
+         PACK_NUM_UPGRADE_STATS * sizeof(PackUpgrade);
+}
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef FIXED_MATH_H
+#define FIXED_MATH_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Integer-only maths used by the simulation when it is built with SIM_FIXED_POINT. Libm's transcendental functions
+// (and the compiler's freedom to fuse or reorder float operations) can give different results between compilers,
+// flags and architectures, whereas these only use integer arithmetic and exact float conversions, so they give
+// bit-identical results on every platform we build for.
+//
+// Values are Q16.16 (16 integer bits, 16 fractional bits) unless stated otherwise. Angles are binary angles, where
+// a full turn is 2^32 and wraps around naturally
+
+typedef int32_t fixed_t;
+
+#define FIXED_ONE (1 << 16)
+
+// Convert a float to Q16.16, rounding towards zero. The float must be in the range (-32768, 32768)
+static inline fixed_t fixed_from_float(float value) { return (fixed_t)(value * FIXED_ONE); }
+
+static inline float fixed_to_float(fixed_t value) { return value / (float)FIXED_ONE; }
+
+// Floor of the square root of an unsigned 64 bit integer (bit by bit method)
+static inline uint64_t fixed_isqrt64(uint64_t value) {
+  uint64_t result = 0;
+  uint64_t bit = (uint64_t)1 << 62;
+  while (bit > value) bit >>= 2;
+
+  while (bit) {
+    if (value >= result + bit) {
+      value -= result + bit;
+      result = (result >> 1) + bit;
+    } else {
+      result >>= 1;
+    }
+    bit >>= 2;
+  }
+  return result;
+}
+
+// Square root of a non-negative Q16.16 value
+static inline fixed_t fixed_sqrt(fixed_t value) { return (fixed_t)fixed_isqrt64((uint64_t)value << 16); }
+
+// Normalise the vector (x, y) in place. The zero vector is left unchanged, like Vector2Normalize
+static inline void fixed_normalise(fixed_t *x, fixed_t *y) {
+  int64_t scaled_x = *x, scaled_y = *y;
+  if (scaled_x == 0 && scaled_y == 0) return;
+
+  // Direction doesn't depend on length, so scale short vectors up first to keep as much precision as possible
+  while (llabs(scaled_x) < (1 << 29) && llabs(scaled_y) < (1 << 29)) {
+    scaled_x *= 2;
+    scaled_y *= 2;
+  }
+
+  int64_t length = (int64_t)fixed_isqrt64((uint64_t)(scaled_x * scaled_x + scaled_y * scaled_y));
+  *x = (fixed_t)(scaled_x * FIXED_ONE / length);
+  *y = (fixed_t)(scaled_y * FIXED_ONE / length);
+}
+
+// sin(i * pi / 512) for i in [0, 256], i.e. a quarter turn, in Q16.16
+static const int32_t FIXED_QUARTER_SINE_TABLE[257] = {
+        0,   402,   804,  1206,  1608,  2010,  2412,  2814,  3216,  3617,  4019,  4420,
+     4821,  5222,  5623,  6023,  6424,  6824,  7224,  7623,  8022,  8421,  8820,  9218,
+     9616, 10014, 10411, 10808, 11204, 11600, 11996, 12391, 12785, 13180, 13573, 13966,
+    14359, 14751, 15143, 15534, 15924, 16314, 16703, 17091, 17479, 17867, 18253, 18639,
+    19024, 19409, 19792, 20175, 20557, 20939, 21320, 21699, 22078, 22457, 22834, 23210,
+    23586, 23961, 24335, 24708, 25080, 25451, 25821, 26190, 26558, 26925, 27291, 27656,
+    28020, 28383, 28745, 29106, 29466, 29824, 30182, 30538, 30893, 31248, 31600, 31952,
+    32303, 32652, 33000, 33347, 33692, 34037, 34380, 34721, 35062, 35401, 35738, 36075,
+    36410, 36744, 37076, 37407, 37736, 38064, 38391, 38716, 39040, 39362, 39683, 40002,
+    40320, 40636, 40951, 41264, 41576, 41886, 42194, 42501, 42806, 43110, 43412, 43713,
+    44011, 44308, 44604, 44898, 45190, 45480, 45769, 46056, 46341, 46624, 46906, 47186,
+    47464, 47741, 48015, 48288, 48559, 48828, 49095, 49361, 49624, 49886, 50146, 50404,
+    50660, 50914, 51166, 51417, 51665, 51911, 52156, 52398, 52639, 52878, 53114, 53349,
+    53581, 53812, 54040, 54267, 54491, 54714, 54934, 55152, 55368, 55582, 55794, 56004,
+    56212, 56418, 56621, 56823, 57022, 57219, 57414, 57607, 57798, 57986, 58172, 58356,
+    58538, 58718, 58896, 59071, 59244, 59415, 59583, 59750, 59914, 60075, 60235, 60392,
+    60547, 60700, 60851, 60999, 61145, 61288, 61429, 61568, 61705, 61839, 61971, 62101,
+    62228, 62353, 62476, 62596, 62714, 62830, 62943, 63054, 63162, 63268, 63372, 63473,
+    63572, 63668, 63763, 63854, 63944, 64031, 64115, 64197, 64277, 64354, 64429, 64501,
+    64571, 64639, 64704, 64766, 64827, 64884, 64940, 64993, 65043, 65091, 65137, 65180,
+    65220, 65259, 65294, 65328, 65358, 65387, 65413, 65436, 65457, 65476, 65492, 65505,
+    65516, 65525, 65531, 65535, 65536};
+
+// Sine of an angle in the first quadrant, given as a fraction of a quarter turn in [0, 2^30]. Linearly
+// interpolates the table, which is accurate to about 3e-5
+static inline fixed_t fixed_quarter_sine(uint32_t quarter_fraction) {
+  uint32_t index = quarter_fraction >> 22;
+  int64_t remainder = quarter_fraction & ((1 << 22) - 1);
+  if (remainder == 0) return FIXED_QUARTER_SINE_TABLE[index];
+
+  int64_t step = FIXED_QUARTER_SINE_TABLE[index + 1] - FIXED_QUARTER_SINE_TABLE[index];
+  return FIXED_QUARTER_SINE_TABLE[index] + (fixed_t)(step * remainder / (1 << 22));
+}
+
+// Sine and cosine of a binary angle
+static inline void fixed_sin_cos(uint32_t angle, fixed_t *sine, fixed_t *cosine) {
+  uint32_t quarter_fraction = angle & ((1u << 30) - 1);
+  fixed_t rising = fixed_quarter_sine(quarter_fraction);
+  fixed_t falling = fixed_quarter_sine((1u << 30) - quarter_fraction);
+
+  switch (angle >> 30) {
+    case 0:
+      *sine = rising;
+      *cosine = falling;
+      break;
+    case 1:
+      *sine = falling;
+      *cosine = -rising;
+      break;
+    case 2:
+      *sine = -rising;
+      *cosine = -falling;
+      break;
+    default:
+      *sine = -falling;
+      *cosine = rising;
+      break;
+  }
+}
+
+// Base 2 logarithm of a positive float, in Q16.16. frexpf is exact, and the fractional bits of the logarithm are
+// found one at a time by repeated squaring of the mantissa
+static inline fixed_t fixed_log2(float value) {
+  int exponent;
+  float mantissa = frexpf(value, &exponent);  // value = mantissa * 2^exponent, mantissa in [0.5, 1)
+  uint64_t mantissa_q30 = (uint64_t)(mantissa * (float)(1u << 31));  // 2 * mantissa in Q2.30, so in [1, 2)
+
+  fixed_t result = (exponent - 1) * FIXED_ONE;
+  for (int bit = 15; bit >= 0; bit--) {
+    mantissa_q30 = (mantissa_q30 * mantissa_q30) >> 30;
+    if (mantissa_q30 >= (uint64_t)2 << 30) {
+      mantissa_q30 >>= 1;
+      result += 1 << bit;
+    }
+  }
+  return result;
+}
+
+// 2^(2^-i) for i in [1, 16], in Q2.30
+static const uint32_t FIXED_EXP2_FRACTION_TABLE[16] = {
+    1518500250, 1276901417, 1170923762, 1121280436, 1097253708, 1085434106,
+    1079572136, 1076653033, 1075196443, 1074468888, 1074105294, 1073923544,
+    1073832680, 1073787251, 1073764537, 1073753181};
+
+// 2 to the power of a Q16.16 value, returned as a float so that large results don't overflow
+static inline float fixed_exp2_to_float(fixed_t value) {
+  int32_t fraction = value & (FIXED_ONE - 1);  // Always non-negative, so the integer part is rounded down
+  int32_t integer = (value - fraction) / FIXED_ONE;
+
+  uint64_t result_q30 = (uint64_t)1 << 30;
+  for (int i = 0; i < 16; i++) {
+    if (fraction & (1 << (15 - i))) result_q30 = (result_q30 * FIXED_EXP2_FRACTION_TABLE[i]) >> 30;
+  }
+  return ldexpf((float)result_q30, integer - 30);
+}
+
+#endif
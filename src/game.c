@@ -5,15 +5,113 @@
 #include <assert.h>
 #include <math.h>
 #include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
 #include "raylib.h"
 #include "raymath.h"
+#include "rlgl.h"
+#include "content_pack.h"
+#include "fixed_math.h"
+#include <pthread.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <unistd.h>
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  // macOS has no MSG_NOSIGNAL, so SO_NOSIGPIPE is set on the socket instead
+#endif
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 
 // Makefile can set DEBUG level
 #ifndef DEBUG
 #define DEBUG 0
 #endif
 
+// CMake sets SIM_FIXED_POINT to make the simulation's maths bit-identical between builds (see the sim_ functions)
+#ifndef SIM_FIXED_POINT
+#define SIM_FIXED_POINT 0
+#endif
+
+#define CONTENT_PACK_PATH "content.pack"  // Path of the compiled content pack, relative to the working directory
+#define SAVE_PATH "save.dat"              // Path of the save file, relative to the working directory
+#define FRAME_TIME_REPORT_PATH "frame_times.csv"  // File each game's frame time summary is appended to
+#define REPLAY_PATH "last_game.replay"             // File the most recent game is recorded to
+
+#define SAVE_MAGIC 0x5653534C  // "LSSV" when read as bytes
+#define SAVE_VERSION 1
+
+#define REPLAY_MAGIC 0x5052534C  // "LSRP" when read as bytes
+#define REPLAY_VERSION 2
+
+#define ENEMY_SPEED_SCALE 1024.0f    // Fixed point steps per unit/s of enemy speed (so the maximum is 64 units/s)
+#define POOL_SIZING_HISTORY 4        // Number of recent games whose pool high-water marks are used to size pools
+#define SPATIAL_GRID_CELL_SIZE 2.0f  // Side length of the cells of spatial grids (in units)
+
+#define CIRCLE_LOD_LEVELS 5           // Number of circle levels of detail. Each has twice the segments of the last
+#define CIRCLE_LOD_MIN_SEGMENTS 8     // Segments in the coarsest circle level of detail
+#define CIRCLE_LOD_MAX_SEGMENTS (CIRCLE_LOD_MIN_SEGMENTS << (CIRCLE_LOD_LEVELS - 1))  // So 128
+#define CIRCLE_MAX_ERROR_PIXELS 0.5f  // Furthest a drawn circle's edges may fall inside the true circle
+
+#define PARTICLE_CAPACITY 16384   // Most particles alive at once on the game screen
+#define PARTICLE_LANES 4          // Particles updated by each vector operation (SSE and NEON are 4 floats wide)
+#define PARTICLE_SIZE 0.06f       // Side length of a particle (in units)
+#define PARTICLE_DRAG 3.0f        // Particles' speed is multiplied by e^-PARTICLE_DRAG each second
+#define PARTICLE_DRAW_CHUNK 1024  // Particles drawn between checks that the render batch has room
+#define PARTICLE_BURST_QUEUE_CAPACITY 256  // Number of bursts the render thread can fall behind by. Power of two
+
+#define CANVAS_BLEND_PIXELS 4         // Pixels blended by each vector operation when drawing to a software canvas
+#define SOFTWARE_FONT_GLYPH_WIDTH 5   // Columns of pixels in each glyph of the software renderer's bitmap font
+#define SOFTWARE_FONT_GLYPH_HEIGHT 8  // Rows of pixels in each glyph (the bottom row is for descenders)
+
+#define INPUT_QUEUE_CAPACITY 64  // Number of input messages the simulation thread can fall behind by. Power of two
+#define RENDER_FRAME_IS_NEW 4    // Flag set in RenderFrameBuffer.middle until the render thread takes that frame
+
+#define FRAME_TIME_SUB_BUCKET_BITS 4  // log2 of the number of frame time histogram buckets per power of two
+#define FRAME_TIME_SUB_BUCKETS (1 << FRAME_TIME_SUB_BUCKET_BITS)  // So durations are within 1/16 (6.25%)
+#define FRAME_TIME_NUM_BUCKETS ((33 - FRAME_TIME_SUB_BUCKET_BITS) * FRAME_TIME_SUB_BUCKETS)  // Covers any uint32_t
+
+#define ENEMY_DECAY_MAX_DAMAGE MAX_ENEMY_TYPES  // Damage which destroys any enemy (chains of types are shorter)
+
+#define GAME_EVENT_BUFFER_INITIAL_CAPACITY 64  // Events a game event buffer has room for before it first grows
+
+#define STATE_STREAM_SOCKET_PATH "loop_shooter.sock"  // Default state stream socket, in the working directory
+#define STATE_STREAM_POSITION_SCALE 256.0f   // Fixed point steps per unit of streamed positions and sizes
+#define STATE_STREAM_VELOCITY_SCALE 1024.0f  // Fixed point steps per unit/s of streamed projectile velocities
+#define STATE_STREAM_TIME_SCALE 1000.0f      // Fixed point steps per second of streamed times (so milliseconds)
+#define STATE_STREAM_HEALTH_SCALE 16.0f      // Fixed point steps per point of streamed boss health
+#define STATE_STREAM_MAX_RECORD_SIZE 40      // Most bytes an entity record in a tick can take
+#define STATE_STREAM_MAX_SLOTS (1 << 24)     // Most entity slots a viewer will make room for
+#define STATE_STREAM_MAX_PENDING (1 << 20)   // Bytes a viewer can fall behind by before it is disconnected
+
+#define QUALITY_NUM_LEVELS 4           // Number of quality levels the frame governor can step between
+#define FRAME_GOVERNOR_WINDOW 30       // Frames measured for each frame governor decision
+#define FRAME_GOVERNOR_CALM_WINDOWS 4  // Windows in a row with headroom needed before quality is stepped up
+
 typedef enum GameScreen { GAME_SCREEN_START, GAME_SCREEN_GAME, GAME_SCREEN_SHOP, GAME_SCREEN_END } GameScreen;
+typedef enum FramePacing { FRAME_PACING_CONTINUOUS, FRAME_PACING_EVENT_DRIVEN, FRAME_PACING_IDLE } FramePacing;
+typedef enum ParticleBurstType {
+  PARTICLE_BURST_ENEMY_DECAY,  // An enemy lost a layer
+  PARTICLE_BURST_ENEMY_DEATH,  // An enemy was destroyed
+  PARTICLE_BURST_BOSS_DEATH    // The boss was defeated
+} ParticleBurstType;
+typedef enum GameEventType {
+  GAME_EVENT_ENEMY_HIT,      // A player projectile touched an enemy
+  GAME_EVENT_BOSS_HIT,       // A player projectile touched the boss (and no enemies)
+  GAME_EVENT_PLAYER_HIT,     // An enemy projectile touched the player
+  GAME_EVENT_ENEMY_DECAYED,  // An enemy lost one or more layers, turning into the type it decays into
+  GAME_EVENT_ENEMY_KILLED,   // An enemy at the base type was destroyed
+  GAME_EVENT_BOSS_DAMAGED,   // The boss lost health
+  GAME_EVENT_BOSS_DEFEATED   // The boss was defeated
+} GameEventType;
 typedef enum ButtonState { BUTTON_STATE_DEFAULT, BUTTON_STATE_HOVER, BUTTON_STATE_PRESSED } ButtonState;
 typedef enum AnchorPosition {
   ANCHOR_TOP_LEFT,
@@ -64,14 +162,39 @@ typedef struct GameColours {
   Color black;
 } GameColours;
 
+// Points around the unit circle for each circle level of detail, so drawing a circle needs no trigonometry
+typedef struct CircleLods {
+  Vector2 unit_vertices[CIRCLE_LOD_LEVELS][CIRCLE_LOD_MAX_SEGMENTS + 1];  // The first point is repeated at the end
+  float max_radii[CIRCLE_LOD_LEVELS];  // Largest radius (in pixels) each level is within the error limit for
+  int level_bias;                      // Number of levels coarser than needed to draw at (see QualitySettings)
+} CircleLods;
+
+// Frame drawn on the CPU instead of through raylib, for machines with no GPU or display (see Software rendering).
+// Pixels are stored row by row from the top left, in the same layout as a raylib R8G8B8A8 image
+typedef struct SoftwareCanvas {
+  Color *pixels;
+  int width;
+  int height;
+} SoftwareCanvas;
+
 typedef struct Constants {
   GameColours *game_colours;          // Pointer to location of the game's colour palette
+  CircleLods *circle_lods;            // Pointer to the unit circle vertex tables used to draw circles
+  SoftwareCanvas *software_canvas;    // Canvas to draw to on the CPU, or NULL to draw through raylib
   Vector2 initial_window_resolution;  // Initial game window dimensions in pixels
   float aspect_ratio;                 // Aspect ratio to keep the game at (we draw black bars to maintain this)
   Vector2 screen_dimensions;          // Dimensions of the displayed portion of the play space in units
   Vector2 game_area_dimensions;       // Dimensions of the game area (in units)
 
-  int target_fps;  // Target frames per second of the game
+  int target_fps;         // Target frames per second of the game (how often it is drawn)
+  float simulation_rate;  // Number of simulation updates per second, independent of the frame rate
+  int idle_fps;           // Frames per second while the game is paused because the window is in the background
+  bool late_latch_aim;    // Whether the aim is re-read just before each frame is submitted (see LateLatch)
+
+  float rewind_duration;           // Number of seconds of gameplay kept for rewinding
+  float snapshot_rate;             // Number of rewind snapshots taken per second of gameplay
+  int snapshot_keyframe_interval;  // Number of rewind snapshots between full (non-delta) snapshots
+  float replay_keyframe_interval;  // Number of seconds of gameplay between keyframes in replays
 
   Vector2 player_start_pos;  // Starting position of the player
   float player_base_speed;   // Initial speed of the player
@@ -99,6 +222,8 @@ typedef struct Constants {
 
   float enemy_update_interval;  // Time interval between attempts at updating the enemy's desired position
   float enemy_update_chance;    // Chance (each update) that the enemy updates its desired position
+  float enemy_lod_radius;       // Distance from the player beyond which enemies move at a reduced rate
+  int enemy_lod_interval;       // Number of updates between moves of enemies beyond enemy_lod_radius
 
   int initial_max_projectiles;  // Maximum number of projectiles. This number should not be reached
 
@@ -131,13 +256,23 @@ typedef struct Player {
   float time_of_last_projectile;  // Time at which the most recent projectile was fired
 } Player;
 
+// The player's controls for one update. The simulation only sees input through this, so it can be driven by a bot
+// as well as the keyboard and mouse
+typedef struct PlayerInput {
+  Vector2 move_direction;  // Direction to move in. Should be normalised (or zero to stand still)
+  Vector2 aim_pos;         // Position in the game area to fire towards
+  bool is_firing;          // Whether the player wants to fire
+} PlayerInput;
+
 typedef enum UpgradeType { UPGRADE_TYPE_MONEY, UPGRADE_TYPE_BOSS_POINTS } UpgradeType;
 typedef struct Upgrade {
   UpgradeType type;      // Currency used to purchase the upgrade
   float cost;            // Cost of the next upgrade purchase
+  float base_cost;       // Cost of the first upgrade purchase
+  int level;             // Number of times the upgrade has been purchased
   float stat_increment;  // Increment of the stat being upgraded (as fraction of the base value)
   float base_stat;       // Base value of the stat being upgraded
-  float *stat;           // Pointer to the stat to adjust
+  PackUpgradeStat stat;  // Which of the player's stats to adjust
 } Upgrade;
 
 typedef struct Shop {
@@ -147,25 +282,40 @@ typedef struct Shop {
   int num_upgrades;   // Number of upgrades in the shop
 } Shop;
 
+// Outcome of hitting an enemy with some whole amount of damage. Each point knocks a layer off, decaying the enemy
+// into the type it turns into, until it reaches the base type, which the next point destroys. The score a hit
+// earns is the number of layers knocked off (num_decays, plus one if the enemy is destroyed)
+typedef struct EnemyDecay {
+  int8_t type;         // Type the enemy is left as, or the type it is destroyed at
+  uint8_t num_decays;  // Number of times the enemy decays (each of which picks a new speed)
+  bool is_destroyed;   // Whether the enemy is destroyed
+} EnemyDecay;
+
 typedef struct EnemyType {
-  float credit_cost;                   // Number of enemy manager credits this enemy type costs
-  float min_speed;                     // Minimum speed of this type of enemy
-  float max_speed;                     // Maximum speed of this type of enemy
-  float min_size;                      // Minimum size of this type of enemy
-  float max_size;                      // Maximum size of this type of enemy
-  Color colour;                        // Colour of this type of enemy
-  const struct EnemyType *turns_into;  // Pointer to the type of enemy that this enemy turns into upon death
+  float credit_cost;  // Number of enemy manager credits this enemy type costs
+  float min_speed;    // Minimum speed of this type of enemy
+  float max_speed;    // Maximum speed of this type of enemy
+  float min_size;     // Minimum size of this type of enemy
+  float max_size;     // Maximum size of this type of enemy
+  Color colour;       // Colour of this type of enemy
+  int turns_into;     // Index of the type this enemy turns into upon death (-1 for none)
+
+  // Outcome of a hit with each whole amount of damage, worked out when the content pack is loaded so that a hit
+  // doesn't have to follow the chain of types. Damage past the end destroys any enemy, like the last entry
+  EnemyDecay decays[ENEMY_DECAY_MAX_DAMAGE + 1];
 } EnemyType;
 
+// Enemies are kept to 24 bytes so that more of them fit in each cache line when the pool is swept every frame. The
+// speed is stored in fixed point (see enemy_get_speed) since it is only ever picked from a small range
 typedef struct Enemy {
   Vector2 pos;          // Current position of the enemy
   Vector2 desired_pos;  // Position that the enemy will try to move towards
-  bool is_active;       // Whether the enemy is processed and drawn
+  float size;           // Radius of the enemy circle
 
-  float speed;  // Speed at which the enemy moves (towards its desired position)
-  float size;   // Radius of the enemy circle
-
-  const EnemyType *type;  // Pointer to the type of the enemy
+  uint16_t speed;      // Speed at which the enemy moves (towards its desired position), in ENEMY_SPEED_SCALE units
+  uint8_t type;        // Index of the type of the enemy in the enemy type array
+  bool is_active : 1;  // Whether the enemy is processed and drawn
+  bool is_far : 1;     // Whether the enemy is far from the player, and so moves less often
 } Enemy;
 
 typedef struct BossType {
@@ -184,9 +334,9 @@ typedef struct BossType {
   float moving_duration;      // Duration of the moving part of the boss's movement cycle (in seconds)
   float stationary_duration;  // Duration of the stationary part of the boss's movement cycle (in seconds)
 
-  int num_enemies_spawned_on_defeat;              // Number of enemies spawned when the boss is defeated
-  const EnemyType *enemy_type_spawned_on_defeat;  // Type of enemy spawned when the boss is defeated
-  int boss_points_on_defeat;  // Number of boss points awarded to the player when the boss is defeated
+  int num_enemies_spawned_on_defeat;  // Number of enemies spawned when the boss is defeated
+  int enemy_type_spawned_on_defeat;   // Index of the type of enemy spawned when the boss is defeated
+  int boss_points_on_defeat;          // Number of boss points awarded to the player when the boss is defeated
   int score_on_defeat;        // Number of points awarded to the player when the boss is defeated
 } BossType;
 
@@ -204,13 +354,22 @@ typedef struct Boss {
   float time_of_last_projectile;    // Time at which the most recent projectile was fired
   float time_of_last_state_switch;  // Time at which the boss last switched between moving and being stationary
 
-  const BossType *boss_type;  // Pointer to the boss type of the boss
+  int type;  // Index of the type of the boss in the boss type array
 } Boss;
 
+// Usage of an entity pool's storage over the current game. A pool's storage starts each game at the size chosen by
+// its PoolSizing and doubles whenever it fills up
+typedef struct PoolStats {
+  int high_water;      // Most entities active at once
+  int grow_count;      // Number of times the storage has grown
+  size_t grown_bytes;  // Number of bytes the storage has grown by
+} PoolStats;
+
 typedef struct EnemyManager {
   Enemy *enemies;   // Pointer to array of enemies
   int enemy_count;  // Number of active enemies in the array
   int capacity;     // Capacity of the enemy array
+  PoolStats stats;  // Usage of the enemy array this game
 
   float enemy_spawn_interval;    // Number of seconds between spawns of enemies
   float time_of_last_spawn;      // Time of the last enemy spawn (in seconds since the start of the game)
@@ -218,26 +377,98 @@ typedef struct EnemyManager {
   float time_of_initialisation;  // Time of the enemy manager's initialisation (used in credit calculation)
 
   float time_of_last_update;  // Time of the last update of enemy positions
+  unsigned num_moves;         // Number of times the enemies have been moved this game, to stagger distant ones
 } EnemyManager;
 
-typedef enum ProjectileAllegiance { ALLEGIANCE_PLAYER, ALLEGIANCE_ENEMIES } ProjectileAllegiance;
+typedef enum ProjectileAllegiance { ALLEGIANCE_PLAYER, ALLEGIANCE_ENEMIES, NUM_ALLEGIANCES } ProjectileAllegiance;
+
+// Projectiles move in straight lines at constant speed, so rather than being moved every frame they store their
+// trajectory and their position is evaluated when needed (see projectile_get_position). Their allegiance and
+// colour aren't stored since they only depend on which pool the projectile is in
 typedef struct Projectile {
-  Vector2 pos;                      // Current position of the projectile
-  Vector2 dir;                      // Movement direction of the projectile. Should always be normalised
-  bool is_active;                   // Whether the projectile is processed and drawn
-  ProjectileAllegiance allegiance;  // Allegiance of the projectile (so it doesn't damage allies)
-
-  float speed;   // Speed at which the projectile moves (in its movement direction)
-  float size;    // Radius of the projectile circle
-  Color colour;  // Colour of the projectile circle
+  Vector2 spawn_pos;  // Position of the projectile when it was spawned
+  Vector2 vel;        // Velocity of the projectile (movement direction scaled by speed)
+  float spawn_time;   // Time at which the projectile was spawned
+  float size;         // Radius of the projectile circle
+
+  unsigned heap_position : 31;  // Position of the projectile's entry in its pool's expiry heap
+  unsigned is_active : 1;       // Whether the projectile is processed and drawn
 } Projectile;
 
+// Entry in a projectile pool's expiry heap
+typedef struct ProjectileExpiry {
+  float exit_time;  // Time at which the projectile leaves the game area
+  int index;        // Index of the projectile in the pool
+} ProjectileExpiry;
+
+// Storage for the projectiles of one allegiance. Every active projectile has an entry in the expiry heap (a binary
+// min-heap on exit time), so projectiles leaving the game area can be found without checking all of them
+typedef struct ProjectilePool {
+  Projectile *projectiles;        // Pointer to array of projectiles
+  ProjectileExpiry *expiry_heap;  // Pointer to heap of projectile exit times, with projectile_count entries
+  int projectile_count;           // Number of active projectiles in the array
+  int capacity;                   // Capacity of the projectile array and the expiry heap
+  PoolStats stats;                // Usage of the projectile array and expiry heap this game
+} ProjectilePool;
+
+// Projectiles are kept in a separate pool per allegiance, so each pool's collision pass only has to test against
+// the opposing side without checking every projectile's allegiance
 typedef struct ProjectileManager {
-  Projectile *projectiles;  // Pointer to array of projectiles
-  int projectile_count;     // Number of active projectiles in the array
-  int capacity;             // Capacity of the projectile array
+  ProjectilePool pools[NUM_ALLEGIANCES];  // Pool of projectiles for each ProjectileAllegiance
 } ProjectileManager;
 
+// High-water marks of the pools in recent games. Pools are sized from these at the start of each game, so they
+// don't have to grow in the middle of it, and shrunk back to them at the end of a game that needed more
+typedef struct PoolSizing {
+  int enemy_high_water[POOL_SIZING_HISTORY];                        // Enemy pool high-water mark of each game
+  int projectile_high_water[NUM_ALLEGIANCES][POOL_SIZING_HISTORY];  // Each projectile pool's, likewise
+  int num_games;  // Number of games recorded. Game n's marks are at index n % POOL_SIZING_HISTORY
+} PoolSizing;
+
+typedef struct RandomState {
+  uint64_t state;  // State of the xorshift64* generator. Must not be zero
+} RandomState;
+
+// Everything that changes while a game is being played. Other than the managers' entity storage, this contains no
+// pointers (entities refer to their types by index), so together with that storage it can be copied byte for byte
+// to snapshot and restore a game
+typedef struct GameState {
+  float time;               // Simulation time in seconds since the game started
+  RandomState random;       // Random number generator used by the simulation
+  Vector2 camera_position;  // Position of the top left of the screen in the game area
+
+  Player player;
+  EnemyManager enemy_manager;
+  ProjectileManager projectile_manager;
+  Boss boss;
+} GameState;
+
+// A single snapshot of a game in a SnapshotRing
+typedef struct Snapshot {
+  unsigned char *data;  // Encoded snapshot: raw serialised game state for keyframes, otherwise a delta from the
+                        // previous snapshot
+  size_t size;          // Size of the encoded snapshot in bytes
+  size_t allocated;     // Number of bytes allocated for `data`
+  size_t raw_size;      // Size of the serialised game state this snapshot decodes to
+  bool is_keyframe;     // Whether the snapshot can be decoded without the snapshots before it
+  float time;           // Simulation time at which the snapshot was taken
+} Snapshot;
+
+// Ring buffer of recent game snapshots for rewinding
+typedef struct SnapshotRing {
+  Snapshot *snapshots;  // Ring of snapshot slots
+  int capacity;         // Number of snapshot slots
+  int start;            // Slot holding the oldest snapshot
+  int count;            // Number of snapshots currently held
+  int since_keyframe;   // Number of snapshots taken since the most recent keyframe
+
+  unsigned char *previous;  // Serialised game state of the most recent snapshot (the base of the next delta)
+  size_t previous_size;     // Size of `previous` in bytes
+  unsigned char *current;   // Buffer the game state is serialised into before encoding
+  unsigned char *decoded;   // Buffer snapshots are decoded into when restoring
+  size_t buffer_capacity;   // Number of bytes allocated for each of the three buffers above
+} SnapshotRing;
+
 typedef struct Button {
   Rectangle bounds;        // Rectangle containing the bounds of the button (for pressing and drawing)
   AnchorType anchor_type;  // Type of anchor for displaying the button
@@ -251,18 +482,750 @@ typedef struct Button {
   Color text_colour;          // Colour of the text inside the button
   float font_size;            // Font size of the text inside the button
 } Button;
+
+// Shop progress as written to the save file. Fields are fixed width so the file is the same on every platform
+typedef struct SaveRecord {
+  uint32_t magic;                                  // Always SAVE_MAGIC
+  uint32_t version;                                // Always SAVE_VERSION
+  int32_t money;                                   // Shop money
+  int32_t boss_points;                             // Shop boss points
+  int32_t upgrade_levels[PACK_NUM_UPGRADE_STATS];  // Number of times each upgrade has been purchased
+} SaveRecord;
+
+typedef struct SaveWriter {
+  pthread_t thread;       // Background thread which writes the save file
+  pthread_mutex_t mutex;  // Protects the fields below
+  pthread_cond_t cond;    // Signalled when there is a record to write or the writer should stop
+  SaveRecord pending;     // Most recently requested record
+  bool has_pending;       // Whether `pending` has not been written yet
+  bool should_stop;       // Whether the thread should exit once there is nothing left to write
+  bool is_running;        // Whether the thread was started successfully
+} SaveWriter;
+
+// Uniform grid over the game area which indexes entities by the cell containing their centre, so the entities near
+// a rectangle can be found without checking every one. Entities are referred to by their index in their storage,
+// and are listed in the order they were inserted within each cell. Positions outside the game area are clamped
+// into the cells at its edge
+typedef struct SpatialGrid {
+  int columns;       // Number of cells across the game area
+  int rows;          // Number of cells down the game area
+  float max_radius;  // Largest radius of the entities inserted, which queries are expanded by
+
+  int *cell_starts;    // Index in `entries` of the first entity of each cell, plus the end of the last cell
+  int cell_capacity;   // Number of elements allocated for `cell_starts`
+  int *entries;        // Indices of the entities, grouped by cell
+  int *entry_cells;    // Cell of each entity, in insertion order (used while building)
+  int *entry_indices;  // Index of each entity, in insertion order (used while building)
+  int num_entries;     // Number of entities inserted
+  int entry_capacity;  // Number of elements allocated for each of the three entry arrays
+} SpatialGrid;
+
+// Histogram of durations in microseconds with logarithmically sized buckets (as in HdrHistogram), so recording is
+// a few instructions and percentiles are accurate to a fixed fraction of the value over the whole range
+typedef struct FrameTimeHistogram {
+  uint32_t counts[FRAME_TIME_NUM_BUCKETS];  // Number of durations in each bucket (see frame_time_get_bucket)
+  uint32_t count;                           // Total number of durations recorded
+  uint32_t max;                             // Longest duration recorded, exactly
+  uint64_t sum;                             // Sum of the durations recorded, for the mean
+} FrameTimeHistogram;
+
+// Percentiles of a FrameTimeHistogram, in milliseconds
+typedef struct FrameTimeSummary {
+  uint32_t count;  // Number of durations recorded
+  float mean;      // Mean duration
+  float p50;       // Median duration
+  float p95;       // 95th percentile duration
+  float p99;       // 99th percentile duration
+  float max;       // Longest duration
+} FrameTimeSummary;
+
+// Input latency of each game screen frame, split into the stages between the controls being read and the frame
+// showing their effect being presented
+typedef struct InputLatency {
+  FrameTimeHistogram simulation;    // From reading the controls to the simulation publishing a frame using them
+  FrameTimeHistogram drawing;       // From the frame being published to it being submitted (before EndDrawing)
+  FrameTimeHistogram presentation;  // From submission to EndDrawing returning, including the frame limiter wait
+  FrameTimeHistogram total;         // From reading the aim that was drawn to presentation (see LateLatch)
+} InputLatency;
+
+// Knobs the frame governor turns to keep the frame rate up. Level 0 is full quality
+typedef struct QualitySettings {
+  const char *name;            // Name used when logging changes of quality level
+  int circle_lod_bias;         // Number of levels coarser than needed that circles are drawn at
+  bool cull_off_screen;        // Whether render frames only index the entities on screen, not the whole game area
+  bool draw_background;        // Whether the background squares are drawn
+  bool show_full_debug_text;   // Whether the debug text lists everything, rather than just the entity counts
+} QualitySettings;
+
+// Watches how long frames take against the target_fps budget, and steps the quality level down when too many go
+// over it and back up once there has been plenty of headroom for a while
+typedef struct FrameGovernor {
+  int level;                 // Current quality level (see quality_get_settings)
+  int num_frames;            // Number of frames measured in the current window
+  int num_slow_frames;       // Number of those frames which went over budget
+  double draw_time_sum;      // Total time spent drawing the window's frames (in seconds)
+  int num_calm_windows;      // Number of windows in a row with plenty of headroom
+  int calm_windows_needed;   // Number of calm windows needed to step up. Doubles when a step up doesn't last
+  bool was_just_stepped_up;  // Whether the level was stepped up at the end of the last window
+  bool is_skipping_frame;    // Whether the next frame is ignored, since it began before the window was restarted
+} FrameGovernor;
+
+// Aim re-read by the render thread just before submitting a frame (see LateLatch), for the player's projectiles
+// fired in an interval of game time to be turned towards. An empty interval re-aims nothing
+typedef struct LateAim {
+  Vector2 aim_pos;       // Position re-read from the mouse
+  float spawned_after;   // Start of the interval of spawn times (exclusive)
+  float spawned_before;  // End of the interval of spawn times (inclusive)
+  unsigned sequence;     // Number of late aims sent so far, including this one
+} LateAim;
+
+// Input sampled by the render thread for the simulation thread. Debug key presses are sent as events since the
+// simulation thread may run zero or several updates per frame
+typedef struct InputMessage {
+  PlayerInput player_input;   // State of the player's controls this frame
+  bool is_rewinding;          // Whether the debug rewind key is held
+  bool toggle_invincibility;  // Whether the debug invincibility key was pressed this frame
+  bool add_score;             // Whether the debug score key was pressed this frame
+  double sample_time;         // GetTime when the controls were read, for measuring input latency
+  bool is_late_aim;           // Whether this only carries `late_aim`, and the controls aren't set
+  LateAim late_aim;           // Re-aim of projectiles already fired, if `is_late_aim`
+} InputMessage;
+
+// Render thread's record of the late aims it has sent. Projectiles are fired towards the aim read at the start of
+// a frame, so by the time the frame is presented the aim is at least a frame old. When late latching is on, the
+// mouse is read again just before submission, and the projectiles fired since the last frame drawn are turned
+// towards it, both in the frame being drawn and (through a late aim) in the simulation
+typedef struct LateLatch {
+  unsigned sequence;        // Sequence number of the last late aim sent
+  float pending_since;      // Start of the interval of the oldest late aim the simulation may not have applied
+  float last_latched_time;  // Game time of the last frame latched
+  double aim_sample_time;   // GetTime when the aim was re-read for the frame being drawn, or 0 if it wasn't
+} LateLatch;
+
+// Request for a burst of particles where something was hit. Particles are only for show, so rather than the
+// simulation keeping them in the game state, it sends these to the render thread, which owns the particles
+typedef struct ParticleBurst {
+  ParticleBurstType type;  // What happened, which sets the number, speed and lifetime of the particles
+  Vector2 pos;             // Centre of the circle that was hit
+  float radius;            // Radius of the circle that was hit. Particles start on its edge
+  Color colour;            // Colour of the particles
+} ParticleBurst;
+
+// Lock-free single producer, single consumer queue of particle bursts from the simulation thread to the render
+// thread, working the same way as InputQueue
+typedef struct ParticleBurstQueue {
+  ParticleBurst bursts[PARTICLE_BURST_QUEUE_CAPACITY];
+  unsigned head;  // Number of bursts pushed. Only written by the simulation thread
+  unsigned tail;  // Number of bursts popped. Only written by the render thread
+} ParticleBurstQueue;
+
+// PARTICLE_LANES floats operated on together. GCC and Clang compile arithmetic on these to SIMD instructions. The
+// reduced alignment allows loads from plain float arrays, and may_alias allows them to be accessed as floats too
+typedef float ParticleLanes __attribute__((vector_size(PARTICLE_LANES * 4), aligned(4), may_alias));
+
+// The channels of CANVAS_BLEND_PIXELS pixels, as stored and widened for blending. Like ParticleLanes, arithmetic
+// on these compiles to SIMD instructions
+typedef uint8_t CanvasBytes __attribute__((vector_size(CANVAS_BLEND_PIXELS * 4), aligned(1), may_alias));
+typedef uint16_t CanvasChannels __attribute__((vector_size(CANVAS_BLEND_PIXELS * 8)));
+
+// Fixed capacity pool of particles, stored as a structure of arrays so the update works on PARTICLE_LANES
+// particles at a time. Live particles are packed at the start of the arrays, so spawning appends one and releasing
+// one moves the last particle into its slot. The arrays are rounded up to a whole number of lanes, and the slots
+// past the live particles hold old (finite) values, which the update is free to overwrite
+typedef struct ParticleSystem {
+  float *pos_x;              // Positions (in units)
+  float *pos_y;
+  float *vel_x;              // Velocities (in units per second)
+  float *vel_y;
+  float *lives;              // Seconds each particle has left
+  float *inverse_lifetimes;  // 1 / the total lifetime of each particle, for fading it out
+  Color *colours;
+  int count;                 // Number of live particles
+  int capacity;              // Most particles that can be alive at once
+  RandomState random;        // Generator for the particles' directions and speeds, separate from the simulation's
+} ParticleSystem;
+
+// Something that happened during a game update. Only the fields relevant to the type are set
+typedef struct GameEvent {
+  GameEventType type;
+  int projectile;   // Index of the projectile in its pool (hits)
+  int enemy;        // Index of the enemy in the enemy manager (enemy hits, decays and kills)
+  int num_decays;   // Number of layers knocked off an enemy without destroying it (decays)
+  int object_type;  // Enemy or boss type before the event (decays, kills and the boss events)
+  Vector2 pos;      // Centre of the enemy or boss (decays, kills and the boss events)
+  float radius;     // Radius of the enemy or boss (decays, kills and boss defeats)
+  float damage;     // Health taken from the boss (boss damage)
+} GameEvent;
+
+// Events of one game update, in the order they happened. Collision detection only appends hits, without changing
+// the game, and the hits are then applied in one ordered pass, which appends what they did. Scoring and particles
+// are driven from the buffer rather than from inside the collision checks. Cleared at the start of each update
+typedef struct GameEventBuffer {
+  GameEvent *events;
+  int count;
+  int capacity;
+} GameEventBuffer;
+
+// Threads which split the player's projectiles into ranges and find their hits in parallel. Each range's hits go
+// to its own buffer, and the buffers are appended to the update's events in range order afterwards, so the events
+// are exactly those found by a single thread
+typedef struct CollisionWorkers {
+  int num_ranges;            // Number of ranges the projectiles are split into. The first is checked by the caller
+  pthread_t *threads;        // One thread for each of the other ranges
+  GameEventBuffer *buffers;  // Hits found in each range (the first range appends straight to the update's events)
+  int *range_starts;         // Pool index of the start of each range, followed by the end of the last range
+
+  pthread_mutex_t mutex;
+  pthread_cond_t job_started;   // Signalled when a job is posted, or the workers are asked to stop
+  pthread_cond_t job_finished;  // Signalled when the last worker finishes its range of a job
+  unsigned job_number;          // Number of jobs posted
+  int num_busy;                 // Workers still checking their range of the current job
+  int num_started;              // Workers which have started, used to give each its range
+  bool is_stopping;             // Set to make the workers exit
+
+  // Current job
+  const ProjectilePool *pool;
+  const EnemyManager *enemy_manager;
+  const Boss *boss;
+  const BossType *boss_types;
+  float time;
+} CollisionWorkers;
+
+// Lock-free single producer, single consumer queue of input messages from the render thread to the simulation
+// thread. The counters only ever increase (wrapping), and each is only written by one thread
+typedef struct InputQueue {
+  InputMessage messages[INPUT_QUEUE_CAPACITY];
+  unsigned head;  // Number of messages pushed. Only written by the render thread
+  unsigned tail;  // Number of messages popped. Only written by the simulation thread
+} InputQueue;
+
+// Everything the game screen draws, copied out of the game state by the simulation thread after each update. The
+// frame owns its entity storage, which only grows, so publishing doesn't allocate once the pools have settled
+typedef struct RenderFrame {
+  GameState game_state;  // Copy of the game state. Its expiry heap pointers are NULL (drawing doesn't use them)
+
+  Enemy *enemies;                              // Storage for the copy of the enemies
+  int enemy_capacity;                          // Capacity of `enemies`
+  Projectile *projectiles[NUM_ALLEGIANCES];    // Storage for the copy of each projectile pool
+  int projectile_capacities[NUM_ALLEGIANCES];  // Capacity of each of `projectiles`
+
+  SpatialGrid enemy_grid;                         // Grid of the active enemies, for culling
+  SpatialGrid projectile_grids[NUM_ALLEGIANCES];  // Grid of each pool's active projectiles at the frame's time
+
+  int snapshot_count;             // Number of rewind snapshots held, for the debug text
+  size_t snapshot_memory;         // Memory used by the rewind snapshots in bytes, for the debug text
+  FrameTimeSummary update_times;  // Times taken by the simulation updates so far this game, for the debug text
+  bool is_game_over;              // Whether the player was defeated in this frame (the simulation thread stops)
+  double input_sample_time;       // GetTime when the input of the frame's last update was read, or 0 if none was
+  double publish_time;            // GetTime when the frame was published
+  unsigned late_aim_sequence;     // Sequence number of the last late aim applied to the game (see LateAim)
+} RenderFrame;
+
+// Lock-free triple buffer of render frames. The simulation thread fills its back frame and swaps it with the
+// middle one to publish it, and the render thread swaps the middle frame with its front one when a new one is
+// available, so neither thread ever waits for the other
+typedef struct RenderFrameBuffer {
+  RenderFrame frames[3];
+  int back;    // Frame being written by the simulation thread
+  int middle;  // Most recently published frame, with RENDER_FRAME_IS_NEW set if it hasn't been taken yet. Atomic
+  int front;   // Frame being drawn by the render thread
+} RenderFrameBuffer;
+
+// Everything from outside the game that a game screen update depends on. Replays store these as they are, so
+// every field is 4 bytes wide and there is no padding
+typedef struct UpdateInput {
+  Vector2 move_direction;         // The player's input (see PlayerInput)
+  Vector2 aim_pos;                // Likewise
+  uint32_t is_firing;             // Likewise
+  uint32_t toggle_invincibility;  // Whether the player's invincibility is toggled before the update (debug only)
+  uint32_t num_score_bonuses;     // Number of times 50 points are added before the update (debug only)
+  Vector2 late_aim_pos;           // Late aim applied before the update (see LateAim)
+  float late_aim_spawned_after;   // Likewise
+  float late_aim_spawned_before;  // Likewise
+} UpdateInput;
+
+// Header at the start of a replay file. A replay records every update of a game screen, and is laid out as:
+//
+//   ReplayHeader
+//   Content pack the game was played with (content_pack_size bytes)
+//   Records, each a ReplayRecordKind byte followed by an UpdateInput or a keyframe
+//   ReplayIndexEntry index[num_keyframes]
+//   ReplayFooter
+//
+// A keyframe is its size (uint32_t) followed by the game state, as serialised by game_state_serialise, from just
+// before the next update. Values are stored in native byte order, like content packs
+typedef struct ReplayHeader {
+  uint32_t magic;              // Always REPLAY_MAGIC
+  uint32_t version;            // Always REPLAY_VERSION
+  float simulation_rate;       // Number of updates per second
+  float screen_dimensions[2];  // Screen dimensions in units (enemies spawn off screen, so the simulation needs it)
+  uint32_t sim_fixed_point;    // SIM_FIXED_POINT of the build which recorded the replay
+  uint32_t content_pack_size;  // Size of the content pack in bytes
+} ReplayHeader;
+
+typedef enum ReplayRecordKind {
+  REPLAY_RECORD_INPUT,     // An update
+  REPLAY_RECORD_KEYFRAME,  // A keyframe, which the updates before it lead to
+  REPLAY_RECORD_JUMP,      // A keyframe after the game jumped (was rewound), which the updates before don't reach
+} ReplayRecordKind;
+
+// Entry in a replay's keyframe index, which is ordered by tick
+typedef struct ReplayIndexEntry {
+  uint64_t offset;  // Offset of the keyframe's record in the file
+  uint32_t tick;    // Number of updates before the keyframe
+  uint32_t unused;  // Keeps the entry free of padding
+} ReplayIndexEntry;
+
+// Footer at the end of a replay file. It is written last, so an unfinished replay (e.g. if the game crashed) has
+// no footer magic
+typedef struct ReplayFooter {
+  uint64_t index_offset;   // Offset of the keyframe index in the file (which is also where the records end)
+  uint32_t num_keyframes;  // Number of entries in the keyframe index
+  uint32_t num_ticks;      // Number of updates recorded
+  uint32_t magic;          // Always REPLAY_MAGIC
+  uint32_t unused;         // Keeps the footer free of padding
+} ReplayFooter;
+
+// Records the game screen's updates to a replay file. While the simulation thread is running, only it records
+typedef struct ReplayWriter {
+  FILE *file;        // Replay being recorded, or NULL if not recording
+  const char *path;  // Path of the replay being recorded
+  uint64_t size;     // Number of bytes written to the replay so far
+  bool has_failed;   // Whether any write to the replay has failed
+
+  unsigned char *content_pack;  // Copy of the content pack the game is using, embedded in each replay
+  size_t content_pack_size;     // Size of `content_pack` in bytes
+  unsigned char *keyframe;      // Buffer the game state is serialised into for keyframes
+  size_t keyframe_capacity;     // Number of bytes allocated for `keyframe`
+  ReplayIndexEntry *index;      // Keyframes recorded so far
+  int num_keyframes;            // Number of entries in `index`
+  int index_capacity;           // Capacity of `index`
+
+  uint32_t num_ticks;             // Number of updates recorded so far
+  uint32_t keyframe_interval;     // Number of updates between keyframes
+  uint32_t ticks_since_keyframe;  // Number of updates recorded since the last keyframe
+  bool has_jumped;                // Whether the game jumped since the last update, so the next needs a keyframe
+} ReplayWriter;
+
+// A replay file mapped into memory to be played, and how far it has been played
+typedef struct Replay {
+  const unsigned char *data;  // Contents of the file
+  size_t size;                // Size of the file in bytes
+  ReplayHeader header;        // Copy of the file's header
+  ReplayFooter footer;        // Copy of the file's footer
+  size_t position;            // Offset of the next record to play
+  uint32_t tick;              // Number of updates played to reach `position`
+} Replay;
+
+// Flags at the start of each tick of a state stream
+typedef enum StateStreamFlag {
+  STATE_STREAM_FLAG_RESET = 1,        // The viewer should forget everything (a new game started, or it joined)
+  STATE_STREAM_FLAG_BOSS_ACTIVE = 2,  // The boss is active, so its values and type follow the others
+  STATE_STREAM_FLAG_GAME_OVER = 4,    // The player was defeated in this tick
+} StateStreamFlag;
+
+// Values sent in each tick of a state stream, as signed deltas from the previous tick's (in fixed point)
+typedef enum StateStreamValue {
+  STATE_STREAM_VALUE_TIME,
+  STATE_STREAM_VALUE_SCORE,
+  STATE_STREAM_VALUE_PLAYER_X,
+  STATE_STREAM_VALUE_PLAYER_Y,
+  STATE_STREAM_VALUE_PLAYER_SIZE,
+  STATE_STREAM_VALUE_BOSS_X,  // The boss's values are only sent while it is active
+  STATE_STREAM_VALUE_BOSS_Y,
+  STATE_STREAM_VALUE_BOSS_HEALTH,
+  STATE_STREAM_NUM_VALUES
+} StateStreamValue;
+
+// Kinds of entity record in a tick. Each record starts with a varint of (slots skipped since the last record << 3
+// | kind), and each list of records ends with STATE_STREAM_RECORD_END
+typedef enum StateStreamRecordKind {
+  STATE_STREAM_RECORD_END,
+  STATE_STREAM_RECORD_SPAWN,    // The slot has a new entity: all its fields, with absolute positions
+  STATE_STREAM_RECORD_MOVE,     // The slot's enemy moved: position deltas
+  STATE_STREAM_RECORD_CHANGE,   // The slot's enemy changed type or size: its type and size, then position deltas
+  STATE_STREAM_RECORD_DESPAWN,  // The slot's entity is gone
+} StateStreamRecordKind;
+
+// An enemy as last sent on a state stream, in fixed point
+typedef struct StateStreamEnemy {
+  int32_t x, y;    // Position, in STATE_STREAM_POSITION_SCALE steps
+  int32_t size;    // Radius, in STATE_STREAM_POSITION_SCALE steps
+  uint8_t type;    // Index of the enemy's type
+  bool is_active;  // Whether the slot holds an enemy
+} StateStreamEnemy;
+
+// A projectile as last sent on a state stream, in fixed point. Projectiles never change after spawning, so these
+// are only compared to find the slots whose projectile was replaced
+typedef struct StateStreamProjectile {
+  int32_t x, y;        // Spawn position, in STATE_STREAM_POSITION_SCALE steps
+  int32_t vx, vy;      // Velocity, in STATE_STREAM_VELOCITY_SCALE steps
+  int32_t size;        // Radius, in STATE_STREAM_POSITION_SCALE steps
+  int32_t spawn_time;  // Spawn time, in STATE_STREAM_TIME_SCALE steps
+  bool is_active;      // Whether the slot holds a projectile
+} StateStreamProjectile;
+
+// The game as last sent on a state stream. The exporter and the viewer each keep one, so every tick only has to
+// carry what changed since the last
+typedef struct StateStreamMirror {
+  int32_t values[STATE_STREAM_NUM_VALUES];              // Fixed point values (see StateStreamValue)
+  StateStreamEnemy *enemies;                            // Enemy in each slot of the enemy storage
+  int enemy_capacity;                                   // Number of slots in `enemies`
+  StateStreamProjectile *projectiles[NUM_ALLEGIANCES];  // Projectile in each slot of each pool
+  int projectile_capacities[NUM_ALLEGIANCES];           // Number of slots in each of `projectiles`
+} StateStreamMirror;
+
+// Position in a tick being decoded. Reading past the end (or a malformed varint) gives zero and sets has_failed
+typedef struct StateStreamReader {
+  const unsigned char *data;  // Encoded tick
+  size_t size;                // Size of the encoded tick in bytes
+  size_t position;            // Number of bytes read so far
+  bool has_failed;            // Whether anything has been read past the end of the tick
+} StateStreamReader;
+
+// Exporter of per-tick deltas of the game state to a viewer in another process, over a Unix domain socket. Only
+// one viewer is served at a time, and the socket never blocks: bytes the viewer hasn't taken yet are kept until
+// the next tick, and a viewer that falls too far behind is disconnected
+typedef struct StateStream {
+  int listen_fd;             // Socket viewers connect to, or -1 if streaming is off
+  int client_fd;             // Socket of the connected viewer, or -1 if there is none
+  const char *path;          // Path of the listening socket
+  StateStreamMirror mirror;  // The game as last sent to the viewer
+  bool needs_reset;          // Whether the next tick should tell the viewer to start over
+
+  unsigned char *message;   // Buffer each tick is encoded into
+  size_t message_capacity;  // Number of bytes allocated for `message`
+  unsigned char *pending;   // Encoded ticks not yet taken by the viewer
+  size_t pending_size;      // Number of bytes in `pending`
+  size_t pending_capacity;  // Number of bytes allocated for `pending`
+
+  int num_ticks;          // Number of ticks sent this game
+  uint64_t num_bytes;     // Number of bytes sent this game
+  double export_seconds;  // CPU time spent encoding and sending ticks this game
+} StateStream;
+
+// Runs the game screen's simulation at a fixed rate on its own thread, so that waiting for vsync or submitting
+// draw calls never holds up the game (or the other way round). While it is running it owns the game state and the
+// snapshot ring, and the render thread only sees the game through published render frames
+typedef struct SimulationThread {
+  pthread_t thread;  // Thread running the simulation
+  bool is_running;   // Cleared to ask the thread to stop. Accessed atomically
+
+  GameState *game_state;        // Game being simulated
+  SnapshotRing *snapshot_ring;  // Rewind snapshots of the game
+  const EnemyType *enemy_types;
+  const BossType *boss_types;
+  const Constants *constants;
+
+  InputQueue input_queue;           // Input from the render thread
+  RenderFrameBuffer frame_buffer;   // Frames for the render thread
+  FrameTimeHistogram update_times;  // Time taken by each update this game (not including publishing its frame)
+  bool cull_off_screen;  // Whether frames only index on-screen entities. Set by the render thread. Atomic
+  GameEventBuffer events;              // Events of the latest update
+  ParticleBurstQueue particle_bursts;  // Bursts of particles for the render thread to spawn
+  StateStream *state_stream;           // Stream each update's state is written to
+  ReplayWriter *replay_writer;         // Replay each update is recorded to
+  double input_sample_time;            // GetTime when the input used by the latest update was read
+  unsigned late_aim_sequence;          // Sequence number of the last late aim applied (see LateAim)
+} SimulationThread;
+
+typedef struct ContentPackWatcher {
+  int fd;                 // inotify file descriptor, or -1 if hot reloading is unavailable
+  const char *path;       // Path of the content pack being watched
+  const char *file_name;  // File name part of the path (inotify reports changes by name within the directory)
+} ContentPackWatcher;
+/*---------------------------------------------------------------------------------------------------------------*/
+
+/*--------------------*/
+/* Software rendering */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+// Bitmap font for text drawn to a software canvas, covering printable ASCII from ' '. Each glyph is
+// SOFTWARE_FONT_GLYPH_WIDTH columns from left to right, each column's rows being its bits from the top
+static const unsigned char SOFTWARE_FONT_GLYPHS[95][SOFTWARE_FONT_GLYPH_WIDTH] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00}, {0x00, 0x07, 0x00, 0x07, 0x00},  //  !"
+    {0x14, 0x7F, 0x14, 0x7F, 0x14}, {0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62},  // #$%
+    {0x36, 0x49, 0x56, 0x20, 0x50}, {0x00, 0x08, 0x07, 0x03, 0x00}, {0x00, 0x1C, 0x22, 0x41, 0x00},  // &'(
+    {0x00, 0x41, 0x22, 0x1C, 0x00}, {0x2A, 0x1C, 0x7F, 0x1C, 0x2A}, {0x08, 0x08, 0x3E, 0x08, 0x08},  // )*+
+    {0x00, 0x80, 0x70, 0x30, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08}, {0x00, 0x00, 0x60, 0x60, 0x00},  // ,-.
+    {0x20, 0x10, 0x08, 0x04, 0x02}, {0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00},  // /01
+    {0x72, 0x49, 0x49, 0x49, 0x46}, {0x21, 0x41, 0x49, 0x4D, 0x33}, {0x18, 0x14, 0x12, 0x7F, 0x10},  // 234
+    {0x27, 0x45, 0x45, 0x45, 0x39}, {0x3C, 0x4A, 0x49, 0x49, 0x31}, {0x41, 0x21, 0x11, 0x09, 0x07},  // 567
+    {0x36, 0x49, 0x49, 0x49, 0x36}, {0x46, 0x49, 0x49, 0x29, 0x1E}, {0x00, 0x00, 0x14, 0x00, 0x00},  // 89:
+    {0x00, 0x40, 0x34, 0x00, 0x00}, {0x00, 0x08, 0x14, 0x22, 0x41}, {0x14, 0x14, 0x14, 0x14, 0x14},  // ;<=
+    {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x59, 0x09, 0x06}, {0x3E, 0x41, 0x5D, 0x59, 0x4E},  // >?@
+    {0x7C, 0x12, 0x11, 0x12, 0x7C}, {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22},  // ABC
+    {0x7F, 0x41, 0x41, 0x41, 0x3E}, {0x7F, 0x49, 0x49, 0x49, 0x41}, {0x7F, 0x09, 0x09, 0x09, 0x01},  // DEF
+    {0x3E, 0x41, 0x41, 0x51, 0x73}, {0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00},  // GHI
+    {0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41}, {0x7F, 0x40, 0x40, 0x40, 0x40},  // JKL
+    {0x7F, 0x02, 0x1C, 0x02, 0x7F}, {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E},  // MNO
+    {0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E}, {0x7F, 0x09, 0x19, 0x29, 0x46},  // PQR
+    {0x26, 0x49, 0x49, 0x49, 0x32}, {0x03, 0x01, 0x7F, 0x01, 0x03}, {0x3F, 0x40, 0x40, 0x40, 0x3F},  // STU
+    {0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x3F, 0x40, 0x38, 0x40, 0x3F}, {0x63, 0x14, 0x08, 0x14, 0x63},  // VWX
+    {0x03, 0x04, 0x78, 0x04, 0x03}, {0x61, 0x59, 0x49, 0x4D, 0x43}, {0x00, 0x7F, 0x41, 0x41, 0x41},  // YZ[
+    {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x41, 0x7F}, {0x04, 0x02, 0x01, 0x02, 0x04},  // \]^
+    {0x40, 0x40, 0x40, 0x40, 0x40}, {0x00, 0x03, 0x07, 0x08, 0x00}, {0x20, 0x54, 0x54, 0x78, 0x40},  // _`a
+    {0x7F, 0x28, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x28}, {0x38, 0x44, 0x44, 0x28, 0x7F},  // bcd
+    {0x38, 0x54, 0x54, 0x54, 0x18}, {0x00, 0x08, 0x7E, 0x09, 0x02}, {0x18, 0xA4, 0xA4, 0x9C, 0x78},  // efg
+    {0x7F, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7D, 0x40, 0x00}, {0x20, 0x40, 0x40, 0x3D, 0x00},  // hij
+    {0x7F, 0x10, 0x28, 0x44, 0x00}, {0x00, 0x41, 0x7F, 0x40, 0x00}, {0x7C, 0x04, 0x78, 0x04, 0x78},  // klm
+    {0x7C, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38}, {0xFC, 0x18, 0x24, 0x24, 0x18},  // nop
+    {0x18, 0x24, 0x24, 0x18, 0xFC}, {0x7C, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x24},  // qrs
+    {0x04, 0x04, 0x3F, 0x44, 0x24}, {0x3C, 0x40, 0x40, 0x20, 0x7C}, {0x1C, 0x20, 0x40, 0x20, 0x1C},  // tuv
+    {0x3C, 0x40, 0x30, 0x40, 0x3C}, {0x44, 0x28, 0x10, 0x28, 0x44}, {0x4C, 0x90, 0x90, 0x90, 0x7C},  // wxy
+    {0x44, 0x64, 0x54, 0x4C, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00}, {0x00, 0x00, 0x77, 0x00, 0x00},  // z{|
+    {0x00, 0x41, 0x36, 0x08, 0x00}, {0x02, 0x01, 0x02, 0x04, 0x02}                                   // }~
+};
+
+// Allocate a canvas of the given size in pixels
+void software_canvas_init(SoftwareCanvas *canvas, int width, int height) {
+  *canvas = (SoftwareCanvas){.pixels = malloc((size_t)width * height * sizeof(Color)), .width = width,
+                             .height = height};
+  if (!canvas->pixels) {
+    fprintf(stderr, "Unable to allocate a %dx%d software canvas.\n", width, height);
+    exit(EXIT_FAILURE);
+  }
+}
+
+void software_canvas_cleanup(SoftwareCanvas *canvas) {
+  free(canvas->pixels);
+  *canvas = (SoftwareCanvas){0};
+}
+
+// Same as ClearBackground, but for the canvas
+void software_canvas_clear(SoftwareCanvas *canvas, Color colour) {
+  colour.a = 255;  // The canvas is always opaque
+  size_t num_pixels = (size_t)canvas->width * canvas->height;
+  for (size_t i = 0; i < num_pixels; i++) canvas->pixels[i] = colour;
+}
+
+// Fill pixels `x_start` up to (not including) `x_end` of row `y` with a colour, blended by its alpha. The blend is
+// done CANVAS_BLEND_PIXELS pixels at a time, with the rest done one by one in the same integer arithmetic, so the
+// result doesn't depend on where a span starts or on the vector width
+void software_canvas_fill_span(SoftwareCanvas *canvas, int y, int x_start, int x_end, Color colour) {
+  Color *pixels = canvas->pixels + (size_t)y * canvas->width + x_start;
+  int count = x_end - x_start;
+  if (colour.a == 0) return;
+  if (colour.a == 255) {
+    for (int i = 0; i < count; i++) pixels[i] = colour;
+    return;
+  }
+
+  // Each colour channel becomes (source * alpha + destination * (255 - alpha)) / 255, rounded to nearest, which
+  // is exact in 16 bits as (t + (t >> 8)) >> 8 with t being the sum plus 128. The alpha channel stays opaque
+  uint16_t source_terms[4] = {colour.r * colour.a + 128, colour.g * colour.a + 128, colour.b * colour.a + 128,
+                              255 * 255 + 128};
+  uint16_t destination_weights[4] = {255 - colour.a, 255 - colour.a, 255 - colour.a, 0};
+  CanvasChannels source_lanes, weight_lanes;
+  for (int lane = 0; lane < CANVAS_BLEND_PIXELS * 4; lane++) {
+    source_lanes[lane] = source_terms[lane % 4];
+    weight_lanes[lane] = destination_weights[lane % 4];
+  }
+
+  int i = 0;
+  for (; i + CANVAS_BLEND_PIXELS <= count; i += CANVAS_BLEND_PIXELS) {
+    CanvasBytes *bytes = (CanvasBytes *)(pixels + i);
+    CanvasChannels blended = __builtin_convertvector(*bytes, CanvasChannels) * weight_lanes + source_lanes;
+    *bytes = __builtin_convertvector((blended + (blended >> 8)) >> 8, CanvasBytes);
+  }
+  for (; i < count; i++) {
+    unsigned char *channels = (unsigned char *)(pixels + i);
+    for (int c = 0; c < 4; c++) {
+      uint16_t blended = channels[c] * destination_weights[c] + source_terms[c];
+      channels[c] = (blended + (blended >> 8)) >> 8;
+    }
+  }
+}
+
+// Round a pixel coordinate up to the next pixel centre's index, clamped to 0 to `max`
+int software_canvas_pixel_index(float coordinate, int max) {
+  float index = ceilf(coordinate - 0.5f);
+  if (!(index > 0)) return 0;  // Also catches NaN
+  return index < max ? (int)index : max;
+}
+
+// Same as DrawRectangleV, but for the canvas. Pixels are filled if their centres are inside the rectangle, so
+// rectangles sharing an edge neither overlap nor leave a gap
+void software_canvas_fill_rectangle(SoftwareCanvas *canvas, Vector2 position, Vector2 dimensions, Color colour) {
+  int x_start = software_canvas_pixel_index(position.x, canvas->width);
+  int x_end = software_canvas_pixel_index(position.x + dimensions.x, canvas->width);
+  int y_start = software_canvas_pixel_index(position.y, canvas->height);
+  int y_end = software_canvas_pixel_index(position.y + dimensions.y, canvas->height);
+  if (x_start >= x_end) return;
+
+  for (int y = y_start; y < y_end; y++) software_canvas_fill_span(canvas, y, x_start, x_end, colour);
+}
+
+// Same as DrawCircleV, but for the canvas. Each row inside the circle is filled as one span, between the points
+// where the row's pixel centres cross the circle
+void software_canvas_fill_circle(SoftwareCanvas *canvas, Vector2 centre, float radius, Color colour) {
+  int y_start = software_canvas_pixel_index(centre.y - radius, canvas->height);
+  int y_end = software_canvas_pixel_index(centre.y + radius, canvas->height);
+  float radius_squared = radius * radius;
+
+  for (int y = y_start; y < y_end; y++) {
+    float offset = y + 0.5f - centre.y;
+    float half_width_squared = radius_squared - offset * offset;
+    if (half_width_squared <= 0) continue;
+
+    float half_width = sqrtf(half_width_squared);
+    int x_start = software_canvas_pixel_index(centre.x - half_width, canvas->width);
+    int x_end = software_canvas_pixel_index(centre.x + half_width, canvas->width);
+    if (x_start < x_end) software_canvas_fill_span(canvas, y, x_start, x_end, colour);
+  }
+}
+
+// Same as MeasureTextEx, but for the software renderer's font. Glyphs are scaled to be `size` pixels tall, and
+// are one (scaled) column of pixels apart plus `spacing`
+Vector2 software_font_measure_text(const char *text, float size, float spacing) {
+  int length = strlen(text);
+  if (length == 0) return (Vector2){0, size};
+
+  float scale = size / SOFTWARE_FONT_GLYPH_HEIGHT;
+  float advance = (SOFTWARE_FONT_GLYPH_WIDTH + 1) * scale + spacing;
+  return (Vector2){length * advance - scale - spacing, size};
+}
+
+// Same as DrawTextEx, but drawn to the canvas in the software renderer's font. Each run of set pixels in a glyph's
+// column is filled as one rectangle. Characters outside printable ASCII are left blank
+void software_canvas_draw_text(SoftwareCanvas *canvas, const char *text, Vector2 position, float size,
+                               float spacing, Color colour) {
+  float scale = size / SOFTWARE_FONT_GLYPH_HEIGHT;
+  float advance = (SOFTWARE_FONT_GLYPH_WIDTH + 1) * scale + spacing;
+
+  for (const char *c = text; *c; c++, position.x += advance) {
+    if (*c <= ' ' || *c > '~') continue;
+    const unsigned char *glyph = SOFTWARE_FONT_GLYPHS[*c - ' '];
+    for (int column = 0; column < SOFTWARE_FONT_GLYPH_WIDTH; column++) {
+      int row = 0;
+      while (row < SOFTWARE_FONT_GLYPH_HEIGHT) {
+        if (!(glyph[column] >> row & 1)) {
+          row++;
+          continue;
+        }
+        int run_start = row;
+        while (row < SOFTWARE_FONT_GLYPH_HEIGHT && glyph[column] >> row & 1) row++;
+        software_canvas_fill_rectangle(canvas,
+                                       (Vector2){position.x + column * scale, position.y + run_start * scale},
+                                       (Vector2){scale, (row - run_start) * scale}, colour);
+      }
+    }
+  }
+}
+
+// Write the canvas to an image file: a binary PPM if the path ends in .ppm, which needs nothing else, or any other
+// format raylib can export (such as PNG). Returns whether it was written
+bool software_canvas_export(const SoftwareCanvas *canvas, const char *path) {
+  if (!IsFileExtension(path, ".ppm")) {
+    Image image = {.data = canvas->pixels,
+                   .width = canvas->width,
+                   .height = canvas->height,
+                   .mipmaps = 1,
+                   .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+    return ExportImage(image, path);
+  }
+
+  FILE *file = fopen(path, "wb");
+  if (!file) return false;
+  bool success = fprintf(file, "P6\n%d %d\n255\n", canvas->width, canvas->height) > 0;
+  size_t num_pixels = (size_t)canvas->width * canvas->height;
+  for (size_t i = 0; i < num_pixels && success; i++) {
+    Color pixel = canvas->pixels[i];
+    success = fwrite(&pixel, 1, 3, file) == 3;  // The alpha channel is dropped
+  }
+  return fclose(file) == 0 && success;
+}
 /*---------------------------------------------------------------------------------------------------------------*/
 
 /*-----------*/
 /* Utilities */
 /*---------------------------------------------------------------------------------------------------------------*/
 
+// Get the next 32 random bits from the generator (xorshift64*). The simulation uses this rather than raylib's
+// generator so that its random state is part of the game state and can be snapshotted
+uint32_t random_next(RandomState *random) {
+  random->state ^= random->state >> 12;
+  random->state ^= random->state << 25;
+  random->state ^= random->state >> 27;
+  return (random->state * 0x2545F4914F6CDD1DULL) >> 32;
+}
+
+// Seed the generator. Any seed is allowed (zero would get the generator stuck, so it is remapped)
+void random_seed(RandomState *random, uint64_t seed) {
+  random->state = seed ? seed : 0x9E3779B97F4A7C15ULL;
+}
+
+// Generate a random integer in the given range (inclusive), like GetRandomValue
+int get_random_int(RandomState *random, int min, int max) {
+  return min + (int)(random_next(random) % ((uint32_t)(max - min) + 1));
+}
+
 // Generate a random float in the given range (inclusive)
-float get_random_float(float min, float max) {
-  float mult = GetRandomValue(0, INT_MAX) / (float)INT_MAX;
+float get_random_float(RandomState *random, float min, float max) {
+  float mult = (random_next(random) >> 8) / (float)0xFFFFFF;  // 24 bits is all a float can hold exactly
   return min + mult * (max - min);
 }
 
+// Advance the generator past `count` numbers without using them
+void random_skip(RandomState *random, int count) {
+  for (int i = 0; i < count; i++) random_next(random);
+}
+
+// The sim_ functions below are used for all maths in the simulation that isn't plain arithmetic. In fixed point
+// builds they use the integer versions from fixed_math.h, so that results don't depend on the compiler or libm
+#if SIM_FIXED_POINT
+Vector2 sim_normalise(Vector2 vector) {
+  fixed_t x = fixed_from_float(vector.x), y = fixed_from_float(vector.y);
+  fixed_normalise(&x, &y);
+  return (Vector2){fixed_to_float(x), fixed_to_float(y)};
+}
+
+float sim_sqrt(float value) { return fixed_to_float(fixed_sqrt(fixed_from_float(value))); }
+
+// Get the unit vector at an angle given as a fraction of a full turn
+Vector2 sim_unit_vector(float turns) {
+  fixed_t sine, cosine;
+  fixed_sin_cos((uint32_t)(uint64_t)(turns * 4294967296.0f), &sine, &cosine);
+  return (Vector2){fixed_to_float(cosine), fixed_to_float(sine)};
+}
+
+// Raise a non-negative base to a power
+float sim_pow(float base, float exponent) {
+  if (exponent == 0) return 1;
+  if (base <= 0) return 0;
+  return fixed_exp2_to_float((fixed_t)((int64_t)fixed_log2(base) * fixed_from_float(exponent) / FIXED_ONE));
+}
+
+bool sim_circles_collide(Vector2 centre_1, float radius_1, Vector2 centre_2, float radius_2) {
+  int64_t dx = fixed_from_float(centre_1.x) - fixed_from_float(centre_2.x);
+  int64_t dy = fixed_from_float(centre_1.y) - fixed_from_float(centre_2.y);
+  int64_t radius_sum = fixed_from_float(radius_1) + fixed_from_float(radius_2);
+  return dx * dx + dy * dy <= radius_sum * radius_sum;
+}
+#else
+Vector2 sim_normalise(Vector2 vector) { return Vector2Normalize(vector); }
+
+float sim_sqrt(float value) { return sqrtf(value); }
+
+// Get the unit vector at an angle given as a fraction of a full turn
+Vector2 sim_unit_vector(float turns) { return (Vector2){cosf(turns * 2 * PI), sinf(turns * 2 * PI)}; }
+
+// Raise a non-negative base to a power
+float sim_pow(float base, float exponent) { return powf(base, exponent); }
+
+// Compares squared distances, so unlike CheckCollisionCircles this needs no square root and can be inlined
+bool sim_circles_collide(Vector2 centre_1, float radius_1, Vector2 centre_2, float radius_2) {
+  float radius_sum = radius_1 + radius_2;
+  return Vector2DistanceSqr(centre_1, centre_2) <= radius_sum * radius_sum;
+}
+#endif
+
+// Convert an enemy speed in units/s to the fixed point representation stored in Enemy
+uint16_t enemy_speed_to_fixed(float speed) { return (uint16_t)(speed * ENEMY_SPEED_SCALE + 0.5f); }
+
+// Get the speed of an enemy in units/s
+float enemy_get_speed(const Enemy *enemy) { return enemy->speed / ENEMY_SPEED_SCALE; }
+
 // Get whether a given circle with centre `pos` and radius `rad` would be showing on the screen
 bool circle_is_on_screen(Vector2 pos, float rad, Vector2 camera_pos, const Constants *constants) {
   return (-rad <= pos.x - camera_pos.x && pos.x - camera_pos.x <= constants->screen_dimensions.x + rad) &&
@@ -305,12 +1268,22 @@ Vector2 get_pos_from_anchored_rect(Rectangle anchored_rect, AnchorType anchor_ty
                                        constants);
 }
 
+// GetScreenWidth from raylib, or the width of the software canvas if drawing to one
+int get_screen_width(const Constants *constants) {
+  return constants->software_canvas ? constants->software_canvas->width : GetScreenWidth();
+}
+
+// GetScreenHeight from raylib, or the height of the software canvas if drawing to one
+int get_screen_height(const Constants *constants) {
+  return constants->software_canvas ? constants->software_canvas->height : GetScreenHeight();
+}
+
 // Get the scale of one of the two black bars required to maintain the desired aspect ratio. A positive return
 // value indicates the width of the required vertical bars. A negative return value indicates the (negative) height
 // of the required horizontal bars
 float get_black_bar_size_in_pixels(const Constants *constants) {
-  float screen_width = GetScreenWidth();
-  float screen_height = GetScreenHeight();
+  float screen_width = get_screen_width(constants);
+  float screen_height = get_screen_height(constants);
   float aspect_ratio = screen_width / screen_height;
 
   // No black bars if the aspect ratios are (approximately) equal
@@ -329,9 +1302,9 @@ float get_units_to_pixels_scale_factor(const Constants *constants) {
 
   // Calculate screen size in pixels (i.e. the viewable portion of the window) divided by screen size in units
   if (black_bar_size >= 0) {  // If there are vertical (or no) black bars, use height
-    return GetScreenHeight() / constants->screen_dimensions.y;
+    return get_screen_height(constants) / constants->screen_dimensions.y;
   } else {  // If there are horizontal black bars, use width
-    return GetScreenWidth() / constants->screen_dimensions.x;
+    return get_screen_width(constants) / constants->screen_dimensions.x;
   }
 }
 // Convert a position in units to a position in pixels (for drawing), accounting for black bars
@@ -386,11 +1359,36 @@ Vector2 get_mouse_position_in_units_ui(const Constants *constants) {
   return get_unit_position_from_draw_position(GetMousePosition(), constants);
 }
 
-// MeasureTextEx from raylib, but with the result in units
+// MeasureTextEx from raylib (or the software renderer's font if drawing to a software canvas), but with the result
+// in units
 Vector2 measure_text_ex_in_units(Font font, const char *text, float size, float spacing,
                                  const Constants *constants) {
-  return get_unit_dimensions_from_draw_dimensions(
-      MeasureTextEx(font, text, get_draw_length_from_unit_length(size, constants), spacing), constants);
+  float pixel_size = get_draw_length_from_unit_length(size, constants);
+  Vector2 dimensions = constants->software_canvas ? software_font_measure_text(text, pixel_size, spacing)
+                                                  : MeasureTextEx(font, text, pixel_size, spacing);
+  return get_unit_dimensions_from_draw_dimensions(dimensions, constants);
+}
+
+// Get a pointer to the player's stat which is increased by upgrades of the given stat
+float *player_get_upgradeable_stat(Player *player, PackUpgradeStat stat) {
+  switch (stat) {
+    case PACK_UPGRADE_STAT_FIRERATE:
+      return &player->firerate;
+    case PACK_UPGRADE_STAT_PROJECTILE_SPEED:
+      return &player->projectile_speed;
+    case PACK_UPGRADE_STAT_PROJECTILE_SIZE:
+      return &player->projectile_size;
+    case PACK_UPGRADE_STAT_PROJECTILE_DAMAGE:
+    default:
+      return &player->projectile_damage;
+  }
+}
+
+// Set the cost and stat of an upgrade from its level, as if it had been bought that many times from scratch
+void upgrade_apply_level(Upgrade *upgrade, Player *player, const Constants *constants) {
+  upgrade->cost = upgrade->base_cost * sim_pow(constants->upgrade_cost_multiplier, upgrade->level);
+  *player_get_upgradeable_stat(player, upgrade->stat) =
+      upgrade->base_stat + upgrade->level * upgrade->stat_increment * upgrade->base_stat;
 }
 
 // Get the normalised vector for the direction the player should move according to keyboard input
@@ -401,7 +1399,435 @@ Vector2 get_movement_input_direction() {
   if (IsKeyDown(KEY_D)) res.x++;
   if (IsKeyDown(KEY_A)) res.x--;
 
-  return Vector2Normalize(res);  // Normalise to prevent diagonal movement being quicker
+  return sim_normalise(res);  // Normalise to prevent diagonal movement being quicker
+}
+
+// Read the player's controls from the keyboard and mouse
+PlayerInput player_input_read(Vector2 camera_position, const Constants *constants) {
+  return (PlayerInput){.move_direction = get_movement_input_direction(),
+                       .aim_pos = get_mouse_position_in_units_game(camera_position, constants),
+                       .is_firing = IsMouseButtonDown(MOUSE_LEFT_BUTTON)};
+}
+/*---------------------------------------------------------------------------------------------------------------*/
+
+/*----------------------*/
+/* Content pack loading */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+// Check that the pack in `data` is well formed and that all of its indices are in range. Prints the problem and
+// returns false if it is not
+bool content_pack_validate(const unsigned char *data, size_t size) {
+  const PackHeader *header = (const PackHeader *)data;
+  if (size < sizeof *header || header->magic != CONTENT_PACK_MAGIC) {
+    fprintf(stderr, "Content pack is not a content pack.\n");
+    return false;
+  }
+  if (header->version != CONTENT_PACK_VERSION) {
+    fprintf(stderr, "Content pack has version %u but version %d is required.\n", header->version,
+            CONTENT_PACK_VERSION);
+    return false;
+  }
+  if (header->num_colours != PACK_NUM_COLOURS || header->num_upgrades != PACK_NUM_UPGRADE_STATS ||
+      header->num_enemy_types == 0 || header->num_enemy_types > MAX_ENEMY_TYPES ||
+      header->size != content_pack_expected_size(header->num_enemy_types) || header->size != size) {
+    fprintf(stderr, "Content pack header does not match its contents.\n");
+    return false;
+  }
+
+  const PackConstants *constants = (const PackConstants *)(data + sizeof *header + PACK_NUM_COLOURS * 4);
+  const PackEnemyType *enemy_types = (const PackEnemyType *)(constants + 1);
+  const PackBossType *boss = (const PackBossType *)(enemy_types + header->num_enemy_types);
+  const PackUpgrade *upgrades = (const PackUpgrade *)(boss + 1);
+
+  int colours[] = {constants->player_colour,
+                   constants->player_projectile_colour,
+                   constants->background_square_colour,
+                   constants->background_colour,
+                   constants->boss_health_bar_colour,
+                   constants->boss_health_bar_background_colour,
+                   boss->colour,
+                   boss->projectile_colour};
+  bool valid = true;
+  for (int i = 0; i < sizeof colours / sizeof *colours; i++) {
+    valid = valid && 0 <= colours[i] && colours[i] < PACK_NUM_COLOURS;
+  }
+  for (int i = 0; i < header->num_enemy_types; i++) {
+    // Enemy types may only turn into earlier types, so decaying an enemy always terminates
+    valid = valid && 0 <= enemy_types[i].colour && enemy_types[i].colour < PACK_NUM_COLOURS;
+    valid = valid && -1 <= enemy_types[i].turns_into && enemy_types[i].turns_into < i;
+    // Enemy speeds must fit in Enemy's fixed point speed field
+    valid = valid && 0 <= enemy_types[i].min_speed && enemy_types[i].max_speed * ENEMY_SPEED_SCALE <= UINT16_MAX;
+  }
+  valid = valid && constants->enemy_lod_interval >= 1;
+  valid = valid && 0 <= boss->enemy_type_spawned_on_defeat &&
+          boss->enemy_type_spawned_on_defeat < (int)header->num_enemy_types;
+  for (int i = 0; i < PACK_NUM_UPGRADE_STATS; i++) {
+    valid = valid && upgrades[i].stat == i && (upgrades[i].type == 0 || upgrades[i].type == 1);
+  }
+
+  if (!valid) fprintf(stderr, "Content pack contains an out of range reference.\n");
+  return valid;
+}
+
+// Map the file at `path` (a `description`, such as "content pack", for error messages) into memory. Returns NULL
+// (after printing the reason) if it cannot be read
+const unsigned char *map_file(const char *path, const char *description, size_t *size) {
+#ifdef _WIN32
+  int file_size;
+  unsigned char *data = LoadFileData(path, &file_size);
+  *size = file_size;
+  if (!data) fprintf(stderr, "Unable to read %s %s.\n", description, path);
+  return data;
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Unable to open %s %s.\n", description, path);
+    return NULL;
+  }
+
+  struct stat file_stat;
+  void *data = MAP_FAILED;
+  if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+    *size = file_stat.st_size;
+    data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);  // The mapping stays valid after the file is closed
+
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "Unable to map %s %s.\n", description, path);
+    return NULL;
+  }
+  return data;
+#endif
+}
+
+// Release a file returned by map_file
+void unmap_file(const unsigned char *data, size_t size) {
+#ifdef _WIN32
+  UnloadFileData((unsigned char *)data);
+#else
+  munmap((void *)data, size);
+#endif
+}
+
+// Work out the outcome of a hit on enemy type `type` for each whole amount of damage. The type it turns into must
+// come earlier (as packs are validated to), and have had its outcomes worked out already
+void enemy_type_build_decays(EnemyType *enemy_types, int type) {
+  EnemyType *enemy_type = enemy_types + type;
+  enemy_type->decays[0] = (EnemyDecay){.type = type};
+  for (int damage = 1; damage <= ENEMY_DECAY_MAX_DAMAGE; damage++) {
+    if (enemy_type->turns_into < 0) {
+      enemy_type->decays[damage] = (EnemyDecay){.type = type, .is_destroyed = true};
+    } else {
+      // The first point of damage decays it, and the rest carry on from the type it turns into
+      EnemyDecay decay = enemy_types[enemy_type->turns_into].decays[damage - 1];
+      decay.num_decays++;
+      enemy_type->decays[damage] = decay;
+    }
+  }
+}
+
+// Copy the contents of a validated pack into the game's data. Upgrade costs and stats are recomputed from the
+// levels already purchased. On a reload the number of enemy types must not change (live enemies refer to their
+// types by index)
+void content_pack_apply(const unsigned char *data, GameColours *game_colours, Constants *constants,
+                        EnemyType *enemy_types, BossType *boss_type, Shop *shop, Player *player, bool is_reload) {
+  const PackHeader *header = (const PackHeader *)data;
+  const uint32_t *pack_colours = (const uint32_t *)(header + 1);
+  const PackConstants *pack_constants = (const PackConstants *)(pack_colours + PACK_NUM_COLOURS);
+  const PackEnemyType *pack_enemy_types = (const PackEnemyType *)(pack_constants + 1);
+  const PackBossType *pack_boss = (const PackBossType *)(pack_enemy_types + header->num_enemy_types);
+  const PackUpgrade *pack_upgrades = (const PackUpgrade *)(pack_boss + 1);
+
+#define GAME_COLOUR_FIELD(name) &game_colours->name,
+  Color *colours[PACK_NUM_COLOURS] = {PACK_COLOURS(GAME_COLOUR_FIELD)};
+#undef GAME_COLOUR_FIELD
+  for (int i = 0; i < PACK_NUM_COLOURS; i++) {
+    *colours[i] = GetColor(pack_colours[i]);
+  }
+
+  constants->game_area_dimensions =
+      (Vector2){pack_constants->game_area_dimensions[0], pack_constants->game_area_dimensions[1]};
+  constants->target_fps = pack_constants->target_fps;
+
+  constants->player_start_pos =
+      (Vector2){pack_constants->player_start_pos[0], pack_constants->player_start_pos[1]};
+  constants->player_base_speed = pack_constants->player_base_speed;
+  constants->player_base_size = pack_constants->player_base_size;
+  constants->player_colour = *colours[pack_constants->player_colour];
+
+  constants->player_base_firerate = pack_constants->player_base_firerate;
+  constants->player_base_projectile_speed = pack_constants->player_base_projectile_speed;
+  constants->player_base_projectile_size = pack_constants->player_base_projectile_size;
+  constants->player_base_projectile_damage = pack_constants->player_base_projectile_damage;
+  constants->player_projectile_colour = *colours[pack_constants->player_projectile_colour];
+
+  constants->upgrade_cost_multiplier = pack_constants->upgrade_cost_multiplier;
+
+  constants->initial_max_enemies = pack_constants->initial_max_enemies;
+  constants->num_enemy_types = header->num_enemy_types;
+  constants->enemy_spawn_interval_min = pack_constants->enemy_spawn_interval_min;
+  constants->enemy_spawn_interval_max = pack_constants->enemy_spawn_interval_max;
+  constants->enemy_first_spawn_interval = pack_constants->enemy_first_spawn_interval;
+  constants->enemy_spawn_min_wave_size = pack_constants->enemy_spawn_min_wave_size;
+  constants->enemy_spawn_additional_enemy_chance = pack_constants->enemy_spawn_additional_enemy_chance;
+  constants->initial_enemy_credits = pack_constants->initial_enemy_credits;
+  constants->enemy_credit_multiplier = pack_constants->enemy_credit_multiplier;
+  constants->enemy_credit_exponent = pack_constants->enemy_credit_exponent;
+
+  constants->enemy_update_interval = pack_constants->enemy_update_interval;
+  constants->enemy_update_chance = pack_constants->enemy_update_chance;
+  constants->enemy_lod_radius = pack_constants->enemy_lod_radius;
+  constants->enemy_lod_interval = pack_constants->enemy_lod_interval;
+
+  constants->initial_max_projectiles = pack_constants->initial_max_projectiles;
+
+  constants->font_spacing = pack_constants->font_spacing;
+  constants->background_square_size = pack_constants->background_square_size;
+  constants->background_square_colour = *colours[pack_constants->background_square_colour];
+  constants->background_colour = *colours[pack_constants->background_colour];
+  constants->boss_health_bar_colour = *colours[pack_constants->boss_health_bar_colour];
+  constants->boss_health_bar_background_colour = *colours[pack_constants->boss_health_bar_background_colour];
+  constants->boss_health_bar_opacity = pack_constants->boss_health_bar_opacity;
+
+  for (int i = 0; i < header->num_enemy_types; i++) {
+    const PackEnemyType *pack_enemy_type = pack_enemy_types + i;
+    enemy_types[i] = (EnemyType){
+        .credit_cost = pack_enemy_type->credit_cost,
+        .min_speed = pack_enemy_type->min_speed,
+        .max_speed = pack_enemy_type->max_speed,
+        .min_size = pack_enemy_type->min_size,
+        .max_size = pack_enemy_type->max_size,
+        .colour = *colours[pack_enemy_type->colour],
+        .turns_into = pack_enemy_type->turns_into};
+    enemy_type_build_decays(enemy_types, i);
+  }
+
+  *boss_type = (BossType){.initial_score_to_spawn = pack_boss->initial_score_to_spawn,
+                          .max_health = pack_boss->max_health,
+                          .speed = pack_boss->speed,
+                          .size = pack_boss->size,
+                          .colour = *colours[pack_boss->colour],
+                          .firerate = pack_boss->firerate,
+                          .shots_per_burst = pack_boss->shots_per_burst,
+                          .projectile_speed = pack_boss->projectile_speed,
+                          .projectile_size = pack_boss->projectile_size,
+                          .projectile_colour = *colours[pack_boss->projectile_colour],
+                          .moving_duration = pack_boss->moving_duration,
+                          .stationary_duration = pack_boss->stationary_duration,
+                          .num_enemies_spawned_on_defeat = pack_boss->num_enemies_spawned_on_defeat,
+                          .enemy_type_spawned_on_defeat = pack_boss->enemy_type_spawned_on_defeat,
+                          .boss_points_on_defeat = pack_boss->boss_points_on_defeat,
+                          .score_on_defeat = pack_boss->score_on_defeat};
+
+  // Upgrade order matches PackUpgradeStat, which in turn matches the layout of the shop screen
+  float base_stats[PACK_NUM_UPGRADE_STATS] = {
+      constants->player_base_firerate, constants->player_base_projectile_speed,
+      constants->player_base_projectile_size, constants->player_base_projectile_damage};
+  for (int i = 0; i < PACK_NUM_UPGRADE_STATS; i++) {
+    Upgrade *upgrade = shop->upgrades + i;
+    upgrade->type = pack_upgrades[i].type;
+    upgrade->stat_increment = pack_upgrades[i].stat_increment;
+    upgrade->base_stat = base_stats[i];
+    upgrade->stat = i;
+    upgrade->base_cost = pack_upgrades[i].cost;
+    upgrade_apply_level(upgrade, player, constants);
+  }
+}
+
+// Load the content pack at `path` into the game's data (see content_pack_apply). Returns false, leaving the game's
+// data untouched, if the pack cannot be loaded
+bool content_pack_load(const char *path, GameColours *game_colours, Constants *constants, EnemyType *enemy_types,
+                       BossType *boss_type, Shop *shop, Player *player, bool is_reload) {
+  size_t size;
+  const unsigned char *data = map_file(path, "content pack", &size);
+  if (!data) return false;
+
+  bool valid = content_pack_validate(data, size);
+  if (valid && is_reload && ((const PackHeader *)data)->num_enemy_types != constants->num_enemy_types) {
+    fprintf(stderr, "Content pack changed the number of enemy types. Restart the game to apply it.\n");
+    valid = false;
+  }
+  if (valid) content_pack_apply(data, game_colours, constants, enemy_types, boss_type, shop, player, is_reload);
+
+  unmap_file(data, size);
+  return valid;
+}
+
+// Start watching the content pack at `path` for changes. Hot reloading is only available on Linux
+void content_pack_watcher_init(ContentPackWatcher *watcher, const char *path) {
+  watcher->fd = -1;
+  watcher->path = path;
+  const char *last_slash = strrchr(path, '/');
+  watcher->file_name = last_slash ? last_slash + 1 : path;
+
+#ifdef __linux__
+  // Watch the directory rather than the file, since the pack compiler replaces the file by renaming over it
+  char directory[4096] = ".";
+  if (last_slash) snprintf(directory, sizeof directory, "%.*s", (int)(last_slash - path), path);
+  if (last_slash == path) strcpy(directory, "/");
+
+  watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (watcher->fd < 0) return;
+  if (inotify_add_watch(watcher->fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    close(watcher->fd);
+    watcher->fd = -1;
+  }
+#endif
+}
+
+// Get whether the watched content pack has been written since the last call. Never blocks
+bool content_pack_watcher_poll(ContentPackWatcher *watcher) {
+  bool changed = false;
+#ifdef __linux__
+  if (watcher->fd < 0) return false;
+
+  // Buffer aligned for inotify_event, as recommended by inotify(7)
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t length;
+  while ((length = read(watcher->fd, buffer, sizeof buffer)) > 0) {
+    for (char *ptr = buffer; ptr < buffer + length;) {
+      const struct inotify_event *event = (const struct inotify_event *)ptr;
+      if (event->len && strcmp(event->name, watcher->file_name) == 0) changed = true;
+      ptr += sizeof *event + event->len;
+    }
+  }
+#endif
+  return changed;
+}
+
+// Stop watching the content pack
+void content_pack_watcher_cleanup(ContentPackWatcher *watcher) {
+#ifndef _WIN32
+  if (watcher->fd >= 0) close(watcher->fd);
+#endif
+  watcher->fd = -1;
+}
+/*---------------------------------------------------------------------------------------------------------------*/
+
+/*-------------*/
+/* Save system */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+// Get the record to save for the shop's current progress
+SaveRecord save_record_from_shop(const Shop *shop) {
+  SaveRecord record = {
+      .magic = SAVE_MAGIC, .version = SAVE_VERSION, .money = shop->money, .boss_points = shop->boss_points};
+  for (int i = 0; i < shop->num_upgrades; i++) {
+    record.upgrade_levels[i] = shop->upgrades[i].level;
+  }
+  return record;
+}
+
+// Write a record to `path` by writing a temporary file and renaming it over the old save, so a crash mid-write
+// never leaves a corrupt save behind
+bool save_write_record(const SaveRecord *record, const char *path) {
+  char temp_path[256];
+  snprintf(temp_path, sizeof temp_path, "%s.tmp", path);
+
+  FILE *file = fopen(temp_path, "wb");
+  if (!file) return false;
+
+  bool ok = fwrite(record, sizeof *record, 1, file) == 1 && fflush(file) == 0;
+#ifndef _WIN32
+  ok = ok && fsync(fileno(file)) == 0;  // Make sure the data is on disk before the rename makes it visible
+#endif
+  ok = (fclose(file) == 0) && ok;
+
+#ifdef _WIN32
+  if (ok) remove(path);  // rename doesn't replace existing files on Windows
+#endif
+  if (!ok || rename(temp_path, path) != 0) {
+    remove(temp_path);
+    return false;
+  }
+  return true;
+}
+
+// Body of the save writer thread. Sleeps until a record is requested, then writes the latest one. Records
+// requested while a write is in progress are coalesced, since only the latest matters
+void *save_writer_thread(void *arg) {
+  SaveWriter *writer = arg;
+
+  pthread_mutex_lock(&writer->mutex);
+  for (;;) {
+    while (!writer->has_pending && !writer->should_stop) pthread_cond_wait(&writer->cond, &writer->mutex);
+    if (!writer->has_pending) break;  // Stopping with nothing left to write
+
+    SaveRecord record = writer->pending;
+    writer->has_pending = false;
+
+    // Never hold the lock during disk I/O, so save_writer_request can't block on it
+    pthread_mutex_unlock(&writer->mutex);
+    if (!save_write_record(&record, SAVE_PATH)) fprintf(stderr, "Unable to write save file %s.\n", SAVE_PATH);
+    pthread_mutex_lock(&writer->mutex);
+  }
+  pthread_mutex_unlock(&writer->mutex);
+
+  return NULL;
+}
+
+// Start the save writer thread. If it can't be started, saves are written synchronously instead
+void save_writer_init(SaveWriter *writer) {
+  *writer = (SaveWriter){0};
+  pthread_mutex_init(&writer->mutex, NULL);
+  pthread_cond_init(&writer->cond, NULL);
+  writer->is_running = pthread_create(&writer->thread, NULL, save_writer_thread, writer) == 0;
+}
+
+// Queue the shop's current progress to be saved. Returns without waiting for any disk I/O
+void save_writer_request(SaveWriter *writer, const Shop *shop) {
+  SaveRecord record = save_record_from_shop(shop);
+
+  if (!writer->is_running) {
+    save_write_record(&record, SAVE_PATH);
+    return;
+  }
+
+  pthread_mutex_lock(&writer->mutex);
+  writer->pending = record;
+  writer->has_pending = true;
+  pthread_cond_signal(&writer->cond);
+  pthread_mutex_unlock(&writer->mutex);
+}
+
+// Finish any outstanding save and stop the save writer thread
+void save_writer_cleanup(SaveWriter *writer) {
+  if (writer->is_running) {
+    pthread_mutex_lock(&writer->mutex);
+    writer->should_stop = true;
+    pthread_cond_signal(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+
+    pthread_join(writer->thread, NULL);
+    writer->is_running = false;
+  }
+
+  pthread_mutex_destroy(&writer->mutex);
+  pthread_cond_destroy(&writer->cond);
+}
+
+// Load saved shop progress from `path`, reapplying purchased upgrades to the player's stats. A missing save is not
+// an error (this is a fresh install), but an unreadable one is reported and ignored
+void save_load(const char *path, Shop *shop, Player *player, const Constants *constants) {
+  FILE *file = fopen(path, "rb");
+  if (!file) return;
+
+  SaveRecord record;
+  bool ok = fread(&record, sizeof record, 1, file) == 1 && fgetc(file) == EOF;
+  fclose(file);
+
+  if (!ok || record.magic != SAVE_MAGIC || record.version != SAVE_VERSION) {
+    fprintf(stderr, "Ignoring unreadable save file %s.\n", path);
+    return;
+  }
+
+  shop->money = record.money;
+  shop->boss_points = record.boss_points;
+  for (int i = 0; i < shop->num_upgrades; i++) {
+    shop->upgrades[i].level = record.upgrade_levels[i] > 0 ? record.upgrade_levels[i] : 0;
+    upgrade_apply_level(shop->upgrades + i, player, constants);
+  }
 }
 /*---------------------------------------------------------------------------------------------------------------*/
 
@@ -428,47 +1854,154 @@ void initialise_game(Player *player, EnemyManager *enemy_manager, ProjectileMana
   }
   enemy_manager->capacity = constants->initial_max_enemies;
 
-  projectile_manager->projectiles =
-      calloc(constants->initial_max_projectiles, sizeof *(projectile_manager->projectiles));
-  if (!projectile_manager->projectiles) {
-    fprintf(stderr, "Unable to allocate projectile storage.\n");
+  for (int i = 0; i < NUM_ALLEGIANCES; i++) {
+    ProjectilePool *pool = projectile_manager->pools + i;
+    pool->projectiles = calloc(constants->initial_max_projectiles, sizeof *(pool->projectiles));
+    pool->expiry_heap = calloc(constants->initial_max_projectiles, sizeof *(pool->expiry_heap));
+    if (!pool->projectiles || !pool->expiry_heap) {
+      fprintf(stderr, "Unable to allocate projectile storage.\n");
+      exit(EXIT_FAILURE);
+    }
+    pool->capacity = constants->initial_max_projectiles;
+  }
+}
+
+// Resize the enemy storage to `capacity` enemies. Any new slots start inactive. Shrinking must not drop active
+// enemies, so it should only happen between games
+void enemy_manager_resize(EnemyManager *enemy_manager, int capacity) {
+  int old_capacity = enemy_manager->capacity;
+  enemy_manager->enemies = realloc(enemy_manager->enemies, capacity * sizeof *(enemy_manager->enemies));
+  if (!enemy_manager->enemies) {
+    fprintf(stderr, "Unable to reallocate enemy storage.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (capacity > old_capacity)
+    memset(enemy_manager->enemies + old_capacity, 0, (capacity - old_capacity) * sizeof *(enemy_manager->enemies));
+  enemy_manager->capacity = capacity;
+}
+
+// Resize a projectile pool's storage to `capacity` projectiles, with the same caveats as enemy_manager_resize
+void projectile_pool_resize(ProjectilePool *pool, int capacity) {
+  int old_capacity = pool->capacity;
+  pool->projectiles = realloc(pool->projectiles, capacity * sizeof *(pool->projectiles));
+  pool->expiry_heap = realloc(pool->expiry_heap, capacity * sizeof *(pool->expiry_heap));
+  if (!pool->projectiles || !pool->expiry_heap) {
+    fprintf(stderr, "Unable to reallocate projectile storage.\n");
     exit(EXIT_FAILURE);
   }
-  projectile_manager->capacity = constants->initial_max_projectiles;
+  if (capacity > old_capacity)
+    memset(pool->projectiles + old_capacity, 0, (capacity - old_capacity) * sizeof *(pool->projectiles));
+  pool->capacity = capacity;
+}
+
+// Get the capacity a pool should have at the start of a game: its initial capacity, doubled until it would have
+// held the highest of its recent high-water marks. This is the capacity growing would have reached in that game
+int pool_sizing_get_capacity(const int high_water[POOL_SIZING_HISTORY], int initial_capacity) {
+  int peak = 0;
+  for (int i = 0; i < POOL_SIZING_HISTORY; i++) {
+    if (high_water[i] > peak) peak = high_water[i];
+  }
+
+  int capacity = initial_capacity;
+  while (capacity < peak) capacity *= 2;
+  return capacity;
+}
+
+// Record the pools' high-water marks from the game that just ended, replacing those of the oldest game recorded
+void pool_sizing_record(PoolSizing *pool_sizing, const EnemyManager *enemy_manager,
+                        const ProjectileManager *projectile_manager) {
+  int slot = pool_sizing->num_games++ % POOL_SIZING_HISTORY;
+  pool_sizing->enemy_high_water[slot] = enemy_manager->stats.high_water;
+  for (int i = 0; i < NUM_ALLEGIANCES; i++) {
+    pool_sizing->projectile_high_water[i][slot] = projectile_manager->pools[i].stats.high_water;
+  }
 }
 
-// Perform initialisation steps for game start
-void start_game(Player *player, EnemyManager *enemy_manager, ProjectileManager *projectile_manager, Boss *boss,
-                const Constants *constants) {
-  float start_time = GetTime();
+// Perform initialisation steps for game start. Games with the same seed (and the same inputs) play out the same.
+// If `pool_sizing` is given, pools smaller than it suggests are grown before the game starts
+void start_game(GameState *game_state, const BossType *boss_types, uint64_t seed,
+                const PoolSizing *pool_sizing, const Constants *constants) {
+  Player *player = &game_state->player;
+  EnemyManager *enemy_manager = &game_state->enemy_manager;
+  ProjectileManager *projectile_manager = &game_state->projectile_manager;
+  Boss *boss = &game_state->boss;
+
+  float start_time = 0;
+  game_state->time = start_time;
+  random_seed(&game_state->random, seed);
+
   player->pos = constants->player_start_pos;
   player->score = 0;
   player->boss_points = 0;
   player->is_defeated = false;
   player->time_of_last_projectile = start_time;
 
+  if (pool_sizing) {
+    int enemy_capacity = pool_sizing_get_capacity(pool_sizing->enemy_high_water, constants->initial_max_enemies);
+    if (enemy_manager->capacity < enemy_capacity) enemy_manager_resize(enemy_manager, enemy_capacity);
+
+    for (int i = 0; i < NUM_ALLEGIANCES; i++) {
+      ProjectilePool *pool = projectile_manager->pools + i;
+      int projectile_capacity =
+          pool_sizing_get_capacity(pool_sizing->projectile_high_water[i], constants->initial_max_projectiles);
+      if (pool->capacity < projectile_capacity) projectile_pool_resize(pool, projectile_capacity);
+    }
+  }
+
   memset(enemy_manager->enemies, 0, enemy_manager->capacity * sizeof *(enemy_manager->enemies));
   enemy_manager->enemy_count = 0;
+  enemy_manager->stats = (PoolStats){0};
   enemy_manager->enemy_spawn_interval = constants->enemy_first_spawn_interval;
   enemy_manager->time_of_last_spawn = start_time;
   enemy_manager->credits_spent = 0;
   enemy_manager->time_of_initialisation = start_time;
   enemy_manager->time_of_last_update = start_time;
+  enemy_manager->num_moves = 0;
 
-  memset(projectile_manager->projectiles, 0,
-         projectile_manager->capacity * sizeof *(projectile_manager->projectiles));
-  projectile_manager->projectile_count = 0;
+  for (int i = 0; i < NUM_ALLEGIANCES; i++) {
+    ProjectilePool *pool = projectile_manager->pools + i;
+    memset(pool->projectiles, 0, pool->capacity * sizeof *(pool->projectiles));
+    pool->projectile_count = 0;
+    pool->stats = (PoolStats){0};
+  }
 
   // Most stats are set when boss is spawned
   boss->is_active = false;
   boss->is_defeated = false;
-  boss->score_for_next_spawn = boss->boss_type->initial_score_to_spawn;
+  boss->score_for_next_spawn = boss_types[boss->type].initial_score_to_spawn;
 }
 
-// Perform actions when this instance of the game ends
-void end_game(Player *player, EnemyManager *enemy_manager, ProjectileManager *projectile_manager, Shop *shop) {
+// Perform actions when this instance of the game ends. The pools' high-water marks are recorded, and pools that
+// grew beyond what recent games suggest are shrunk back, so a single big game doesn't slow down the ones after it.
+// Shrinking only drops entities of the finished game, which start_game clears anyway
+void end_game(Player *player, EnemyManager *enemy_manager, ProjectileManager *projectile_manager, Shop *shop,
+              PoolSizing *pool_sizing, const Constants *constants) {
   shop->money += player->score;
   shop->boss_points += player->boss_points;
+
+  if (DEBUG >= 1) {
+    printf("Enemy pool: high-water mark %d, capacity %d, grew %d times (%zu bytes)\n",
+           enemy_manager->stats.high_water, enemy_manager->capacity, enemy_manager->stats.grow_count,
+           enemy_manager->stats.grown_bytes);
+    for (int i = 0; i < NUM_ALLEGIANCES; i++) {
+      const ProjectilePool *pool = projectile_manager->pools + i;
+      printf("%s projectile pool: high-water mark %d, capacity %d, grew %d times (%zu bytes)\n",
+             i == ALLEGIANCE_PLAYER ? "Player" : "Enemy", pool->stats.high_water, pool->capacity,
+             pool->stats.grow_count, pool->stats.grown_bytes);
+    }
+  }
+
+  pool_sizing_record(pool_sizing, enemy_manager, projectile_manager);
+
+  int enemy_capacity = pool_sizing_get_capacity(pool_sizing->enemy_high_water, constants->initial_max_enemies);
+  if (enemy_manager->capacity > enemy_capacity) enemy_manager_resize(enemy_manager, enemy_capacity);
+
+  for (int i = 0; i < NUM_ALLEGIANCES; i++) {
+    ProjectilePool *pool = projectile_manager->pools + i;
+    int projectile_capacity =
+        pool_sizing_get_capacity(pool_sizing->projectile_high_water[i], constants->initial_max_projectiles);
+    if (pool->capacity > projectile_capacity) projectile_pool_resize(pool, projectile_capacity);
+  }
 }
 
 // Clean up game objects when the program ends
@@ -476,129 +2009,1003 @@ void cleanup_game(EnemyManager *enemy_manager, ProjectileManager *projectile_man
   free(enemy_manager->enemies);
   enemy_manager->enemies = NULL;
 
-  free(projectile_manager->projectiles);
-  projectile_manager->projectiles = NULL;
+  for (int i = 0; i < NUM_ALLEGIANCES; i++) {
+    free(projectile_manager->pools[i].projectiles);
+    projectile_manager->pools[i].projectiles = NULL;
+    free(projectile_manager->pools[i].expiry_heap);
+    projectile_manager->pools[i].expiry_heap = NULL;
+  }
 }
 /*---------------------------------------------------------------------------------------------------------------*/
 
-/*-----------------------*/
-/* Projectile management */
+/*------------------*/
+/* Rewind snapshots */
 /*---------------------------------------------------------------------------------------------------------------*/
 
-// Add a projectile to the projectile manager's storage, doubling its size if it is full
-void projectile_manager_add_projectile(ProjectileManager *projectile_manager, Projectile projectile) {
-  // If the projectile manager would become full, double its size
-  while (projectile_manager->projectile_count + 1 > projectile_manager->capacity) {
-    projectile_manager->capacity *= 2;
-    projectile_manager->projectiles = realloc(
-        projectile_manager->projectiles, projectile_manager->capacity * sizeof *(projectile_manager->projectiles));
+// Get the number of bytes needed to serialise the game state
+size_t game_state_serialised_size(const GameState *game_state) {
+  const EnemyManager *enemy_manager = &game_state->enemy_manager;
+  size_t size = sizeof *game_state + enemy_manager->capacity * sizeof *(enemy_manager->enemies);
+  for (int i = 0; i < NUM_ALLEGIANCES; i++) {
+    const ProjectilePool *pool = game_state->projectile_manager.pools + i;
+    size += pool->capacity * (sizeof *(pool->projectiles) + sizeof *(pool->expiry_heap));
   }
+  return size;
+}
 
-  for (int i = 0; i < projectile_manager->capacity; i++) {
-    if (!projectile_manager->projectiles[i].is_active) {
-      projectile_manager->projectiles[i] = projectile;
-      projectile_manager->projectile_count++;
-      return;
-    }
+// Serialise the game state into `dest`: the GameState itself (with its storage pointers zeroed, so the bytes don't
+// depend on where the storage lives) followed by the enemy storage and each projectile pool's storage
+void game_state_serialise(const GameState *game_state, unsigned char *dest) {
+  GameState *dest_state = (GameState *)dest;
+  memcpy(dest_state, game_state, sizeof *game_state);
+  dest_state->enemy_manager.enemies = NULL;
+  for (int i = 0; i < NUM_ALLEGIANCES; i++) {
+    dest_state->projectile_manager.pools[i].projectiles = NULL;
+    dest_state->projectile_manager.pools[i].expiry_heap = NULL;
+  }
+  dest += sizeof *game_state;
 
-    // Check that the loop doesn't terminate without finding an inactive projectile (this is the final i)
-    assert((i != projectile_manager->capacity - 1) && "No inactive projectile found");
+  size_t enemies_size = game_state->enemy_manager.capacity * sizeof *game_state->enemy_manager.enemies;
+  memcpy(dest, game_state->enemy_manager.enemies, enemies_size);
+  dest += enemies_size;
+
+  for (int i = 0; i < NUM_ALLEGIANCES; i++) {
+    const ProjectilePool *pool = game_state->projectile_manager.pools + i;
+    size_t projectiles_size = pool->capacity * sizeof *(pool->projectiles);
+    memcpy(dest, pool->projectiles, projectiles_size);
+    dest += projectiles_size;
+
+    size_t heap_size = pool->capacity * sizeof *(pool->expiry_heap);
+    memcpy(dest, pool->expiry_heap, heap_size);
+    dest += heap_size;
   }
 }
 
-// Update projectile positions according to their trajectories
-void projectile_manager_update_projectile_positions(ProjectileManager *projectile_manager, Vector2 camera_position,
-                                                    const Constants *constants) {
-  for (int i = 0, projectiles_counted = 0;
-       i < projectile_manager->capacity && projectiles_counted < projectile_manager->projectile_count; i++) {
-    Projectile *this_projectile = projectile_manager->projectiles + i;
-    if (!this_projectile->is_active) continue;
-
-    projectiles_counted++;
+// Restore the game state from data written by game_state_serialise, resizing the entity storage if its capacity
+// has changed since
+void game_state_deserialise(GameState *game_state, const unsigned char *src) {
+  EnemyManager current_enemy_manager = game_state->enemy_manager;
+  ProjectileManager current_projectile_manager = game_state->projectile_manager;
+  memcpy(game_state, src, sizeof *game_state);
 
-    // Move the projectile along its trajectory according to its speed
-    this_projectile->pos = Vector2Add(this_projectile->pos,
-                                      Vector2Scale(this_projectile->dir, this_projectile->speed * GetFrameTime()));
+  EnemyManager *enemy_manager = &game_state->enemy_manager;
+  enemy_manager->enemies = current_enemy_manager.enemies;
+  if (enemy_manager->capacity != current_enemy_manager.capacity) {
+    enemy_manager->enemies =
+        realloc(enemy_manager->enemies, enemy_manager->capacity * sizeof *(enemy_manager->enemies));
+    if (!enemy_manager->enemies) {
+      fprintf(stderr, "Unable to reallocate enemy storage.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
 
-    // If the projectile has moved outside the game boundaries, make it inactive
-    if (!circle_is_in_game_area(this_projectile->pos, this_projectile->size, constants)) {
-      this_projectile->is_active = false;
-      projectile_manager->projectile_count--;
+  src += sizeof *game_state;
+
+  size_t enemies_size = enemy_manager->capacity * sizeof *(enemy_manager->enemies);
+  memcpy(enemy_manager->enemies, src, enemies_size);
+  src += enemies_size;
+
+  for (int i = 0; i < NUM_ALLEGIANCES; i++) {
+    ProjectilePool *pool = game_state->projectile_manager.pools + i;
+    const ProjectilePool *current_pool = current_projectile_manager.pools + i;
+    pool->projectiles = current_pool->projectiles;
+    pool->expiry_heap = current_pool->expiry_heap;
+    if (pool->capacity != current_pool->capacity) {
+      pool->projectiles = realloc(pool->projectiles, pool->capacity * sizeof *(pool->projectiles));
+      pool->expiry_heap = realloc(pool->expiry_heap, pool->capacity * sizeof *(pool->expiry_heap));
+      if (!pool->projectiles || !pool->expiry_heap) {
+        fprintf(stderr, "Unable to reallocate projectile storage.\n");
+        exit(EXIT_FAILURE);
+      }
     }
+
+    size_t projectiles_size = pool->capacity * sizeof *(pool->projectiles);
+    memcpy(pool->projectiles, src, projectiles_size);
+    src += projectiles_size;
+
+    size_t heap_size = pool->capacity * sizeof *(pool->expiry_heap);
+    memcpy(pool->expiry_heap, src, heap_size);
+    src += heap_size;
   }
 }
 
-// Check for collisions between projectiles and objects of opposing allegiance
-void projectile_manager_check_for_collisions(ProjectileManager *projectile_manager, EnemyManager *enemy_manager,
-                                             Player *player, Boss *boss) {
-  for (int i = 0, projectiles_counted = 0;
-       i < projectile_manager->capacity && projectiles_counted < projectile_manager->projectile_count; i++) {
-    Projectile *this_projectile = projectile_manager->projectiles + i;
-    if (!this_projectile->is_active) continue;
+// Write `value` as a little endian base 128 varint, returning the number of bytes written
+size_t write_varint(unsigned char *dest, size_t value) {
+  size_t length = 0;
+  do {
+    dest[length++] = (value & 0x7F) | (value >= 0x80 ? 0x80 : 0);
+    value >>= 7;
+  } while (value);
+  return length;
+}
+
+// Read a varint written by write_varint, returning the number of bytes read
+size_t read_varint(const unsigned char *src, size_t *value) {
+  size_t length = 0;
+  *value = 0;
+  do {
+    *value |= (size_t)(src[length] & 0x7F) << (7 * length);
+  } while (src[length++] & 0x80);
+  return length;
+}
+
+// Encode `raw` as a delta from `base` (bytes past the end of `base` count as zero). Only a few entities move
+// between snapshots, so the XOR of the two is almost all zero. It is stored as a sequence of (zero run length,
+// literal length, literal bytes) with varint lengths. `dest` must have room for 2 * raw_size + 16 bytes. Returns
+// the encoded size
+size_t snapshot_delta_encode(const unsigned char *base, size_t base_size, const unsigned char *raw,
+                             size_t raw_size, unsigned char *dest) {
+#define DELTA_BYTE(i) (raw[i] ^ ((i) < base_size ? base[i] : 0))
+  size_t encoded_size = 0;
+  size_t i = 0;
+  while (i < raw_size) {
+    size_t zero_run_start = i;
+    while (i < raw_size && DELTA_BYTE(i) == 0) i++;
+
+    // Runs of fewer than four zeros are cheaper to keep in the literal than to split it
+    size_t literal_start = i;
+    while (i < raw_size) {
+      size_t zeros_end = i;
+      while (zeros_end < raw_size && zeros_end - i < 4 && DELTA_BYTE(zeros_end) == 0) zeros_end++;
+      if (zeros_end - i >= 4 || zeros_end == raw_size) break;
+      i = zeros_end + 1;
+    }
+
+    encoded_size += write_varint(dest + encoded_size, literal_start - zero_run_start);
+    encoded_size += write_varint(dest + encoded_size, i - literal_start);
+    for (size_t j = literal_start; j < i; j++) {
+      dest[encoded_size++] = DELTA_BYTE(j);
+    }
+  }
+  return encoded_size;
+#undef DELTA_BYTE
+}
+
+// Apply a delta from snapshot_delta_encode to `buffer`, which holds the `base_size` byte base of the delta. The
+// buffer then holds the `raw_size` byte decoded snapshot
+void snapshot_delta_apply(unsigned char *buffer, size_t base_size, const unsigned char *delta, size_t delta_size,
+                          size_t raw_size) {
+  if (raw_size > base_size) memset(buffer + base_size, 0, raw_size - base_size);
+
+  size_t position = 0;
+  for (size_t i = 0; i < delta_size;) {
+    size_t zero_run, literal_length;
+    i += read_varint(delta + i, &zero_run);
+    i += read_varint(delta + i, &literal_length);
+
+    position += zero_run;
+    for (size_t j = 0; j < literal_length; j++) {
+      buffer[position++] ^= delta[i++];
+    }
+  }
+}
+
+// Set up an empty snapshot ring holding `rewind_duration` seconds of snapshots
+void snapshot_ring_init(SnapshotRing *ring, const Constants *constants) {
+  *ring = (SnapshotRing){0};
+  ring->capacity = ceilf(constants->rewind_duration * constants->snapshot_rate) + 1;
+  ring->snapshots = calloc(ring->capacity, sizeof *(ring->snapshots));
+  if (!ring->snapshots) {
+    fprintf(stderr, "Unable to allocate snapshot storage.\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Get the snapshot at `index` in the ring, where 0 is the oldest
+Snapshot *snapshot_ring_get(const SnapshotRing *ring, int index) {
+  return ring->snapshots + (ring->start + index) % ring->capacity;
+}
+
+// Remove all snapshots from the ring (keeping their storage for reuse)
+void snapshot_ring_clear(SnapshotRing *ring) {
+  ring->start = 0;
+  ring->count = 0;
+  ring->since_keyframe = 0;
+  ring->previous_size = 0;
+}
+
+// Grow `*buffer` to at least `size` bytes, keeping its contents
+void snapshot_reserve(unsigned char **buffer, size_t *allocated, size_t size) {
+  if (*allocated >= size) return;
+
+  *buffer = realloc(*buffer, size);
+  if (!*buffer) {
+    fprintf(stderr, "Unable to allocate snapshot memory.\n");
+    exit(EXIT_FAILURE);
+  }
+  *allocated = size;
+}
+
+// Add a snapshot of the game state to the ring, replacing the oldest snapshot if the ring is full
+void snapshot_ring_push(SnapshotRing *ring, const GameState *game_state, const Constants *constants) {
+  size_t raw_size = game_state_serialised_size(game_state);
+  if (ring->buffer_capacity < raw_size) {
+    size_t buffer_capacity = ring->buffer_capacity;
+    snapshot_reserve(&ring->previous, &buffer_capacity, raw_size);
+    buffer_capacity = ring->buffer_capacity;
+    snapshot_reserve(&ring->current, &buffer_capacity, raw_size);
+    buffer_capacity = ring->buffer_capacity;
+    snapshot_reserve(&ring->decoded, &buffer_capacity, raw_size);
+    ring->buffer_capacity = raw_size;
+  }
+  game_state_serialise(game_state, ring->current);
+
+  if (ring->count == ring->capacity) {  // Overwrite the oldest snapshot
+    ring->start = (ring->start + 1) % ring->capacity;
+    ring->count--;
+  }
+  Snapshot *snapshot = snapshot_ring_get(ring, ring->count);
+  ring->count++;
+
+  // Keyframes are taken regularly so that restoring never has to apply more than a few deltas
+  snapshot->is_keyframe = ring->count == 1 || ring->since_keyframe + 1 >= constants->snapshot_keyframe_interval;
+  ring->since_keyframe = snapshot->is_keyframe ? 0 : ring->since_keyframe + 1;
+  snapshot->raw_size = raw_size;
+  snapshot->time = game_state->time;
+
+  if (snapshot->is_keyframe) {
+    snapshot_reserve(&snapshot->data, &snapshot->allocated, raw_size);
+    memcpy(snapshot->data, ring->current, raw_size);
+    snapshot->size = raw_size;
+  } else {
+    snapshot_reserve(&snapshot->data, &snapshot->allocated, 2 * raw_size + 16);
+    snapshot->size =
+        snapshot_delta_encode(ring->previous, ring->previous_size, ring->current, raw_size, snapshot->data);
+  }
+
+  // The snapshot just taken is the base of the next delta
+  unsigned char *swap = ring->previous;
+  ring->previous = ring->current;
+  ring->current = swap;
+  ring->previous_size = raw_size;
+}
+
+// Take a snapshot if it has been long enough since the last one
+void snapshot_ring_try_to_take_snapshot(SnapshotRing *ring, const GameState *game_state,
+                                        const Constants *constants) {
+  if (ring->count > 0 &&
+      game_state->time - snapshot_ring_get(ring, ring->count - 1)->time < 1 / constants->snapshot_rate)
+    return;
+
+  snapshot_ring_push(ring, game_state, constants);
+}
+
+// Restore the game state from the snapshot at `index` (0 is the oldest). Snapshots newer than it are discarded, so
+// the game carries on from that point. Returns false if the snapshot can't be decoded because the keyframe it
+// depends on has already been overwritten
+bool snapshot_ring_restore(SnapshotRing *ring, int index, GameState *game_state) {
+  if (index < 0 || index >= ring->count) return false;
+
+  int keyframe = index;
+  while (keyframe >= 0 && !snapshot_ring_get(ring, keyframe)->is_keyframe) keyframe--;
+  if (keyframe < 0) return false;
+
+  // Decode the keyframe, then apply each delta after it in turn
+  const Snapshot *snapshot = snapshot_ring_get(ring, keyframe);
+  memcpy(ring->decoded, snapshot->data, snapshot->raw_size);
+  size_t decoded_size = snapshot->raw_size;
+  for (int i = keyframe + 1; i <= index; i++) {
+    snapshot = snapshot_ring_get(ring, i);
+    snapshot_delta_apply(ring->decoded, decoded_size, snapshot->data, snapshot->size, snapshot->raw_size);
+    decoded_size = snapshot->raw_size;
+  }
+  game_state_deserialise(game_state, ring->decoded);
+
+  ring->count = index + 1;
+  ring->since_keyframe = index - keyframe;
+
+  // The restored snapshot is the base of the next delta
+  unsigned char *swap = ring->previous;
+  ring->previous = ring->decoded;
+  ring->decoded = swap;
+  ring->previous_size = decoded_size;
+  return true;
+}
+
+// Rewind the game by `steps` snapshots, or as far as possible if there aren't enough snapshots left
+void snapshot_ring_rewind(SnapshotRing *ring, int steps, GameState *game_state) {
+  if (steps <= 0 || ring->count == 0) return;
+
+  int index = ring->count - 1 - steps;
+  if (index < 0) index = 0;
+  while (index < ring->count - 1 && !snapshot_ring_restore(ring, index, game_state)) index++;
+}
+
+// Get the total number of bytes used by the encoded snapshots in the ring
+size_t snapshot_ring_get_memory_usage(const SnapshotRing *ring) {
+  size_t memory_usage = 0;
+  for (int i = 0; i < ring->count; i++) {
+    memory_usage += snapshot_ring_get(ring, i)->size;
+  }
+  return memory_usage;
+}
+
+// Free the snapshot ring's storage
+void snapshot_ring_cleanup(SnapshotRing *ring) {
+  for (int i = 0; i < ring->capacity; i++) {
+    free(ring->snapshots[i].data);
+  }
+  free(ring->snapshots);
+  free(ring->previous);
+  free(ring->current);
+  free(ring->decoded);
+  *ring = (SnapshotRing){0};
+}
+/*---------------------------------------------------------------------------------------------------------------*/
+
+/*-----------*/
+/* Particles */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+// Add a burst to the queue. Only called by the simulation thread. The burst is dropped if the render thread has
+// fallen too far behind to take it
+void particle_burst_queue_push(ParticleBurstQueue *queue, ParticleBurst burst) {
+  unsigned head = queue->head;
+  if (head - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) == PARTICLE_BURST_QUEUE_CAPACITY) return;
+
+  queue->bursts[head % PARTICLE_BURST_QUEUE_CAPACITY] = burst;
+  __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Take the oldest burst from the queue. Only called by the render thread. Returns false if it is empty
+bool particle_burst_queue_pop(ParticleBurstQueue *queue, ParticleBurst *burst) {
+  unsigned tail = queue->tail;
+  if (tail == __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)) return false;
+
+  *burst = queue->bursts[tail % PARTICLE_BURST_QUEUE_CAPACITY];
+  __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+// Allocate storage for up to `capacity` particles, with none alive
+void particle_system_init(ParticleSystem *particles, int capacity, uint64_t seed) {
+  int padded_capacity = (capacity + PARTICLE_LANES - 1) / PARTICLE_LANES * PARTICLE_LANES;
+  *particles = (ParticleSystem){.pos_x = calloc(padded_capacity, sizeof(float)),
+                                .pos_y = calloc(padded_capacity, sizeof(float)),
+                                .vel_x = calloc(padded_capacity, sizeof(float)),
+                                .vel_y = calloc(padded_capacity, sizeof(float)),
+                                .lives = calloc(padded_capacity, sizeof(float)),
+                                .inverse_lifetimes = calloc(padded_capacity, sizeof(float)),
+                                .colours = calloc(padded_capacity, sizeof(Color)),
+                                .capacity = capacity};
+  if (!particles->pos_x || !particles->pos_y || !particles->vel_x || !particles->vel_y || !particles->lives ||
+      !particles->inverse_lifetimes || !particles->colours) {
+    fprintf(stderr, "Unable to allocate particle storage.\n");
+    exit(EXIT_FAILURE);
+  }
+  random_seed(&particles->random, seed);
+}
+
+// Add a particle. Returns false (dropping it) if the pool is full
+bool particle_system_spawn(ParticleSystem *particles, Vector2 pos, Vector2 vel, float lifetime, Color colour) {
+  if (particles->count == particles->capacity) return false;
+
+  int i = particles->count++;
+  particles->pos_x[i] = pos.x;
+  particles->pos_y[i] = pos.y;
+  particles->vel_x[i] = vel.x;
+  particles->vel_y[i] = vel.y;
+  particles->lives[i] = lifetime;
+  particles->inverse_lifetimes[i] = 1 / lifetime;
+  particles->colours[i] = colour;
+  return true;
+}
+
+// Remove the particle at index `i`, moving the last particle into its place
+void particle_system_release(ParticleSystem *particles, int i) {
+  int last = --particles->count;
+  particles->pos_x[i] = particles->pos_x[last];
+  particles->pos_y[i] = particles->pos_y[last];
+  particles->vel_x[i] = particles->vel_x[last];
+  particles->vel_y[i] = particles->vel_y[last];
+  particles->lives[i] = particles->lives[last];
+  particles->inverse_lifetimes[i] = particles->inverse_lifetimes[last];
+  particles->colours[i] = particles->colours[last];
+}
+
+// Spawn the particles for a burst, flying outwards from the edge of the circle that was hit
+void particle_system_spawn_burst(ParticleSystem *particles, const ParticleBurst *burst) {
+  // Number of particles, and their greatest speed (in units per second) and lifetime (in seconds), for each type
+  const struct {
+    int num_particles;
+    float speed;
+    float lifetime;
+  } burst_types[] = {[PARTICLE_BURST_ENEMY_DECAY] = {6, 3, 0.3},
+                     [PARTICLE_BURST_ENEMY_DEATH] = {16, 4, 0.5},
+                     [PARTICLE_BURST_BOSS_DEATH] = {160, 8, 1.2}};
+  int num_particles = burst_types[burst->type].num_particles;
+  float speed = burst_types[burst->type].speed;
+  float lifetime = burst_types[burst->type].lifetime;
+
+  for (int i = 0; i < num_particles; i++) {
+    float angle = get_random_float(&particles->random, 0, 2 * PI);
+    Vector2 direction = {cosf(angle), sinf(angle)};
+    Vector2 pos = Vector2Add(burst->pos, Vector2Scale(direction, burst->radius));
+    Vector2 vel = Vector2Scale(direction, get_random_float(&particles->random, 0.4, 1) * speed);
+    if (!particle_system_spawn(particles, pos, vel, get_random_float(&particles->random, 0.6, 1) * lifetime,
+                               burst->colour))
+      return;
+  }
+}
+
+// Advance the particles by `frame_time` seconds and release those that have expired. Every field is updated
+// PARTICLE_LANES particles at a time, running on into the unused slots of the last lanes
+void particle_system_update(ParticleSystem *particles, float frame_time) {
+  ParticleLanes *pos_x = (ParticleLanes *)particles->pos_x;
+  ParticleLanes *pos_y = (ParticleLanes *)particles->pos_y;
+  ParticleLanes *vel_x = (ParticleLanes *)particles->vel_x;
+  ParticleLanes *vel_y = (ParticleLanes *)particles->vel_y;
+  ParticleLanes *lives = (ParticleLanes *)particles->lives;
+  float drag = expf(-PARTICLE_DRAG * frame_time);
+
+  int num_lanes = (particles->count + PARTICLE_LANES - 1) / PARTICLE_LANES;
+  for (int i = 0; i < num_lanes; i++) {
+    pos_x[i] += vel_x[i] * frame_time;
+    pos_y[i] += vel_y[i] * frame_time;
+    vel_x[i] *= drag;
+    vel_y[i] *= drag;
+    lives[i] -= frame_time;
+  }
+
+  for (int i = 0; i < particles->count;) {
+    if (particles->lives[i] <= 0)
+      particle_system_release(particles, i);  // Moves an unchecked particle into slot i, so i isn't advanced
+    else
+      i++;
+  }
+}
+
+// Draw the particles as squares which fade out over their lifetimes. They all go into the render batch as quads
+// from a single loop, rather than a raylib draw call each
+void particle_system_draw(const ParticleSystem *particles, Vector2 camera_position, const Constants *constants) {
+  if (particles->count == 0) return;
+
+  // Positions are converted to pixels here, as get_draw_position_from_unit_position is just a scale and shift
+  float scale = get_units_to_pixels_scale_factor(constants);
+  Vector2 origin = get_draw_position_from_unit_position(Vector2Negate(camera_position), constants);
+  float half_size = PARTICLE_SIZE / 2 * scale;
+  float max_x = get_screen_width(constants) + half_size;
+  float max_y = get_screen_height(constants) + half_size;
+
+  if (constants->software_canvas) {
+    for (int i = 0; i < particles->count; i++) {
+      float x = origin.x + particles->pos_x[i] * scale;
+      float y = origin.y + particles->pos_y[i] * scale;
+      if (x < -half_size || x > max_x || y < -half_size || y > max_y) continue;
+
+      Color colour = particles->colours[i];
+      colour.a *= particles->lives[i] * particles->inverse_lifetimes[i];
+      software_canvas_fill_rectangle(constants->software_canvas, (Vector2){x - half_size, y - half_size},
+                                     (Vector2){2 * half_size, 2 * half_size}, colour);
+    }
+    return;
+  }
+
+  rlSetTexture(rlGetTextureIdDefault());  // Plain white, so it doesn't matter what texture coordinates are set
+  for (int start = 0; start < particles->count; start += PARTICLE_DRAW_CHUNK) {
+    int end = start + PARTICLE_DRAW_CHUNK < particles->count ? start + PARTICLE_DRAW_CHUNK : particles->count;
+    rlCheckRenderBatchLimit(4 * (end - start));  // Flush the batch now rather than part way through a quad
+    rlBegin(RL_QUADS);
+    for (int i = start; i < end; i++) {
+      float x = origin.x + particles->pos_x[i] * scale;
+      float y = origin.y + particles->pos_y[i] * scale;
+      if (x < -half_size || x > max_x || y < -half_size || y > max_y) continue;
+
+      Color colour = particles->colours[i];
+      rlColor4ub(colour.r, colour.g, colour.b, colour.a * particles->lives[i] * particles->inverse_lifetimes[i]);
+      rlVertex2f(x - half_size, y - half_size);
+      rlVertex2f(x - half_size, y + half_size);
+      rlVertex2f(x + half_size, y + half_size);
+      rlVertex2f(x + half_size, y - half_size);
+    }
+    rlEnd();
+  }
+  rlSetTexture(0);
+}
+
+// Free the particles' storage
+void particle_system_cleanup(ParticleSystem *particles) {
+  free(particles->pos_x);
+  free(particles->pos_y);
+  free(particles->vel_x);
+  free(particles->vel_y);
+  free(particles->lives);
+  free(particles->inverse_lifetimes);
+  free(particles->colours);
+  *particles = (ParticleSystem){0};
+}
+/*---------------------------------------------------------------------------------------------------------------*/
+
+/*-----------------------*/
+/* Projectile management */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+// Get the position of a projectile at the given time
+Vector2 projectile_get_position(const Projectile *projectile, float time) {
+  return Vector2Add(projectile->spawn_pos, Vector2Scale(projectile->vel, time - projectile->spawn_time));
+}
+
+// Get the time at which a projectile will have entirely left the game area (and so stop being processed)
+float projectile_get_exit_time(const Projectile *projectile, const Constants *constants) {
+  float exit_time = INFINITY;
+  float spawn_pos[2] = {projectile->spawn_pos.x, projectile->spawn_pos.y};
+  float vel[2] = {projectile->vel.x, projectile->vel.y};
+  float half_dimensions[2] = {constants->game_area_dimensions.x / 2, constants->game_area_dimensions.y / 2};
+
+  // On each axis, the projectile leaves when its trailing edge passes the boundary it is moving towards
+  for (int axis = 0; axis < 2; axis++) {
+    if (vel[axis] == 0) continue;
+    float boundary = half_dimensions[axis] + projectile->size;
+    if (vel[axis] < 0) boundary = -boundary;
+    exit_time = fminf(exit_time, projectile->spawn_time + (boundary - spawn_pos[axis]) / vel[axis]);
+  }
+  return exit_time;
+}
+
+// Swap two entries of a pool's expiry heap, keeping their projectiles' heap positions up to date
+void projectile_pool_swap_heap_entries(ProjectilePool *pool, int a, int b) {
+  ProjectileExpiry temp = pool->expiry_heap[a];
+  pool->expiry_heap[a] = pool->expiry_heap[b];
+  pool->expiry_heap[b] = temp;
+  pool->projectiles[pool->expiry_heap[a].index].heap_position = a;
+  pool->projectiles[pool->expiry_heap[b].index].heap_position = b;
+}
+
+// Restore the heap property for the entry at `position`, which may be out of place in either direction
+void projectile_pool_fix_heap_entry(ProjectilePool *pool, int position) {
+  ProjectileExpiry *heap = pool->expiry_heap;
+  while (position > 0 && heap[position].exit_time < heap[(position - 1) / 2].exit_time) {
+    projectile_pool_swap_heap_entries(pool, position, (position - 1) / 2);
+    position = (position - 1) / 2;
+  }
+
+  while (true) {
+    int smallest = position;
+    int left = 2 * position + 1, right = 2 * position + 2;
+    if (left < pool->projectile_count && heap[left].exit_time < heap[smallest].exit_time) smallest = left;
+    if (right < pool->projectile_count && heap[right].exit_time < heap[smallest].exit_time) smallest = right;
+    if (smallest == position) return;
+
+    projectile_pool_swap_heap_entries(pool, position, smallest);
+    position = smallest;
+  }
+}
+
+// Get the direction a player projectile fired from `pos` towards `aim_pos` moves in
+Vector2 projectile_get_aim_direction(Vector2 pos, Vector2 aim_pos) {
+  // If the aim is on the player, just fire in an arbitrary direction, otherwise fire towards the aim
+  if (Vector2Equals(aim_pos, pos)) return (Vector2){1, 0};  // Arbitrarily choose to shoot to the right
+  return sim_normalise(Vector2Subtract(aim_pos, pos));
+}
+
+// Turn the player's projectiles spawned in a late aim's interval (see LateAim) towards its aim, as if they were
+// fired at it. The pool's expiry heap is kept up to date if it has one (render frame copies don't)
+void projectile_pool_apply_late_aim(ProjectilePool *pool, Vector2 aim_pos, float spawned_after,
+                                    float spawned_before, float projectile_speed, const Constants *constants) {
+  if (spawned_after >= spawned_before) return;
+
+  for (int i = 0; i < pool->capacity; i++) {
+    Projectile *this_projectile = pool->projectiles + i;
+    if (!this_projectile->is_active || this_projectile->spawn_time <= spawned_after ||
+        this_projectile->spawn_time > spawned_before)
+      continue;
+
+    Vector2 dir = projectile_get_aim_direction(this_projectile->spawn_pos, aim_pos);
+    this_projectile->vel = Vector2Scale(dir, projectile_speed);
+    if (!pool->expiry_heap) continue;
+
+    int position = this_projectile->heap_position;
+    pool->expiry_heap[position].exit_time = projectile_get_exit_time(this_projectile, constants);
+    projectile_pool_fix_heap_entry(pool, position);
+  }
+}
+
+// Add a projectile to a projectile pool's storage, doubling its size if it is full
+void projectile_pool_add_projectile(ProjectilePool *pool, Projectile projectile, const Constants *constants) {
+  // If the pool would become full, double its size
+  while (pool->projectile_count + 1 > pool->capacity) {
+    pool->stats.grow_count++;
+    pool->stats.grown_bytes += pool->capacity * (sizeof *(pool->projectiles) + sizeof *(pool->expiry_heap));
+    projectile_pool_resize(pool, pool->capacity * 2);
+  }
+
+  for (int i = 0; i < pool->capacity; i++) {
+    if (!pool->projectiles[i].is_active) {
+      int position = pool->projectile_count++;
+      if (pool->projectile_count > pool->stats.high_water) pool->stats.high_water = pool->projectile_count;
+      projectile.heap_position = position;
+      pool->projectiles[i] = projectile;
+      pool->expiry_heap[position] =
+          (ProjectileExpiry){.exit_time = projectile_get_exit_time(&projectile, constants), .index = i};
+      projectile_pool_fix_heap_entry(pool, position);
+      return;
+    }
+
+    // Check that the loop doesn't terminate without finding an inactive projectile (this is the final i)
+    assert((i != pool->capacity - 1) && "No inactive projectile found");
+  }
+}
+
+// Make the projectile at index `i` of a pool inactive and remove it from the expiry heap
+void projectile_pool_remove_projectile(ProjectilePool *pool, int i) {
+  Projectile *projectile = pool->projectiles + i;
+  int position = projectile->heap_position;
+  projectile->is_active = false;
+  pool->projectile_count--;
+
+  // Move the last heap entry into the hole and restore the heap property
+  if (position == pool->projectile_count) return;
+  pool->expiry_heap[position] = pool->expiry_heap[pool->projectile_count];
+  pool->projectiles[pool->expiry_heap[position].index].heap_position = position;
+  projectile_pool_fix_heap_entry(pool, position);
+}
+
+// Remove the projectiles of a pool which have left the game area by `time`, visiting only the expired ones
+void projectile_pool_expire_projectiles(ProjectilePool *pool, float time) {
+  while (pool->projectile_count > 0 && pool->expiry_heap[0].exit_time < time) {
+    projectile_pool_remove_projectile(pool, pool->expiry_heap[0].index);
+  }
+}
+
+// Remove projectiles which have left the game area
+void projectile_manager_expire_projectiles(ProjectileManager *projectile_manager, float time) {
+  for (int i = 0; i < NUM_ALLEGIANCES; i++) {
+    projectile_pool_expire_projectiles(projectile_manager->pools + i, time);
+  }
+}
+/*---------------------------------------------------------------------------------------------------------------*/
+
+/*-------------*/
+/* Game events */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+// Empty the buffer, ready for the next update
+void game_event_buffer_clear(GameEventBuffer *buffer) { buffer->count = 0; }
+
+// Append an event to the buffer, growing it if it is full
+void game_event_buffer_push(GameEventBuffer *buffer, GameEvent event) {
+  if (buffer->count == buffer->capacity) {
+    buffer->capacity = buffer->capacity ? 2 * buffer->capacity : GAME_EVENT_BUFFER_INITIAL_CAPACITY;
+    buffer->events = realloc(buffer->events, buffer->capacity * sizeof *(buffer->events));
+    if (!buffer->events) {
+      fprintf(stderr, "Unable to reallocate game event storage.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  buffer->events[buffer->count++] = event;
+}
+
+void game_event_buffer_cleanup(GameEventBuffer *buffer) {
+  free(buffer->events);
+  *buffer = (GameEventBuffer){0};
+}
+
+// Find the first active enemy from index `first` onwards which a projectile at `projectile_pos` touches, returning
+// its index, or -1 if there isn't one
+int player_projectile_find_enemy_hit(const Projectile *projectile, Vector2 projectile_pos,
+                                     const EnemyManager *enemy_manager, int first) {
+  // Stops once it has seen as many active enemies as there are, as there can't be any more after them
+  for (int j = first, enemies_counted = 0;
+       j < enemy_manager->capacity && enemies_counted < enemy_manager->enemy_count; j++) {
+    const Enemy *this_enemy = enemy_manager->enemies + j;
+    if (!this_enemy->is_active) continue;
+
+    enemies_counted++;
+    if (sim_circles_collide(projectile_pos, projectile->size, this_enemy->pos, this_enemy->size)) return j;
+  }
+  return -1;
+}
+
+// Whether a projectile at `projectile_pos` touches the (active) boss
+bool player_projectile_hits_boss(const Projectile *projectile, Vector2 projectile_pos, const Boss *boss,
+                                 const BossType *boss_types) {
+  return boss->is_active &&
+         sim_circles_collide(projectile_pos, projectile->size, boss->pos, boss_types[boss->type].size);
+}
+
+// Find what each of the player's projectiles with an index in [first, end) has hit, appending a hit event for the
+// first enemy it touches, or for the boss if it touches no enemies. Nothing is changed, so every projectile sees
+// the same game state, and separate ranges can be checked at the same time
+void player_projectiles_detect_collisions(const ProjectilePool *pool, int first, int end,
+                                          const EnemyManager *enemy_manager, const Boss *boss,
+                                          const BossType *boss_types, float time, GameEventBuffer *events) {
+  for (int i = first, projectiles_counted = 0; i < end && projectiles_counted < pool->projectile_count; i++) {
+    const Projectile *this_projectile = pool->projectiles + i;
+    if (!this_projectile->is_active) continue;
 
     projectiles_counted++;
+    Vector2 projectile_pos = projectile_get_position(this_projectile, time);
 
-    switch (this_projectile->allegiance) {
-      case ALLEGIANCE_PLAYER:
-        // Check for collisions with enemies
-        for (int j = 0, enemies_counted = 0;
-             j < enemy_manager->capacity && enemies_counted < enemy_manager->enemy_count; j++) {
-          Enemy *this_enemy = enemy_manager->enemies + j;
-          if (!this_enemy->is_active) continue;
-
-          enemies_counted++;
-
-          if (!CheckCollisionCircles(this_projectile->pos, this_projectile->size, this_enemy->pos,
-                                     this_enemy->size))
-            continue;
-
-          this_projectile->is_active = false;
-          projectile_manager->projectile_count--;
-
-          // Decay the enemy type once for each full point of damage the player deals
-          float damage_remaining = player->projectile_damage;
-          while (damage_remaining >= 1) {
-            if (this_enemy->type->turns_into) {  // If the enemy is not at the base type, decay
-              this_enemy->type = this_enemy->type->turns_into;
-              this_enemy->speed = get_random_float(this_enemy->type->min_speed, this_enemy->type->max_speed);
-
-              damage_remaining--;
-              player->score++;
-            } else {  // Otherwise destroy the enemy
-              this_enemy->is_active = false;
-              enemy_manager->enemy_count--;
-
-              player->score++;
-              break;  // Don't deal any more damage to the enemy
-            }
-          }
+    int enemy = player_projectile_find_enemy_hit(this_projectile, projectile_pos, enemy_manager, 0);
+    if (enemy >= 0) {
+      game_event_buffer_push(events, (GameEvent){.type = GAME_EVENT_ENEMY_HIT, .projectile = i, .enemy = enemy});
+    } else if (player_projectile_hits_boss(this_projectile, projectile_pos, boss, boss_types)) {
+      game_event_buffer_push(events, (GameEvent){.type = GAME_EVENT_BOSS_HIT, .projectile = i});
+    }
+  }
+}
 
-          break;  // Exit the enemy loop so the projectile doesn't destroy a second enemy
-        }
+// Find which of the enemies' projectiles have hit the player (a single circle test per projectile), appending a
+// hit event for each
+void enemy_projectiles_detect_collisions(const ProjectilePool *pool, const Player *player, float time,
+                                         GameEventBuffer *events) {
+  for (int i = 0, projectiles_counted = 0; i < pool->capacity && projectiles_counted < pool->projectile_count;
+       i++) {
+    const Projectile *this_projectile = pool->projectiles + i;
+    if (!this_projectile->is_active) continue;
 
-        // Check for a collision with the boss
-        if (!boss->is_active) break;
-        if (!CheckCollisionCircles(this_projectile->pos, this_projectile->size, boss->pos, boss->boss_type->size))
-          break;
+    projectiles_counted++;
+
+    Vector2 projectile_pos = projectile_get_position(this_projectile, time);
+    if (!sim_circles_collide(projectile_pos, this_projectile->size, player->pos, player->size)) continue;
+
+    game_event_buffer_push(events, (GameEvent){.type = GAME_EVENT_PLAYER_HIT, .projectile = i});
+  }
+}
 
-        this_projectile->is_active = false;
-        projectile_manager->projectile_count--;
+// Body of each collision worker thread. Checks its range of the player's projectiles for each job posted, until
+// the workers are asked to stop
+void *collision_worker_run(void *arg) {
+  CollisionWorkers *workers = arg;
+
+  pthread_mutex_lock(&workers->mutex);
+  int range = ++workers->num_started;  // Range 0 is checked by the thread posting the jobs
+  unsigned jobs_done = 0;
+  while (true) {
+    while (workers->job_number == jobs_done && !workers->is_stopping)
+      pthread_cond_wait(&workers->job_started, &workers->mutex);
+    if (workers->is_stopping) break;
+    jobs_done = workers->job_number;
+    pthread_mutex_unlock(&workers->mutex);
+
+    GameEventBuffer *buffer = workers->buffers + range;
+    game_event_buffer_clear(buffer);
+    player_projectiles_detect_collisions(workers->pool, workers->range_starts[range],
+                                         workers->range_starts[range + 1], workers->enemy_manager, workers->boss,
+                                         workers->boss_types, workers->time, buffer);
+
+    pthread_mutex_lock(&workers->mutex);
+    if (--workers->num_busy == 0) pthread_cond_signal(&workers->job_finished);
+  }
+  pthread_mutex_unlock(&workers->mutex);
+  return NULL;
+}
+
+// Start `num_threads` - 1 worker threads, so that with the calling thread, collision detection is split
+// `num_threads` ways
+void collision_workers_init(CollisionWorkers *workers, int num_threads) {
+  *workers = (CollisionWorkers){.num_ranges = num_threads};
+  workers->threads = malloc((num_threads - 1) * sizeof *(workers->threads));
+  workers->buffers = calloc(num_threads, sizeof *(workers->buffers));
+  workers->range_starts = malloc((num_threads + 1) * sizeof *(workers->range_starts));
+  if (!workers->threads || !workers->buffers || !workers->range_starts) {
+    fprintf(stderr, "Unable to allocate collision worker storage.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  pthread_mutex_init(&workers->mutex, NULL);
+  pthread_cond_init(&workers->job_started, NULL);
+  pthread_cond_init(&workers->job_finished, NULL);
+  for (int i = 0; i < num_threads - 1; i++) {
+    if (pthread_create(workers->threads + i, NULL, collision_worker_run, workers) != 0) {
+      fprintf(stderr, "Unable to start collision worker thread.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+// Stop the worker threads and free their storage
+void collision_workers_cleanup(CollisionWorkers *workers) {
+  pthread_mutex_lock(&workers->mutex);
+  workers->is_stopping = true;
+  pthread_cond_broadcast(&workers->job_started);
+  pthread_mutex_unlock(&workers->mutex);
+  for (int i = 0; i < workers->num_ranges - 1; i++) pthread_join(workers->threads[i], NULL);
+
+  pthread_mutex_destroy(&workers->mutex);
+  pthread_cond_destroy(&workers->job_started);
+  pthread_cond_destroy(&workers->job_finished);
+  for (int i = 0; i < workers->num_ranges; i++) game_event_buffer_cleanup(workers->buffers + i);
+  free(workers->threads);
+  free(workers->buffers);
+  free(workers->range_starts);
+  *workers = (CollisionWorkers){0};
+}
+
+// Find what the player's projectiles have hit, split between the workers and the calling thread, appending the
+// same hit events in the same order as player_projectiles_detect_collisions over the whole pool
+void collision_workers_detect(CollisionWorkers *workers, const ProjectilePool *pool,
+                              const EnemyManager *enemy_manager, const Boss *boss, const BossType *boss_types,
+                              float time, GameEventBuffer *events) {
+  int num_ranges = workers->num_ranges;
+
+  // Split the pool into ranges holding equal numbers of active projectiles, since the active ones are usually
+  // bunched up at the start of the pool
+  int range = 1;
+  workers->range_starts[0] = 0;
+  for (int i = 0, num_seen = 0; i < pool->capacity && range < num_ranges; i++) {
+    if (!pool->projectiles[i].is_active) continue;
+    while (range < num_ranges && num_seen == range * pool->projectile_count / num_ranges)
+      workers->range_starts[range++] = i;
+    num_seen++;
+  }
+  while (range <= num_ranges) workers->range_starts[range++] = pool->capacity;
+
+  pthread_mutex_lock(&workers->mutex);
+  workers->pool = pool;
+  workers->enemy_manager = enemy_manager;
+  workers->boss = boss;
+  workers->boss_types = boss_types;
+  workers->time = time;
+  workers->job_number++;
+  workers->num_busy = num_ranges - 1;
+  pthread_cond_broadcast(&workers->job_started);
+  pthread_mutex_unlock(&workers->mutex);
+
+  player_projectiles_detect_collisions(pool, workers->range_starts[0], workers->range_starts[1], enemy_manager,
+                                       boss, boss_types, time, events);
+
+  pthread_mutex_lock(&workers->mutex);
+  while (workers->num_busy > 0) pthread_cond_wait(&workers->job_finished, &workers->mutex);
+  pthread_mutex_unlock(&workers->mutex);
+
+  // Later ranges hold later projectiles, so appending them in order matches the single-threaded order
+  for (int i = 1; i < num_ranges; i++) {
+    const GameEventBuffer *buffer = workers->buffers + i;
+    for (int j = 0; j < buffer->count; j++) game_event_buffer_push(events, buffer->events[j]);
+  }
+}
+
+// Append hit events for every projectile touching an object of opposing allegiance. The player's projectiles are
+// split between `collision_workers` if it isn't NULL, which finds the same hits
+void projectile_manager_detect_collisions(const ProjectileManager *projectile_manager,
+                                          const EnemyManager *enemy_manager, const Player *player,
+                                          const Boss *boss, const BossType *boss_types, float time,
+                                          CollisionWorkers *collision_workers, GameEventBuffer *events) {
+  const ProjectilePool *player_pool = projectile_manager->pools + ALLEGIANCE_PLAYER;
+  if (collision_workers && collision_workers->num_ranges > 1) {
+    collision_workers_detect(collision_workers, player_pool, enemy_manager, boss, boss_types, time, events);
+  } else {
+    player_projectiles_detect_collisions(player_pool, 0, player_pool->capacity, enemy_manager, boss, boss_types,
+                                         time, events);
+  }
+  enemy_projectiles_detect_collisions(projectile_manager->pools + ALLEGIANCE_ENEMIES, player, time, events);
+}
+
+// Knock layers off an enemy hit by one of the player's projectiles, decaying its type once for each full point of
+// damage the player deals, or destroying it once it is at the base type. Appends a decay event if it decayed, and
+// a kill event if it was destroyed
+void enemy_take_hit(EnemyManager *enemy_manager, int enemy, const Player *player, const EnemyType *enemy_types,
+                    RandomState *random, GameEventBuffer *events) {
+  Enemy *this_enemy = enemy_manager->enemies + enemy;
+  float damage = player->projectile_damage;
+  int whole_damage = damage >= ENEMY_DECAY_MAX_DAMAGE ? ENEMY_DECAY_MAX_DAMAGE : damage >= 1 ? (int)damage : 0;
+  EnemyDecay decay = enemy_types[this_enemy->type].decays[whole_damage];
+  GameEvent event = {.enemy = enemy, .object_type = this_enemy->type, .pos = this_enemy->pos,
+                     .radius = this_enemy->size};
+
+  if (decay.num_decays > 0) {
+    // Each decay picks a new speed for the type decayed into, and only the last one is kept. The other random
+    // numbers are skipped, so the rest of the game plays out the same as decaying one type at a time
+    random_skip(random, decay.num_decays - 1);
+    this_enemy->type = decay.type;
+    const EnemyType *new_type = enemy_types + this_enemy->type;
+    this_enemy->speed = enemy_speed_to_fixed(get_random_float(random, new_type->min_speed, new_type->max_speed));
+
+    event.type = GAME_EVENT_ENEMY_DECAYED;
+    event.num_decays = decay.num_decays;
+    game_event_buffer_push(events, event);
+  }
+
+  if (decay.is_destroyed) {
+    this_enemy->is_active = false;
+    enemy_manager->enemy_count--;
+
+    event.type = GAME_EVENT_ENEMY_KILLED;
+    event.object_type = decay.type;
+    event.num_decays = 0;
+    game_event_buffer_push(events, event);
+  }
+}
+
+// Take the player's projectile damage from the boss, marking it as defeated once it has no health left
+void boss_take_hit(Boss *boss, const Player *player, GameEventBuffer *events) {
+  boss->health -= player->projectile_damage;
+  if (boss->health <= 0) {
+    boss->is_defeated = true;
+  }
+  game_event_buffer_push(events, (GameEvent){.type = GAME_EVENT_BOSS_DAMAGED,
+                                             .object_type = boss->type,
+                                             .pos = boss->pos,
+                                             .damage = player->projectile_damage});
+}
 
-        boss->health -= player->projectile_damage;
-        if (boss->health <= 0) {
-          boss->is_defeated = true;
+// Apply the hit events found by detection, in the order they were found, removing the projectiles and damaging
+// what they hit. Each hit appends events for what it did (decays, kills and boss damage) to the same buffer, so
+// the buffer ends up as a complete record of the update for the systems that consume it.
+//
+// A hit on an enemy that an earlier hit this update has already destroyed isn't wasted: the projectile goes on to
+// the next enemy (or the boss) it touches, just as if the hits had been handled as they were found. Decaying an
+// enemy doesn't move or resize it, so no other hit can change
+void game_events_resolve_hits(GameEventBuffer *events, ProjectileManager *projectile_manager,
+                              EnemyManager *enemy_manager, Player *player, Boss *boss,
+                              const EnemyType *enemy_types, const BossType *boss_types, float time,
+                              RandomState *random) {
+  ProjectilePool *player_pool = projectile_manager->pools + ALLEGIANCE_PLAYER;
+  ProjectilePool *enemy_pool = projectile_manager->pools + ALLEGIANCE_ENEMIES;
+
+  int num_hits = events->count;  // Events appended while resolving are results, not hits
+  for (int i = 0; i < num_hits; i++) {
+    GameEvent event = events->events[i];  // Copied, since appending can move the buffer
+
+    switch (event.type) {
+    case GAME_EVENT_ENEMY_HIT: {
+      const Projectile *projectile = player_pool->projectiles + event.projectile;
+      int enemy = event.enemy;
+      if (!enemy_manager->enemies[enemy].is_active) {
+        Vector2 projectile_pos = projectile_get_position(projectile, time);
+        enemy = player_projectile_find_enemy_hit(projectile, projectile_pos, enemy_manager, enemy + 1);
+        if (enemy < 0) {
+          if (!player_projectile_hits_boss(projectile, projectile_pos, boss, boss_types)) break;
+
+          projectile_pool_remove_projectile(player_pool, event.projectile);
+          boss_take_hit(boss, player, events);
+          break;
         }
+      }
 
-        break;
-      case ALLEGIANCE_ENEMIES:
-        if (!CheckCollisionCircles(this_projectile->pos, this_projectile->size, player->pos, player->size)) break;
+      projectile_pool_remove_projectile(player_pool, event.projectile);
+      enemy_take_hit(enemy_manager, enemy, player, enemy_types, random, events);
+      break;
+    }
+    case GAME_EVENT_BOSS_HIT:
+      projectile_pool_remove_projectile(player_pool, event.projectile);
+      boss_take_hit(boss, player, events);
+      break;
+    case GAME_EVENT_PLAYER_HIT:
+      projectile_pool_remove_projectile(enemy_pool, event.projectile);
+      player->is_defeated = true;
+      break;
+    default:
+      break;
+    }
+  }
+}
 
-        player->is_defeated = true;
+// Score a point for each layer knocked off an enemy this update
+void game_events_apply_scores(const GameEventBuffer *events, Player *player) {
+  for (int i = 0; i < events->count; i++) {
+    const GameEvent *event = events->events + i;
+    if (event->type == GAME_EVENT_ENEMY_DECAYED) player->score += event->num_decays;
+    if (event->type == GAME_EVENT_ENEMY_KILLED) player->score++;
+  }
+}
 
-        this_projectile->is_active = false;
-        projectile_manager->projectile_count--;
-        break;
+// Send a particle burst for each enemy hit that decayed or destroyed it, and for the boss being defeated this
+// update
+void game_events_send_particle_bursts(const GameEventBuffer *events, const EnemyType *enemy_types,
+                                      const BossType *boss_types, ParticleBurstQueue *queue) {
+  for (int i = 0; i < events->count; i++) {
+    const GameEvent *event = events->events + i;
+    ParticleBurst burst = {.pos = event->pos, .radius = event->radius};
+
+    switch (event->type) {
+    case GAME_EVENT_ENEMY_DECAYED:
+      burst.type = PARTICLE_BURST_ENEMY_DECAY;
+      burst.colour = enemy_types[event->object_type].colour;
+      break;
+    case GAME_EVENT_ENEMY_KILLED:
+      burst.type = PARTICLE_BURST_ENEMY_DEATH;
+      burst.colour = enemy_types[event->object_type].colour;
+      break;
+    case GAME_EVENT_BOSS_DEFEATED:
+      burst.type = PARTICLE_BURST_BOSS_DEATH;
+      burst.colour = boss_types[event->object_type].colour;
+      break;
+    default:
+      continue;
     }
+    particle_burst_queue_push(queue, burst);
   }
 }
 /*---------------------------------------------------------------------------------------------------------------*/
@@ -607,10 +3014,10 @@ void projectile_manager_check_for_collisions(ProjectileManager *projectile_manag
 /* Player actions */
 /*---------------------------------------------------------------------------------------------------------------*/
 
-// Update the player's position according to keyboard input
-void player_update_position(Player *player, const Constants *constants) {
-  player->pos =
-      Vector2Add(player->pos, Vector2Scale(get_movement_input_direction(), player->speed * GetFrameTime()));
+// Update the player's position according to their input
+void player_update_position(Player *player, const PlayerInput *input, float frame_time,
+                            const Constants *constants) {
+  player->pos = Vector2Add(player->pos, Vector2Scale(input->move_direction, player->speed * frame_time));
 
   // Clamp the player inside the screen boundaries
   Vector2 min_player_pos = Vector2Subtract(Vector2Scale(Vector2One(), player->size),
@@ -619,43 +3026,30 @@ void player_update_position(Player *player, const Constants *constants) {
   player->pos = Vector2Clamp(player->pos, min_player_pos, max_player_pos);
 }
 
-// Generate a new projectile that moves towards the mouse
-Projectile projectile_generate_from_player(const Player *player, Vector2 camera_position,
-                                           const Constants *constants) {
-  Projectile projectile = {.pos = player->pos,
-                           .is_active = true,
-                           .allegiance = ALLEGIANCE_PLAYER,
-                           .speed = player->projectile_speed,
-                           .size = player->projectile_size,
-                           .colour = player->projectile_colour};
-
-  Vector2 mouse_pos = get_mouse_position_in_units_game(camera_position, constants);
-
-  // If the mouse is on the player, just fire in an arbitrary direction, otherwise fire towards the mouse
-  if (Vector2Equals(mouse_pos, player->pos))
-    projectile.dir = (Vector2){1, 0};  // Arbitrarily choose to shoot to the right
-  else
-    projectile.dir = Vector2Subtract(mouse_pos, player->pos);
-
-  projectile.dir = Vector2Normalize(projectile.dir);
-
-  return projectile;
+// Generate a new projectile that moves towards the aim position
+Projectile projectile_generate_from_player(const Player *player, Vector2 aim_pos, float time) {
+  Vector2 dir = projectile_get_aim_direction(player->pos, aim_pos);
+  return (Projectile){.spawn_pos = player->pos,
+                      .vel = Vector2Scale(dir, player->projectile_speed),
+                      .spawn_time = time,
+                      .size = player->projectile_size,
+                      .is_active = true};
 }
 
-// Spawn a new projectile when it is time to do so and if the correct button is down
-void player_try_to_fire_projectile(Player *player, ProjectileManager *projectile_manager, Vector2 camera_position,
-                                   const Constants *constants) {
-  // If the mouse button isn't held, do nothing
-  if (!IsMouseButtonDown(MOUSE_LEFT_BUTTON)) return;
+// Spawn a new projectile when it is time to do so and if the player is firing
+void player_try_to_fire_projectile(Player *player, ProjectileManager *projectile_manager, const PlayerInput *input,
+                                   float time, const Constants *constants) {
+  // If the player isn't firing, do nothing
+  if (!input->is_firing) return;
 
   // If it has not been long enough since the last shot, do nothing
-  float time_since_last_projectile = GetTime() - player->time_of_last_projectile;
+  float time_since_last_projectile = time - player->time_of_last_projectile;
   if (time_since_last_projectile < 1 / player->firerate) return;
 
-  Projectile projectile = projectile_generate_from_player(player, camera_position, constants);
-  projectile_manager_add_projectile(projectile_manager, projectile);
+  Projectile projectile = projectile_generate_from_player(player, input->aim_pos, time);
+  projectile_pool_add_projectile(projectile_manager->pools + ALLEGIANCE_PLAYER, projectile, constants);
 
-  player->time_of_last_projectile = GetTime();
+  player->time_of_last_projectile = time;
 }
 
 void player_check_for_defeat(Player *player, GameScreen game_screen) {}
@@ -669,9 +3063,9 @@ void player_check_for_defeat(Player *player, GameScreen game_screen) {}
 void enemy_manager_add_enemy(EnemyManager *enemy_manager, Enemy enemy) {
   // If the enemy manager would become full, double its capacity
   while (enemy_manager->enemy_count + 1 > enemy_manager->capacity) {
-    enemy_manager->capacity *= 2;
-    enemy_manager->enemies =
-        realloc(enemy_manager->enemies, enemy_manager->capacity * sizeof *(enemy_manager->enemies));
+    enemy_manager->stats.grow_count++;
+    enemy_manager->stats.grown_bytes += enemy_manager->capacity * sizeof *(enemy_manager->enemies);
+    enemy_manager_resize(enemy_manager, enemy_manager->capacity * 2);
   }
 
   // Loop through the enemy slots until an inactive enemy is found and replace with an enemy of the desired type
@@ -679,6 +3073,8 @@ void enemy_manager_add_enemy(EnemyManager *enemy_manager, Enemy enemy) {
     if (!enemy_manager->enemies[j].is_active) {
       enemy_manager->enemies[j] = enemy;
       enemy_manager->enemy_count++;
+      if (enemy_manager->enemy_count > enemy_manager->stats.high_water)
+        enemy_manager->stats.high_water = enemy_manager->enemy_count;
       break;
     }
 
@@ -689,53 +3085,56 @@ void enemy_manager_add_enemy(EnemyManager *enemy_manager, Enemy enemy) {
 
 // Enemy manager credits, at time t and before spending, are given by: credits = mult * t ^ exp,
 // where mult and exp are constants defined at game initialisation
-float enemy_manager_calculate_credits(const EnemyManager *enemy_manager, const Constants *constants) {
-  float t = GetTime() - enemy_manager->time_of_initialisation;
-  return constants->enemy_credit_multiplier * powf(t, constants->enemy_credit_exponent) -
+float enemy_manager_calculate_credits(const EnemyManager *enemy_manager, float time, const Constants *constants) {
+  float t = time - enemy_manager->time_of_initialisation;
+  return constants->enemy_credit_multiplier * sim_pow(t, constants->enemy_credit_exponent) -
          enemy_manager->credits_spent + constants->initial_enemy_credits;
 }
 
 // Randomly generate a starting position of an enemy. Enemies spawn in the game area but off the screen
-Vector2 get_random_enemy_start_position(float enemy_size, Vector2 camera_position, const Constants *constants) {
+Vector2 get_random_enemy_start_position(float enemy_size, Vector2 camera_position, RandomState *random,
+                                        const Constants *constants) {
   // Using a for loop here is fine as it is unlikely to run more than a couple of times
   for (;;) {
     Vector2 position = {
-        get_random_float(-constants->game_area_dimensions.x / 2, constants->game_area_dimensions.x / 2),
-        get_random_float(-constants->game_area_dimensions.y / 2, constants->game_area_dimensions.y / 2)};
+        get_random_float(random, -constants->game_area_dimensions.x / 2, constants->game_area_dimensions.x / 2),
+        get_random_float(random, -constants->game_area_dimensions.y / 2, constants->game_area_dimensions.y / 2)};
 
     if (!circle_is_on_screen(position, enemy_size, camera_position, constants)) return position;
   }
 }
 
 // Generate a new enemy with random speed and size, and zeroed position
-Enemy enemy_generate_at_origin(const EnemyType *enemy_type, const Player *player) {
+Enemy enemy_generate_at_origin(int type, const EnemyType *enemy_types, const Player *player, RandomState *random) {
+  const EnemyType *enemy_type = enemy_types + type;
+  float speed = get_random_float(random, enemy_type->min_speed, enemy_type->max_speed);
   return (Enemy){.pos = Vector2Zero(),
                  .desired_pos = player->pos,
-                 .is_active = true,
-                 .speed = get_random_float(enemy_type->min_speed, enemy_type->max_speed),
-                 .size = get_random_float(enemy_type->min_size, enemy_type->max_size),
-                 .type = enemy_type};
+                 .size = get_random_float(random, enemy_type->min_size, enemy_type->max_size),
+                 .speed = enemy_speed_to_fixed(speed),
+                 .type = type,
+                 .is_active = true};
 }
 
 // Generate a new enemy with random speed, size and offscreen position
-Enemy enemy_generate_offscreen(const EnemyType *enemy_type, const Player *player, Vector2 camera_position,
-                               const Constants *constants) {
-  Enemy enemy = enemy_generate_at_origin(enemy_type, player);
-  enemy.pos = get_random_enemy_start_position(enemy.size, camera_position, constants);
+Enemy enemy_generate_offscreen(int type, const EnemyType *enemy_types, const Player *player,
+                               Vector2 camera_position, RandomState *random, const Constants *constants) {
+  Enemy enemy = enemy_generate_at_origin(type, enemy_types, player, random);
+  enemy.pos = get_random_enemy_start_position(enemy.size, camera_position, random, constants);
 
   return enemy;
 }
 
 // Try to create and spawn a new wave of enemies (if it is time to do so)
 void enemy_manager_try_to_spawn_enemies(EnemyManager *enemy_manager, const EnemyType *enemy_types,
-                                        const Player *player, Vector2 camera_position,
-                                        const Constants *constants) {
+                                        const Player *player, Vector2 camera_position, float time,
+                                        RandomState *random, const Constants *constants) {
   // If it has not been long enough since the last enemy, do nothing
-  float time_since_last_enemy = GetTime() - enemy_manager->time_of_last_spawn;
+  float time_since_last_enemy = time - enemy_manager->time_of_last_spawn;
   if (time_since_last_enemy < enemy_manager->enemy_spawn_interval) return;
 
   // If we cannot afford the minimum wave, do nothing (i.e wait a bit longer)
-  float available_credits = enemy_manager_calculate_credits(enemy_manager, constants);
+  float available_credits = enemy_manager_calculate_credits(enemy_manager, time, constants);
   int wave_size = constants->enemy_spawn_min_wave_size;
   int wave_cost = wave_size * enemy_types[0].credit_cost;
   if (wave_cost > available_credits) return;
@@ -743,7 +3142,7 @@ void enemy_manager_try_to_spawn_enemies(EnemyManager *enemy_manager, const Enemy
   // Keep trying to increase the wave size until either we fail the probability check or we cannot afford the
   // wave
   while (wave_cost + enemy_types[0].credit_cost <= available_credits &&
-         get_random_float(0, 1) <= constants->enemy_spawn_additional_enemy_chance) {
+         get_random_float(random, 0, 1) <= constants->enemy_spawn_additional_enemy_chance) {
     wave_size++;
     wave_cost += enemy_types[0].credit_cost;
   };
@@ -758,233 +3157,1739 @@ void enemy_manager_try_to_spawn_enemies(EnemyManager *enemy_manager, const Enemy
   bool upgrade_instead_of_add = true;                       // First iteration should upgrade the enemies
   float cheapest_action_cost = enemy_types[0].credit_cost;  // Assume the cheapest action is adding a type 0 enemy
 
-  // While it is possible to increase the strength of the wave, continue to do so
-  while (wave_cost < available_credits - cheapest_action_cost) {
-    // Upgrade existing enemies
-    if (upgrade_instead_of_add) {
-      // Try to upgrade each enemy in the wave
-      for (int i = 0; i < wave_size; i++) {
-        int this_enemy_type = wave_enemy_types[i];
+  // While it is possible to increase the strength of the wave, continue to do so
+  while (wave_cost < available_credits - cheapest_action_cost) {
+    // Upgrade existing enemies
+    if (upgrade_instead_of_add) {
+      // Try to upgrade each enemy in the wave
+      for (int i = 0; i < wave_size; i++) {
+        int this_enemy_type = wave_enemy_types[i];
+
+        // If this enemy is already of the strongest type, don't try to upgrade it
+        if (this_enemy_type == constants->num_enemy_types - 1) continue;
+
+        int this_enemy_new_type = get_random_int(random, this_enemy_type + 1, constants->num_enemy_types - 1);
+
+        // If upgrading this enemy to this type would be too expensive, don't upgrade it
+        float cost_increase =
+            enemy_types[this_enemy_new_type].credit_cost - enemy_types[this_enemy_type].credit_cost;
+        if (wave_cost + cost_increase > available_credits) continue;
+
+        // Otherwise, upgrade the enemy
+        wave_enemy_types[i] = this_enemy_new_type;
+        wave_cost += cost_increase;
+      }
+    } else {  // Add more enemies
+      int prev_wave_size = wave_size;
+
+      // Add enemies in the same way as before, but now guarentee one additional enemy
+      do {
+        wave_size++;
+        wave_cost += enemy_types[0].credit_cost;
+      } while (wave_cost + enemy_types[0].credit_cost <= available_credits &&
+               get_random_float(random, 0, 1) <= constants->enemy_spawn_additional_enemy_chance);
+
+      // Ensure that adding a type 0 enemy was in fact the cheapest action
+      assert((wave_cost <= available_credits) && "Enemies added to wave exceeded credits");
+
+      // Increase wave array size and ensure the new enemies are of type 0
+      wave_enemy_types = realloc(wave_enemy_types, wave_size * sizeof *wave_enemy_types);
+      if (!wave_enemy_types) {
+        fprintf(stderr, "Error reallocating wave enemy types memory.\n");
+        exit(EXIT_FAILURE);
+      }
+      memset(wave_enemy_types + prev_wave_size, 0, (wave_size - prev_wave_size) * sizeof *wave_enemy_types);
+    }
+    // Further iterations randomly choose to either upgrade the current enemies or add more
+    upgrade_instead_of_add = get_random_int(random, 0, 1);
+  }
+
+  // Add the enemies from the wave to the enemy manager
+  for (int i = 0; i < wave_size; i++) {
+    Enemy this_enemy =
+        enemy_generate_offscreen(wave_enemy_types[i], enemy_types, player, camera_position, random, constants);
+    enemy_manager_add_enemy(enemy_manager, this_enemy);
+  }
+
+  enemy_manager->credits_spent += wave_cost;
+  free(wave_enemy_types);
+  wave_enemy_types = NULL;
+
+  // Reset the enemy timer and generate a new interval length
+  enemy_manager->time_of_last_spawn = time;
+  enemy_manager->enemy_spawn_interval =
+      get_random_float(random, constants->enemy_spawn_interval_min, constants->enemy_spawn_interval_max);
+}
+
+// Update the enemies so that they move towards the player (when it is time to do so and with probability)
+void enemy_manager_update_desired_positions(EnemyManager *enemy_manager, const Player *player, float time,
+                                            RandomState *random, const Constants *constants) {
+  // If it is not time to update the enemies, do nothing
+  float time_since_last_update = time - enemy_manager->time_of_last_update;
+  if (time_since_last_update < constants->enemy_update_interval) return;
+
+  enemy_manager->time_of_last_update = time;
+
+  // Otherwise, iterate through the enemies and (sometimes) update their desired positions
+  for (int i = 0; i < enemy_manager->capacity; i++) {
+    Enemy *this_enemy = enemy_manager->enemies + i;
+    if (!this_enemy->is_active) continue;
+
+    float r_num = get_random_float(random, 0, 1);
+    if (r_num <= constants->enemy_update_chance) {
+      this_enemy->desired_pos = player->pos;  // Enemy will now move towards the current position of the player
+    }
+  }
+}
+
+// Update the positions of active enemies and check for collisions with the player.
+//
+// Only enemies near the player matter for gameplay, so enemies further than enemy_lod_radius away move once every
+// enemy_lod_interval updates instead, in one step covering all of those updates, and aren't tested against the
+// player (which they can't reach before their next move). Each enemy gets a turn every enemy_lod_interval updates,
+// staggered by index so the distant moves are spread evenly, and only switches between moving every update and
+// moving on its turns at its turn, so every update's movement is made exactly once
+void enemy_manager_update_enemy_positions(EnemyManager *enemy_manager, Player *player, float frame_time,
+                                          const Constants *constants) {
+  int lod_interval = constants->enemy_lod_interval > 1 ? constants->enemy_lod_interval : 1;
+  int turn = enemy_manager->num_moves++ % lod_interval;
+
+  for (int i = 0, enemies_counted = 0; i < enemy_manager->capacity && enemies_counted < enemy_manager->enemy_count;
+       i++) {
+    Enemy *this_enemy = enemy_manager->enemies + i;
+    if (!this_enemy->is_active) continue;
+
+    enemies_counted++;  // Keep track of enemies processed so we can exit the loop early
+
+    bool is_turn = i % lod_interval == turn;
+    if (is_turn) {
+      this_enemy->is_far =
+          lod_interval > 1 && !sim_circles_collide(this_enemy->pos, constants->enemy_lod_radius, player->pos, 0);
+    }
+    if (this_enemy->is_far && !is_turn) continue;
+
+    // Move the enemy towards its desired position according to its speed
+    Vector2 normalised_move_direction = sim_normalise(Vector2Subtract(this_enemy->desired_pos, this_enemy->pos));
+    float move_time = this_enemy->is_far ? frame_time * lod_interval : frame_time;
+    float move_distance = enemy_get_speed(this_enemy) * move_time;
+    this_enemy->pos = Vector2Add(this_enemy->pos, Vector2Scale(normalised_move_direction, move_distance));
+    if (this_enemy->is_far) continue;
+
+    // Check for the enemy colliding with the player
+    if (sim_circles_collide(this_enemy->pos, this_enemy->size, player->pos, player->size)) {
+      // Delete the enemy (not strictly necessary at the moment)
+      this_enemy->is_active = false;
+      enemy_manager->enemy_count--;
+
+      player->is_defeated = true;
+    }
+  }
+}
+
+// If it is time to do so, spawn the boss
+void boss_try_to_spawn(Boss *boss, const BossType *boss_types, const Player *player, Vector2 camera_position,
+                       float time, RandomState *random, const Constants *constants) {
+  if (boss->is_active) return;
+  if (player->score < boss->score_for_next_spawn) return;
+
+  const BossType *boss_type = boss_types + boss->type;
+  boss->pos = get_random_enemy_start_position(boss_type->size, camera_position, random, constants);
+  boss->desired_pos = player->pos;
+  boss->is_active = true;
+  boss->health = boss_type->max_health;
+  boss->time_of_last_projectile = time;
+}
+
+// If it is time to do so, change the boss between moving and being stationary
+void boss_try_to_switch_states(Boss *boss, const BossType *boss_types, const Player *player, float time) {
+  if (!boss->is_active) return;
+
+  const BossType *boss_type = boss_types + boss->type;
+  if (boss->state == BOSS_STATE_MOVING && time - boss->time_of_last_state_switch >= boss_type->moving_duration) {
+    boss->state = BOSS_STATE_STATIONARY;
+    boss->time_of_last_state_switch = time;
+    boss->shots_left_in_burst = boss_type->shots_per_burst;
+    boss->time_of_last_projectile = time;
+  }
+
+  if (boss->state == BOSS_STATE_STATIONARY &&
+      time - boss->time_of_last_state_switch >= boss_type->stationary_duration) {
+    boss->state = BOSS_STATE_MOVING;
+    boss->time_of_last_state_switch = time;
+    boss->desired_pos = player->pos;
+  }
+}
+
+// If the boss is moving, update its position
+void boss_update_position(Boss *boss, const BossType *boss_types, Player *player, float frame_time) {
+  if (!boss->is_active) return;
+
+  // Check for the boss colliding with the player (even if the boss is stationary)
+  const BossType *boss_type = boss_types + boss->type;
+  if (sim_circles_collide(boss->pos, boss_type->size, player->pos, player->size)) {
+    boss->is_active = false;  // Deactivate the boss (not strictly necessary at the moment)
+    player->is_defeated = true;
+  }
+
+  if (boss->state != BOSS_STATE_MOVING) return;
+
+  Vector2 normalised_move_direction = sim_normalise(Vector2Subtract(boss->desired_pos, boss->pos));
+  boss->pos = Vector2Add(boss->pos, Vector2Scale(normalised_move_direction, boss_type->speed * frame_time));
+}
+
+// Generate a new boss projectile that moves towards the player
+Projectile projectile_generate_from_boss(const Boss *boss, const BossType *boss_types, const Player *player,
+                                         float time) {
+  // Spawn the projectile at the edge of the boss
+  const BossType *boss_type = boss_types + boss->type;
+  Vector2 boss_to_player_norm = sim_normalise(Vector2Subtract(player->pos, boss->pos));
+  Vector2 position =
+      Vector2Add(boss->pos, Vector2Scale(boss_to_player_norm, boss_type->size - boss_type->projectile_size));
+
+  return (Projectile){.spawn_pos = position,
+                      .vel = Vector2Scale(boss_to_player_norm, boss_type->projectile_speed),
+                      .spawn_time = time,
+                      .size = boss_type->projectile_size,
+                      .is_active = true};
+}
+
+// If it is time to do so, fire projectiles at the player
+void boss_try_to_fire_projectile(Boss *boss, const BossType *boss_types, ProjectileManager *projectile_manager,
+                                 const Player *player, float time, const Constants *constants) {
+  // Note we can still fire while moving
+  if (!boss->is_active) return;
+  if (boss->shots_left_in_burst <= 0) return;
+  if (time - boss->time_of_last_projectile <= 1 / boss_types[boss->type].firerate) return;
+
+  projectile_pool_add_projectile(projectile_manager->pools + ALLEGIANCE_ENEMIES,
+                                 projectile_generate_from_boss(boss, boss_types, player, time), constants);
+  boss->time_of_last_projectile = time;
+  boss->shots_left_in_burst--;
+}
+
+// If the boss is defeated, perform death actions
+void boss_check_for_defeat(Boss *boss, const BossType *boss_types, Player *player, EnemyManager *enemy_manager,
+                           const EnemyType *enemy_types, RandomState *random, GameEventBuffer *events) {
+  if (!boss->is_defeated) return;
+
+  const BossType *boss_type = boss_types + boss->type;
+  game_event_buffer_push(events, (GameEvent){.type = GAME_EVENT_BOSS_DEFEATED,
+                                             .object_type = boss->type,
+                                             .pos = boss->pos,
+                                             .radius = boss_type->size});
+  boss->is_defeated = false;
+  boss->is_active = false;
+  player->score += boss_type->score_on_defeat;
+  player->boss_points += boss_type->boss_points_on_defeat;
+  // Successive bosses take twice as many points to spawn (starting from when the previous boss is defeated)
+  boss->score_for_next_spawn = 2 * boss_type->initial_score_to_spawn + player->score;
+
+  for (int i = 0; i < boss_type->num_enemies_spawned_on_defeat; i++) {
+    Enemy enemy = enemy_generate_at_origin(boss_type->enemy_type_spawned_on_defeat, enemy_types, player, random);
+
+    // Position the enemy uniformly at random inside the boss
+    float max_radius = boss_type->size - enemy.size;
+    assert((max_radius > 0) && "Boss should not be smaller than spawned enemies");
+    float radius = sim_sqrt(get_random_float(random, 0, max_radius * max_radius));  // Sqrt makes it uniform
+    Vector2 direction = sim_unit_vector(get_random_float(random, 0, 1));
+    enemy.pos = Vector2Add(boss->pos, Vector2Scale(direction, radius));
+
+    enemy_manager_add_enemy(enemy_manager, enemy);
+  }
+}
+
+/*---------------------------------------------------------------------------------------------------------------*/
+
+/*---------------------*/
+/* Camera calculations */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+// Update the position of the camera (following the player without showing out of bounds area)
+void camera_update_position(Vector2 *camera_position, const Player *player, const Constants *constants) {
+  Vector2 minimum_position =
+      Vector2Scale(Vector2Subtract(constants->screen_dimensions, constants->game_area_dimensions), 0.5);
+  Vector2 maximum_position = Vector2Negate(minimum_position);
+  Vector2 offset_amount = Vector2Scale(constants->screen_dimensions, 0.5);
+  *camera_position = Vector2Subtract(Vector2Clamp(player->pos, minimum_position, maximum_position), offset_amount);
+}
+
+/*-------------*/
+/* Game update */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+// Advance the game by one update of `frame_time` seconds. The game and any headless runners drive the simulation
+// through this, so they play out identically given the same seed, inputs and frame times. What happened during
+// the update is left in `events`, for the caller to drive anything else (e.g. particles) from. Collisions are
+// found on `collision_workers` as well as the calling thread if it isn't NULL, with the same results
+void game_state_update(GameState *game_state, const PlayerInput *input, float frame_time,
+                       const EnemyType *enemy_types, const BossType *boss_types, GameEventBuffer *events,
+                       CollisionWorkers *collision_workers, const Constants *constants) {
+  Player *player = &game_state->player;
+  EnemyManager *enemy_manager = &game_state->enemy_manager;
+  ProjectileManager *projectile_manager = &game_state->projectile_manager;
+  Boss *boss = &game_state->boss;
+  Vector2 *camera_position = &game_state->camera_position;
+  RandomState *random = &game_state->random;
+
+  game_state->time += frame_time;
+  float time = game_state->time;
+  game_event_buffer_clear(events);
+
+  player_update_position(player, input, frame_time, constants);
+  camera_update_position(camera_position, player, constants);
+  player_try_to_fire_projectile(player, projectile_manager, input, time, constants);
+
+  enemy_manager_try_to_spawn_enemies(enemy_manager, enemy_types, player, *camera_position, time, random,
+                                     constants);
+  enemy_manager_update_desired_positions(enemy_manager, player, time, random, constants);
+  enemy_manager_update_enemy_positions(enemy_manager, player, frame_time, constants);
+
+  boss_try_to_spawn(boss, boss_types, player, *camera_position, time, random, constants);
+  boss_try_to_switch_states(boss, boss_types, player, time);
+  boss_update_position(boss, boss_types, player, frame_time);
+  boss_try_to_fire_projectile(boss, boss_types, projectile_manager, player, time, constants);
+
+  projectile_manager_detect_collisions(projectile_manager, enemy_manager, player, boss, boss_types, time,
+                                       collision_workers, events);
+  game_events_resolve_hits(events, projectile_manager, enemy_manager, player, boss, enemy_types, boss_types, time,
+                           random);
+  game_events_apply_scores(events, player);
+  projectile_manager_expire_projectiles(projectile_manager, time);
+
+  boss_check_for_defeat(boss, boss_types, player, enemy_manager, enemy_types, random, events);
+}
+
+// Apply an update's debug actions (see UpdateInput) to the game
+void game_state_apply_debug_actions(GameState *game_state, const UpdateInput *input) {
+  if (input->toggle_invincibility) game_state->player.is_invincible = !game_state->player.is_invincible;
+  game_state->player.score += 50 * input->num_score_bonuses;
+}
+
+// Run one game screen update with `input`: apply its debug actions and late aim, update the game, and undo the
+// player's defeat if they are invincible. The simulation thread and replays both update the game through this, so
+// that replays play out exactly as the game did
+void game_state_play_update(GameState *game_state, const UpdateInput *input, float frame_time,
+                            const EnemyType *enemy_types, const BossType *boss_types, GameEventBuffer *events,
+                            const Constants *constants) {
+  Player *player = &game_state->player;
+  game_state_apply_debug_actions(game_state, input);
+  projectile_pool_apply_late_aim(game_state->projectile_manager.pools + ALLEGIANCE_PLAYER, input->late_aim_pos,
+                                 input->late_aim_spawned_after, input->late_aim_spawned_before,
+                                 player->projectile_speed, constants);
+
+  PlayerInput player_input = {
+      .move_direction = input->move_direction, .aim_pos = input->aim_pos, .is_firing = input->is_firing};
+  game_state_update(game_state, &player_input, frame_time, enemy_types, boss_types, events, NULL, constants);
+  player_check_for_defeat(player, GAME_SCREEN_GAME);
+  if (player->is_defeated && player->is_invincible) player->is_defeated = false;
+}
+/*---------------------------------------------------------------------------------------------------------------*/
+
+/*---------*/
+/* Replays */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+void replay_writer_write(ReplayWriter *writer, const void *data, size_t size) {
+  if (fwrite(data, 1, size, writer->file) != size) writer->has_failed = true;
+  writer->size += size;
+}
+
+// Keep a copy of the content pack at `path` to embed in the replays recorded from now on. Called whenever the game
+// loads the pack. Returns false (keeping the old copy) if it cannot be read
+bool replay_writer_set_content(ReplayWriter *writer, const char *path) {
+  size_t size;
+  const unsigned char *data = map_file(path, "content pack", &size);
+  if (!data) return false;
+
+  writer->content_pack = realloc(writer->content_pack, size);
+  if (!writer->content_pack) {
+    fprintf(stderr, "Unable to allocate replay storage.\n");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(writer->content_pack, data, size);
+  writer->content_pack_size = size;
+  unmap_file(data, size);
+  return true;
+}
+
+// Start recording the game to a replay at `path`, from its next update
+void replay_writer_start(ReplayWriter *writer, const char *path, const Constants *constants) {
+  writer->file = fopen(path, "wb");
+  if (!writer->file) {
+    fprintf(stderr, "Unable to open replay %s.\n", path);
+    return;
+  }
+  writer->path = path;
+  writer->size = 0;
+  writer->has_failed = false;
+  writer->num_keyframes = 0;
+  writer->num_ticks = 0;
+  writer->ticks_since_keyframe = 0;
+  writer->has_jumped = false;
+  writer->keyframe_interval = fmaxf(1, roundf(constants->replay_keyframe_interval * constants->simulation_rate));
+
+  ReplayHeader header = {.magic = REPLAY_MAGIC,
+                         .version = REPLAY_VERSION,
+                         .simulation_rate = constants->simulation_rate,
+                         .screen_dimensions = {constants->screen_dimensions.x, constants->screen_dimensions.y},
+                         .sim_fixed_point = SIM_FIXED_POINT,
+                         .content_pack_size = writer->content_pack_size};
+  replay_writer_write(writer, &header, sizeof header);
+  replay_writer_write(writer, writer->content_pack, writer->content_pack_size);
+}
+
+// Note that the game jumped (e.g. it was rewound), so the updates recorded so far don't lead to its current state
+void replay_writer_jump(ReplayWriter *writer) {
+  writer->has_jumped = true;
+}
+
+// Record an update about to be run with `input`. A keyframe of the game is recorded before it if one is due
+void replay_writer_record(ReplayWriter *writer, const GameState *game_state, const UpdateInput *input) {
+  if (!writer->file) return;
+
+  if (writer->num_ticks == 0 || writer->has_jumped || writer->ticks_since_keyframe >= writer->keyframe_interval) {
+    size_t keyframe_size = game_state_serialised_size(game_state);
+    if (writer->keyframe_capacity < keyframe_size) {
+      writer->keyframe = realloc(writer->keyframe, keyframe_size);
+      writer->keyframe_capacity = keyframe_size;
+    }
+    if (writer->index_capacity == writer->num_keyframes) {
+      writer->index_capacity = writer->index_capacity ? 2 * writer->index_capacity : 64;
+      writer->index = realloc(writer->index, writer->index_capacity * sizeof *(writer->index));
+    }
+    if (!writer->keyframe || !writer->index) {
+      fprintf(stderr, "Unable to allocate replay storage.\n");
+      exit(EXIT_FAILURE);
+    }
+    game_state_serialise(game_state, writer->keyframe);
+    writer->index[writer->num_keyframes++] = (ReplayIndexEntry){.offset = writer->size, .tick = writer->num_ticks};
+
+    unsigned char kind = writer->has_jumped ? REPLAY_RECORD_JUMP : REPLAY_RECORD_KEYFRAME;
+    uint32_t keyframe_size_field = keyframe_size;
+    replay_writer_write(writer, &kind, 1);
+    replay_writer_write(writer, &keyframe_size_field, sizeof keyframe_size_field);
+    replay_writer_write(writer, writer->keyframe, keyframe_size);
+    writer->ticks_since_keyframe = 0;
+    writer->has_jumped = false;
+  }
+
+  unsigned char kind = REPLAY_RECORD_INPUT;
+  replay_writer_write(writer, &kind, 1);
+  replay_writer_write(writer, input, sizeof *input);
+  writer->num_ticks++;
+  writer->ticks_since_keyframe++;
+}
+
+// Finish the replay being recorded (if any) by writing its keyframe index and footer, and close it
+void replay_writer_finish(ReplayWriter *writer) {
+  if (!writer->file) return;
+
+  ReplayFooter footer = {.index_offset = writer->size,
+                         .num_keyframes = writer->num_keyframes,
+                         .num_ticks = writer->num_ticks,
+                         .magic = REPLAY_MAGIC};
+  replay_writer_write(writer, writer->index, writer->num_keyframes * sizeof *(writer->index));
+  replay_writer_write(writer, &footer, sizeof footer);
+  if (fclose(writer->file) != 0) writer->has_failed = true;
+  writer->file = NULL;
+  if (writer->has_failed) fprintf(stderr, "Unable to write replay %s.\n", writer->path);
+}
+
+// Finish any replay being recorded and free the writer's storage
+void replay_writer_cleanup(ReplayWriter *writer) {
+  replay_writer_finish(writer);
+  free(writer->content_pack);
+  free(writer->keyframe);
+  free(writer->index);
+  *writer = (ReplayWriter){0};
+}
+
+// Map the replay at `path` into memory and check that it is complete, ready to seek. Returns false (after printing
+// the reason) if it cannot be played
+bool replay_open(Replay *replay, const char *path) {
+  *replay = (Replay){0};
+  replay->data = map_file(path, "replay", &replay->size);
+  if (!replay->data) return false;
+
+  ReplayHeader *header = &replay->header;
+  ReplayFooter *footer = &replay->footer;
+  bool valid = replay->size >= sizeof *header + sizeof *footer;
+  if (valid) {
+    memcpy(header, replay->data, sizeof *header);
+    memcpy(footer, replay->data + replay->size - sizeof *footer, sizeof *footer);
+  }
+  valid = valid && header->magic == REPLAY_MAGIC && footer->magic == REPLAY_MAGIC;
+  if (valid && header->version != REPLAY_VERSION) {
+    fprintf(stderr, "Replay %s has version %u but version %d is required.\n", path, header->version,
+            REPLAY_VERSION);
+    unmap_file(replay->data, replay->size);
+    return false;
+  }
+
+  // The index must fit between the records and the footer, and start with a keyframe before the first update
+  size_t records_start = sizeof *header + header->content_pack_size;
+  size_t index_size = (size_t)footer->num_keyframes * sizeof(ReplayIndexEntry);
+  valid = valid && footer->num_keyframes > 0 && records_start <= footer->index_offset &&
+          footer->index_offset <= replay->size - sizeof *footer &&
+          replay->size - sizeof *footer - footer->index_offset == index_size;
+  if (valid) {
+    ReplayIndexEntry first;
+    memcpy(&first, replay->data + footer->index_offset, sizeof first);
+    valid = first.tick == 0 && first.offset == records_start;
+  }
+  if (!valid) {
+    fprintf(stderr, "Replay %s is incomplete or not a replay.\n", path);
+    unmap_file(replay->data, replay->size);
+    return false;
+  }
+  if (!content_pack_validate(replay->data + sizeof *header, header->content_pack_size)) {
+    unmap_file(replay->data, replay->size);
+    return false;
+  }
+
+  replay->position = records_start;
+  return true;
+}
+
+void replay_close(Replay *replay) {
+  unmap_file(replay->data, replay->size);
+  *replay = (Replay){0};
+}
+
+// Load the content the replay was recorded with into the game's constants and types, along with the recording's
+// other constants which the simulation depends on. The player's stats are in the keyframes
+void replay_load_content(const Replay *replay, GameColours *game_colours, Constants *constants,
+                         EnemyType *enemy_types, BossType *boss_types) {
+  Upgrade upgrades[PACK_NUM_UPGRADE_STATS] = {0};
+  Shop shop = {.upgrades = upgrades, .num_upgrades = PACK_NUM_UPGRADE_STATS};
+  Player player = {0};
+  content_pack_apply(replay->data + sizeof replay->header, game_colours, constants, enemy_types, boss_types, &shop,
+                     &player, false);
+  constants->simulation_rate = replay->header.simulation_rate;
+  const float *screen_dimensions = replay->header.screen_dimensions;
+  constants->screen_dimensions = (Vector2){screen_dimensions[0], screen_dimensions[1]};
+}
+
+// Load the keyframe record at the replay's position into the game. If `num_mismatches` isn't NULL, and the
+// keyframe is one the updates before it lead to, the game is first compared with it, and counted as a mismatch if
+// it differs. Returns false if there is no keyframe at the position, or it is malformed
+bool replay_load_keyframe(Replay *replay, GameState *game_state, int *num_mismatches) {
+  size_t end = replay->footer.index_offset;
+  size_t position = replay->position;
+  uint32_t size;
+  if (end - position < 1 + sizeof size) return false;
+
+  ReplayRecordKind kind = replay->data[position++];
+  if (kind != REPLAY_RECORD_KEYFRAME && kind != REPLAY_RECORD_JUMP) return false;
+  memcpy(&size, replay->data + position, sizeof size);
+  position += sizeof size;
+
+  // The keyframe's size must match the storage capacities in its game state
+  GameState keyframe_state;
+  if (end - position < size || size < sizeof keyframe_state) return false;
+  memcpy(&keyframe_state, replay->data + position, sizeof keyframe_state);
+  if (game_state_serialised_size(&keyframe_state) != size) return false;
+
+  if (num_mismatches && kind == REPLAY_RECORD_KEYFRAME && replay->tick > 0) {
+    unsigned char *current = malloc(size);
+    if (!current) {
+      fprintf(stderr, "Unable to allocate replay storage.\n");
+      exit(EXIT_FAILURE);
+    }
+    if (game_state_serialised_size(game_state) != size) {
+      (*num_mismatches)++;
+    } else {
+      game_state_serialise(game_state, current);
+      if (memcmp(current, replay->data + position, size) != 0) (*num_mismatches)++;
+    }
+    free(current);
+  }
+
+  game_state_deserialise(game_state, replay->data + position);
+  replay->position = position + size;
+  return true;
+}
+
+// Play the replay's next update on the game, loading any keyframes on the way (see replay_load_keyframe for
+// `num_mismatches`). Returns false at the end of the replay, or if it is malformed
+bool replay_play_tick(Replay *replay, GameState *game_state, GameEventBuffer *events, const EnemyType *enemy_types,
+                      const BossType *boss_types, const Constants *constants, int *num_mismatches) {
+  size_t end = replay->footer.index_offset;
+  while (replay->position < end && replay->data[replay->position] != REPLAY_RECORD_INPUT) {
+    if (!replay_load_keyframe(replay, game_state, num_mismatches)) return false;
+  }
+
+  UpdateInput input;
+  if (end - replay->position < 1 + sizeof input) return false;
+  memcpy(&input, replay->data + replay->position + 1, sizeof input);
+  replay->position += 1 + sizeof input;
+
+  game_state_play_update(game_state, &input, 1 / constants->simulation_rate, enemy_types, boss_types, events,
+                         constants);
+  replay->tick++;
+  return true;
+}
+
+// Jump to just before update `tick` (up to the number of updates in the replay) by loading the last keyframe at or
+// before it, then playing the updates in between, of which there are fewer than the keyframe interval. Returns
+// false if the replay doesn't reach the update
+bool replay_seek(Replay *replay, uint32_t tick, GameState *game_state, GameEventBuffer *events,
+                 const EnemyType *enemy_types, const BossType *boss_types, const Constants *constants) {
+  if (tick > replay->footer.num_ticks) return false;
+
+  // Binary search for the last keyframe at or before the update. The first is always at update 0
+  uint32_t low = 0;
+  uint32_t high = replay->footer.num_keyframes;
+  ReplayIndexEntry entry;
+  while (high - low > 1) {
+    uint32_t middle = low + (high - low) / 2;
+    memcpy(&entry, replay->data + replay->footer.index_offset + middle * sizeof entry, sizeof entry);
+    if (entry.tick <= tick)
+      low = middle;
+    else
+      high = middle;
+  }
+  memcpy(&entry, replay->data + replay->footer.index_offset + low * sizeof entry, sizeof entry);
+  if (entry.offset >= replay->footer.index_offset) return false;
+
+  replay->position = entry.offset;
+  replay->tick = entry.tick;
+  if (!replay_load_keyframe(replay, game_state, NULL)) return false;
+  while (replay->tick < tick) {
+    if (!replay_play_tick(replay, game_state, events, enemy_types, boss_types, constants, NULL)) return false;
+  }
+  return true;
+}
+/*---------------------------------------------------------------------------------------------------------------*/
+
+/*--------------*/
+/* Spatial grid */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+// Get the column of the grid containing an x coordinate, clamped to the grid
+int spatial_grid_get_column(const SpatialGrid *grid, float x, const Constants *constants) {
+  float column = (x + constants->game_area_dimensions.x / 2) / SPATIAL_GRID_CELL_SIZE;
+  if (!(column >= 0)) return 0;  // Also catches NaN
+  return column < grid->columns ? (int)column : grid->columns - 1;
+}
+
+// Get the row of the grid containing a y coordinate, clamped to the grid
+int spatial_grid_get_row(const SpatialGrid *grid, float y, const Constants *constants) {
+  float row = (y + constants->game_area_dimensions.y / 2) / SPATIAL_GRID_CELL_SIZE;
+  if (!(row >= 0)) return 0;
+  return row < grid->rows ? (int)row : grid->rows - 1;
+}
+
+// Empty the grid, ready for entities to be inserted, resizing it to the game area
+void spatial_grid_clear(SpatialGrid *grid, const Constants *constants) {
+  grid->columns = ceilf(constants->game_area_dimensions.x / SPATIAL_GRID_CELL_SIZE);
+  grid->rows = ceilf(constants->game_area_dimensions.y / SPATIAL_GRID_CELL_SIZE);
+  grid->max_radius = 0;
+  grid->num_entries = 0;
+
+  int num_cells = grid->columns * grid->rows;
+  if (num_cells + 1 > grid->cell_capacity) {
+    grid->cell_starts = realloc(grid->cell_starts, (num_cells + 1) * sizeof *(grid->cell_starts));
+    if (!grid->cell_starts) {
+      fprintf(stderr, "Unable to allocate spatial grid storage.\n");
+      exit(EXIT_FAILURE);
+    }
+    grid->cell_capacity = num_cells + 1;
+  }
+}
+
+// Add an entity to the grid. It can't be found by queries until spatial_grid_finish is called
+void spatial_grid_insert(SpatialGrid *grid, int index, Vector2 pos, float radius, const Constants *constants) {
+  if (grid->num_entries == grid->entry_capacity) {
+    grid->entry_capacity = grid->entry_capacity ? grid->entry_capacity * 2 : 64;
+    grid->entries = realloc(grid->entries, grid->entry_capacity * sizeof *(grid->entries));
+    grid->entry_cells = realloc(grid->entry_cells, grid->entry_capacity * sizeof *(grid->entry_cells));
+    grid->entry_indices = realloc(grid->entry_indices, grid->entry_capacity * sizeof *(grid->entry_indices));
+    if (!grid->entries || !grid->entry_cells || !grid->entry_indices) {
+      fprintf(stderr, "Unable to allocate spatial grid storage.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  int column = spatial_grid_get_column(grid, pos.x, constants);
+  int row = spatial_grid_get_row(grid, pos.y, constants);
+  grid->entry_cells[grid->num_entries] = row * grid->columns + column;
+  grid->entry_indices[grid->num_entries] = index;
+  grid->num_entries++;
+
+  if (radius > grid->max_radius) grid->max_radius = radius;
+}
+
+// Group the inserted entities by cell (a counting sort, so it takes linear time and keeps the insertion order)
+void spatial_grid_finish(SpatialGrid *grid) {
+  int num_cells = grid->columns * grid->rows;
+  memset(grid->cell_starts, 0, (num_cells + 1) * sizeof *(grid->cell_starts));
+
+  // Count the entities in each cell, then turn the counts into the end of each cell
+  for (int i = 0; i < grid->num_entries; i++) grid->cell_starts[grid->entry_cells[i] + 1]++;
+  for (int cell = 1; cell <= num_cells; cell++) grid->cell_starts[cell] += grid->cell_starts[cell - 1];
+
+  // Place each entity at its cell's start, moving the start along. Afterwards each start is the next cell's start
+  for (int i = 0; i < grid->num_entries; i++) {
+    grid->entries[grid->cell_starts[grid->entry_cells[i]]++] = grid->entry_indices[i];
+  }
+  memmove(grid->cell_starts + 1, grid->cell_starts, num_cells * sizeof *(grid->cell_starts));
+  grid->cell_starts[0] = 0;
+}
+
+// Get the rows and columns of the cells which could hold entities overlapping the rectangle from `min` to `max`.
+// Returns false if the grid is empty. Within a row, the entities of a run of cells are contiguous in `entries`
+bool spatial_grid_get_cell_range(const SpatialGrid *grid, Vector2 min, Vector2 max, int *min_column, int *min_row,
+                                 int *max_column, int *max_row, const Constants *constants) {
+  if (grid->num_entries == 0) return false;
+
+  *min_column = spatial_grid_get_column(grid, min.x - grid->max_radius, constants);
+  *max_column = spatial_grid_get_column(grid, max.x + grid->max_radius, constants);
+  *min_row = spatial_grid_get_row(grid, min.y - grid->max_radius, constants);
+  *max_row = spatial_grid_get_row(grid, max.y + grid->max_radius, constants);
+  return true;
+}
+
+// Free the grid's storage
+void spatial_grid_cleanup(SpatialGrid *grid) {
+  free(grid->cell_starts);
+  free(grid->entries);
+  free(grid->entry_cells);
+  free(grid->entry_indices);
+  *grid = (SpatialGrid){0};
+}
+/*---------------------------------------------------------------------------------------------------------------*/
+
+/*----------------------*/
+/* Frame time recording */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+// Get the histogram bucket for a duration. Durations below FRAME_TIME_SUB_BUCKETS get a bucket each, and above
+// that each power of two is split into FRAME_TIME_SUB_BUCKETS buckets by the bits after the top one
+int frame_time_get_bucket(uint32_t microseconds) {
+  if (microseconds < FRAME_TIME_SUB_BUCKETS) return microseconds;
+
+  int shift = 31 - __builtin_clz(microseconds) - FRAME_TIME_SUB_BUCKET_BITS;
+  return (shift + 1) * FRAME_TIME_SUB_BUCKETS + ((microseconds >> shift) & (FRAME_TIME_SUB_BUCKETS - 1));
+}
+
+// Get the longest duration that falls in a histogram bucket
+uint32_t frame_time_get_bucket_limit(int bucket) {
+  if (bucket < FRAME_TIME_SUB_BUCKETS) return bucket;
+
+  int shift = bucket / FRAME_TIME_SUB_BUCKETS - 1;
+  uint32_t lowest = (uint32_t)(FRAME_TIME_SUB_BUCKETS + bucket % FRAME_TIME_SUB_BUCKETS) << shift;
+  return lowest + ((1u << shift) - 1);
+}
+
+// Record a duration (in seconds, as measured with GetTime)
+void frame_time_histogram_record(FrameTimeHistogram *histogram, double seconds) {
+  double microseconds = seconds * 1e6;
+  uint32_t value = microseconds <= 0 ? 0 : microseconds >= UINT32_MAX ? UINT32_MAX : (uint32_t)microseconds;
+
+  histogram->counts[frame_time_get_bucket(value)]++;
+  histogram->count++;
+  histogram->sum += value;
+  if (value > histogram->max) histogram->max = value;
+}
+
+// Summarise a histogram in a single pass over its buckets. Percentiles are the longest duration in the bucket they
+// fall in, so they are never understated
+FrameTimeSummary frame_time_histogram_summarise(const FrameTimeHistogram *histogram) {
+  FrameTimeSummary summary = {.count = histogram->count};
+  if (histogram->count == 0) return summary;
+
+  uint64_t targets[3] = {histogram->count * 50ull, histogram->count * 95ull, histogram->count * 99ull};
+  float *percentiles[3] = {&summary.p50, &summary.p95, &summary.p99};
+  int next = 0;  // Index of the next percentile to find
+
+  uint64_t cumulative_count = 0;
+  for (int i = 0; i < FRAME_TIME_NUM_BUCKETS && next < 3; i++) {
+    cumulative_count += histogram->counts[i];
+    while (next < 3 && cumulative_count * 100 >= targets[next]) {
+      uint32_t limit = frame_time_get_bucket_limit(i);
+      *percentiles[next++] = (limit < histogram->max ? limit : histogram->max) / 1000.0f;
+    }
+  }
+
+  summary.mean = histogram->sum / (histogram->count * 1000.0f);
+  summary.max = histogram->max / 1000.0f;
+  return summary;
+}
+
+// Append a line summarising one game's update and draw times to the CSV file at `path`, so that runs (and builds)
+// can be compared. The header is written when the file is created
+bool frame_time_report_write(const char *path, const FrameTimeHistogram *update_times,
+                             const FrameTimeHistogram *draw_times, const Player *player, float game_time) {
+  FILE *file = fopen(path, "a");
+  if (!file) return false;
+
+  fseek(file, 0, SEEK_END);  // Where an append stream starts out is implementation defined
+  if (ftell(file) == 0) {
+    fprintf(file, "timestamp,build,score,game_seconds,"
+                  "updates,update_mean_ms,update_p50_ms,update_p95_ms,update_p99_ms,update_max_ms,"
+                  "draws,draw_mean_ms,draw_p50_ms,draw_p95_ms,draw_p99_ms,draw_max_ms\n");
+  }
+
+  fprintf(file, "%lld,%s,%d,%.2f", (long long)time(NULL), DEBUG >= 1 ? "debug" : "release", player->score,
+          game_time);
+  const FrameTimeHistogram *histograms[] = {update_times, draw_times};
+  for (int i = 0; i < 2; i++) {
+    FrameTimeSummary summary = frame_time_histogram_summarise(histograms[i]);
+    fprintf(file, ",%u,%.3f,%.3f,%.3f,%.3f,%.3f", summary.count, summary.mean, summary.p50, summary.p95,
+            summary.p99, summary.max);
+  }
+  fprintf(file, "\n");
+
+  return fclose(file) == 0;
+}
+
+// Record the input latency of a game screen frame submitted at `submit_time` and presented at `present_time`. The
+// aim shown is the newer of the frame's input and the aim last read by late latching (see LateLatch)
+void input_latency_record(InputLatency *latency, const RenderFrame *frame, double late_aim_sample_time,
+                          double submit_time, double present_time) {
+  if (frame->input_sample_time == 0) return;  // The frame doesn't show any input
+
+  double aim_sample_time = fmax(frame->input_sample_time, late_aim_sample_time);
+  frame_time_histogram_record(&latency->simulation, frame->publish_time - frame->input_sample_time);
+  frame_time_histogram_record(&latency->drawing, submit_time - frame->publish_time);
+  frame_time_histogram_record(&latency->presentation, present_time - submit_time);
+  frame_time_histogram_record(&latency->total, present_time - aim_sample_time);
+}
+
+// Print a summary of one game's input latency
+void input_latency_report(const InputLatency *latency) {
+  if (latency->total.count == 0) return;
+
+  const char *stage_labels[] = {"simulation", "drawing", "presentation", "total"};
+  const FrameTimeHistogram *stages[] = {&latency->simulation, &latency->drawing, &latency->presentation,
+                                        &latency->total};
+  printf("Input latency (ms, p50/p95/p99):");
+  for (int i = 0; i < 4; i++) {
+    FrameTimeSummary summary = frame_time_histogram_summarise(stages[i]);
+    printf(" %s %.2f/%.2f/%.2f%s", stage_labels[i], summary.p50, summary.p95, summary.p99, i < 3 ? "," : "\n");
+  }
+}
+/*---------------------------------------------------------------------------------------------------------------*/
+
+/*--------------*/
+/* State stream */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+// Convert a value to fixed point with `scale` steps per unit
+int32_t state_stream_quantise(float value, float scale) {
+  return lroundf(value * scale);
+}
+
+// Write the difference `value - base` as a zigzag varint, so small differences either way take a single byte.
+// Returns the number of bytes written. The difference wraps around rather than overflowing
+size_t state_stream_write_delta(unsigned char *dest, int32_t value, int32_t base) {
+  uint32_t delta = (uint32_t)value - (uint32_t)base;
+  return write_varint(dest, delta << 1 ^ (0u - (delta >> 31)));
+}
+
+// Read a varint of up to 32 bits
+uint32_t state_stream_read_varint(StateStreamReader *reader) {
+  uint32_t value = 0;
+  for (int shift = 0; shift < 35 && reader->position < reader->size; shift += 7) {
+    unsigned char byte = reader->data[reader->position++];
+    value |= (uint32_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) return value;
+  }
+  reader->has_failed = true;
+  return 0;
+}
+
+// Read a difference written by state_stream_write_delta, returning `base` plus the difference
+int32_t state_stream_read_delta(StateStreamReader *reader, int32_t base) {
+  uint32_t zigzag = state_stream_read_varint(reader);
+  return (uint32_t)base + ((zigzag >> 1) ^ (0u - (zigzag & 1)));
+}
+
+// Grow some slots of a mirror to at least `capacity` slots, with the new ones empty
+void *state_stream_mirror_reserve(void *slots, int *slots_capacity, int capacity, size_t slot_size) {
+  if (*slots_capacity >= capacity) return slots;
+
+  slots = realloc(slots, capacity * slot_size);
+  if (!slots) {
+    fprintf(stderr, "Unable to allocate state stream storage.\n");
+    exit(EXIT_FAILURE);
+  }
+  memset((unsigned char *)slots + *slots_capacity * slot_size, 0, (capacity - *slots_capacity) * slot_size);
+  *slots_capacity = capacity;
+  return slots;
+}
+
+// Grow the mirror to have a slot for every slot of the game's entity storage
+void state_stream_mirror_fit(StateStreamMirror *mirror, const GameState *game_state) {
+  mirror->enemies = state_stream_mirror_reserve(mirror->enemies, &mirror->enemy_capacity,
+                                                game_state->enemy_manager.capacity, sizeof *(mirror->enemies));
+  for (int a = 0; a < NUM_ALLEGIANCES; a++) {
+    int capacity = game_state->projectile_manager.pools[a].capacity;
+    mirror->projectiles[a] = state_stream_mirror_reserve(mirror->projectiles[a], mirror->projectile_capacities + a,
+                                                         capacity, sizeof *(mirror->projectiles[a]));
+  }
+}
+
+// Empty the mirror, as if nothing had been sent
+void state_stream_mirror_clear(StateStreamMirror *mirror) {
+  memset(mirror->values, 0, sizeof mirror->values);
+  if (mirror->enemies) memset(mirror->enemies, 0, mirror->enemy_capacity * sizeof *(mirror->enemies));
+  for (int a = 0; a < NUM_ALLEGIANCES; a++) {
+    if (mirror->projectiles[a])
+      memset(mirror->projectiles[a], 0, mirror->projectile_capacities[a] * sizeof *(mirror->projectiles[a]));
+  }
+}
+
+void state_stream_mirror_cleanup(StateStreamMirror *mirror) {
+  free(mirror->enemies);
+  for (int a = 0; a < NUM_ALLEGIANCES; a++) free(mirror->projectiles[a]);
+  *mirror = (StateStreamMirror){0};
+}
+
+StateStreamEnemy state_stream_quantise_enemy(const Enemy *enemy) {
+  return (StateStreamEnemy){.x = state_stream_quantise(enemy->pos.x, STATE_STREAM_POSITION_SCALE),
+                            .y = state_stream_quantise(enemy->pos.y, STATE_STREAM_POSITION_SCALE),
+                            .size = state_stream_quantise(enemy->size, STATE_STREAM_POSITION_SCALE),
+                            .type = enemy->type,
+                            .is_active = true};
+}
+
+StateStreamProjectile state_stream_quantise_projectile(const Projectile *projectile) {
+  return (StateStreamProjectile){
+      .x = state_stream_quantise(projectile->spawn_pos.x, STATE_STREAM_POSITION_SCALE),
+      .y = state_stream_quantise(projectile->spawn_pos.y, STATE_STREAM_POSITION_SCALE),
+      .vx = state_stream_quantise(projectile->vel.x, STATE_STREAM_VELOCITY_SCALE),
+      .vy = state_stream_quantise(projectile->vel.y, STATE_STREAM_VELOCITY_SCALE),
+      .size = state_stream_quantise(projectile->size, STATE_STREAM_POSITION_SCALE),
+      .spawn_time = state_stream_quantise(projectile->spawn_time, STATE_STREAM_TIME_SCALE),
+      .is_active = true};
+}
+
+// Get whether two mirrored projectiles are the same (including both being empty)
+bool state_stream_projectiles_match(const StateStreamProjectile *a, const StateStreamProjectile *b) {
+  if (!a->is_active || !b->is_active) return a->is_active == b->is_active;
+  return a->x == b->x && a->y == b->y && a->vx == b->vx && a->vy == b->vy && a->size == b->size &&
+         a->spawn_time == b->spawn_time;
+}
+
+// Get the most bytes a tick can be encoded in, given a mirror fitted to the game
+size_t state_stream_max_tick_size(const StateStreamMirror *mirror) {
+  size_t size = 1 + 5 * (STATE_STREAM_NUM_VALUES + 1) + 1 + NUM_ALLEGIANCES;  // Flags, values, boss, list ends
+  size += (size_t)mirror->enemy_capacity * STATE_STREAM_MAX_RECORD_SIZE;
+  for (int a = 0; a < NUM_ALLEGIANCES; a++)
+    size += (size_t)mirror->projectile_capacities[a] * STATE_STREAM_MAX_RECORD_SIZE;
+  return size;
+}
+
+// Encode what changed in the game since the mirror as a tick, and update the mirror to match. A tick is the flags,
+// the values (see StateStreamValue) and the boss's type if it is active, then a list of enemy records and a list
+// of records for each projectile pool (see StateStreamRecordKind). A reset tick is encoded against an empty game,
+// so a viewer can start from it. `dest` must have room for state_stream_max_tick_size bytes once the mirror has
+// been fitted to the game. Returns the size of the tick
+size_t state_stream_encode_tick(StateStreamMirror *mirror, const GameState *game_state, bool is_reset,
+                                unsigned char *dest) {
+  const Player *player = &game_state->player;
+  const Boss *boss = &game_state->boss;
+  const EnemyManager *enemy_manager = &game_state->enemy_manager;
+  if (is_reset) state_stream_mirror_clear(mirror);
+
+  size_t size = 0;
+  dest[size++] = (is_reset ? STATE_STREAM_FLAG_RESET : 0) | (boss->is_active ? STATE_STREAM_FLAG_BOSS_ACTIVE : 0) |
+                 (player->is_defeated ? STATE_STREAM_FLAG_GAME_OVER : 0);
+
+  int32_t values[STATE_STREAM_NUM_VALUES] = {
+      [STATE_STREAM_VALUE_TIME] = state_stream_quantise(game_state->time, STATE_STREAM_TIME_SCALE),
+      [STATE_STREAM_VALUE_SCORE] = player->score,
+      [STATE_STREAM_VALUE_PLAYER_X] = state_stream_quantise(player->pos.x, STATE_STREAM_POSITION_SCALE),
+      [STATE_STREAM_VALUE_PLAYER_Y] = state_stream_quantise(player->pos.y, STATE_STREAM_POSITION_SCALE),
+      [STATE_STREAM_VALUE_PLAYER_SIZE] = state_stream_quantise(player->size, STATE_STREAM_POSITION_SCALE),
+      [STATE_STREAM_VALUE_BOSS_X] = state_stream_quantise(boss->pos.x, STATE_STREAM_POSITION_SCALE),
+      [STATE_STREAM_VALUE_BOSS_Y] = state_stream_quantise(boss->pos.y, STATE_STREAM_POSITION_SCALE),
+      [STATE_STREAM_VALUE_BOSS_HEALTH] = state_stream_quantise(boss->health, STATE_STREAM_HEALTH_SCALE)};
+  int num_values = boss->is_active ? STATE_STREAM_NUM_VALUES : STATE_STREAM_VALUE_BOSS_X;
+  for (int i = 0; i < num_values; i++) {
+    size += state_stream_write_delta(dest + size, values[i], mirror->values[i]);
+    mirror->values[i] = values[i];
+  }
+  if (boss->is_active) size += write_varint(dest + size, boss->type);
+
+  // Enemies. Empty slots in the mirror are all zero, so a spawn is encoded like a change from nothing. Slots past
+  // the end of the enemy storage (which can shrink when rewinding) count as empty
+  int last_slot = -1;
+  for (int i = 0; i < mirror->enemy_capacity; i++) {
+    StateStreamEnemy *sent = mirror->enemies + i;
+    StateStreamEnemy enemy = {0};
+    if (i < enemy_manager->capacity && enemy_manager->enemies[i].is_active)
+      enemy = state_stream_quantise_enemy(enemy_manager->enemies + i);
+
+    StateStreamRecordKind kind;
+    if (!enemy.is_active) {
+      if (!sent->is_active) continue;
+      kind = STATE_STREAM_RECORD_DESPAWN;
+    } else if (!sent->is_active) {
+      kind = STATE_STREAM_RECORD_SPAWN;
+    } else if (enemy.type != sent->type || enemy.size != sent->size) {
+      kind = STATE_STREAM_RECORD_CHANGE;
+    } else if (enemy.x != sent->x || enemy.y != sent->y) {
+      kind = STATE_STREAM_RECORD_MOVE;
+    } else {
+      continue;
+    }
+
+    size += write_varint(dest + size, (size_t)(i - last_slot - 1) << 3 | kind);
+    last_slot = i;
+    if (kind == STATE_STREAM_RECORD_SPAWN || kind == STATE_STREAM_RECORD_CHANGE) {
+      size += write_varint(dest + size, enemy.type);
+      size += state_stream_write_delta(dest + size, enemy.size, sent->size);
+    }
+    if (kind != STATE_STREAM_RECORD_DESPAWN) {
+      size += state_stream_write_delta(dest + size, enemy.x, sent->x);
+      size += state_stream_write_delta(dest + size, enemy.y, sent->y);
+    }
+    *sent = enemy;
+  }
+  dest[size++] = STATE_STREAM_RECORD_END;
+
+  // Projectiles only need sending when they spawn and despawn, since the viewer can work out where they are from
+  // their trajectories. A slot whose projectile was replaced since the last tick just gets a spawn
+  for (int a = 0; a < NUM_ALLEGIANCES; a++) {
+    const ProjectilePool *pool = game_state->projectile_manager.pools + a;
+    last_slot = -1;
+    for (int i = 0; i < mirror->projectile_capacities[a]; i++) {
+      StateStreamProjectile *sent = mirror->projectiles[a] + i;
+      StateStreamProjectile projectile = {0};
+      if (i < pool->capacity && pool->projectiles[i].is_active)
+        projectile = state_stream_quantise_projectile(pool->projectiles + i);
+      if (state_stream_projectiles_match(&projectile, sent)) continue;
+
+      StateStreamRecordKind kind = projectile.is_active ? STATE_STREAM_RECORD_SPAWN : STATE_STREAM_RECORD_DESPAWN;
+      size += write_varint(dest + size, (size_t)(i - last_slot - 1) << 3 | kind);
+      last_slot = i;
+      if (kind == STATE_STREAM_RECORD_SPAWN) {
+        size += state_stream_write_delta(dest + size, projectile.x, 0);
+        size += state_stream_write_delta(dest + size, projectile.y, 0);
+        size += state_stream_write_delta(dest + size, projectile.vx, 0);
+        size += state_stream_write_delta(dest + size, projectile.vy, 0);
+        size += state_stream_write_delta(dest + size, projectile.size, 0);
+        size += state_stream_write_delta(dest + size, projectile.spawn_time, values[STATE_STREAM_VALUE_TIME]);
+      }
+      *sent = projectile;
+    }
+    dest[size++] = STATE_STREAM_RECORD_END;
+  }
+
+  return size;
+}
+
+// Read the slot of the next entity record in a list, given the slot of the last one (-1 at the start of the list).
+// Returns false at the end of the list, or if the record is malformed (which sets has_failed)
+bool state_stream_read_record(StateStreamReader *reader, int *slot, StateStreamRecordKind *kind) {
+  uint32_t header = state_stream_read_varint(reader);
+  *kind = header & 7;
+  if (reader->has_failed || *kind == STATE_STREAM_RECORD_END) return false;
+
+  int64_t next_slot = (int64_t)*slot + (header >> 3) + 1;
+  if (*kind > STATE_STREAM_RECORD_DESPAWN || next_slot >= STATE_STREAM_MAX_SLOTS) {
+    reader->has_failed = true;
+    return false;
+  }
+  *slot = next_slot;
+  return true;
+}
+
+// Apply a tick from state_stream_encode_tick to the mirror and to `game_state`, the viewer's copy of the game,
+// growing its entity storage as needed. Only what the stream carries is set: the time, the player's score,
+// position and size, the boss, the enemies' positions, sizes and types, and the projectiles' trajectories. Returns
+// false if the tick is malformed, in which case the copy should be ignored until the next reset
+bool state_stream_decode_tick(StateStreamMirror *mirror, const unsigned char *tick, size_t tick_size,
+                              GameState *game_state) {
+  StateStreamReader reader = {.data = tick, .size = tick_size};
+  Player *player = &game_state->player;
+  Boss *boss = &game_state->boss;
+  EnemyManager *enemy_manager = &game_state->enemy_manager;
+
+  uint32_t flags = state_stream_read_varint(&reader);
+  if (flags & STATE_STREAM_FLAG_RESET) {
+    state_stream_mirror_clear(mirror);
+    for (int i = 0; i < enemy_manager->capacity; i++) enemy_manager->enemies[i].is_active = false;
+    enemy_manager->enemy_count = 0;
+    for (int a = 0; a < NUM_ALLEGIANCES; a++) {
+      ProjectilePool *pool = game_state->projectile_manager.pools + a;
+      for (int i = 0; i < pool->capacity; i++) pool->projectiles[i].is_active = false;
+      pool->projectile_count = 0;
+    }
+  }
+
+  bool is_boss_active = flags & STATE_STREAM_FLAG_BOSS_ACTIVE;
+  int num_values = is_boss_active ? STATE_STREAM_NUM_VALUES : STATE_STREAM_VALUE_BOSS_X;
+  for (int i = 0; i < num_values; i++) mirror->values[i] = state_stream_read_delta(&reader, mirror->values[i]);
+  const int32_t *values = mirror->values;
+
+  game_state->time = values[STATE_STREAM_VALUE_TIME] / STATE_STREAM_TIME_SCALE;
+  player->score = values[STATE_STREAM_VALUE_SCORE];
+  player->pos = (Vector2){values[STATE_STREAM_VALUE_PLAYER_X] / STATE_STREAM_POSITION_SCALE,
+                          values[STATE_STREAM_VALUE_PLAYER_Y] / STATE_STREAM_POSITION_SCALE};
+  player->size = values[STATE_STREAM_VALUE_PLAYER_SIZE] / STATE_STREAM_POSITION_SCALE;
+  player->is_defeated = flags & STATE_STREAM_FLAG_GAME_OVER;
+  boss->is_active = is_boss_active;
+  if (is_boss_active) {
+    boss->type = state_stream_read_varint(&reader);
+    boss->pos = (Vector2){values[STATE_STREAM_VALUE_BOSS_X] / STATE_STREAM_POSITION_SCALE,
+                          values[STATE_STREAM_VALUE_BOSS_Y] / STATE_STREAM_POSITION_SCALE};
+    boss->health = values[STATE_STREAM_VALUE_BOSS_HEALTH] / STATE_STREAM_HEALTH_SCALE;
+  }
+
+  int slot = -1;
+  StateStreamRecordKind kind;
+  while (state_stream_read_record(&reader, &slot, &kind)) {
+    if (slot >= enemy_manager->capacity) {
+      int capacity = enemy_manager->capacity * 2;
+      enemy_manager_resize(enemy_manager, slot < capacity ? capacity : slot + 1);
+      state_stream_mirror_fit(mirror, game_state);
+    }
+    StateStreamEnemy *sent = mirror->enemies + slot;
+    if (sent->is_active == (kind == STATE_STREAM_RECORD_SPAWN)) return false;  // Only empty slots can spawn
+
+    if (kind == STATE_STREAM_RECORD_DESPAWN) {
+      *sent = (StateStreamEnemy){0};
+    } else {
+      if (kind != STATE_STREAM_RECORD_MOVE) {
+        sent->type = state_stream_read_varint(&reader);
+        sent->size = state_stream_read_delta(&reader, sent->size);
+      }
+      sent->x = state_stream_read_delta(&reader, sent->x);
+      sent->y = state_stream_read_delta(&reader, sent->y);
+      sent->is_active = true;
+      if (sent->type >= MAX_ENEMY_TYPES) return false;
+    }
+
+    Enemy *enemy = enemy_manager->enemies + slot;
+    if (enemy->is_active != sent->is_active) enemy_manager->enemy_count += sent->is_active ? 1 : -1;
+    *enemy = (Enemy){.pos = {sent->x / STATE_STREAM_POSITION_SCALE, sent->y / STATE_STREAM_POSITION_SCALE},
+                     .size = sent->size / STATE_STREAM_POSITION_SCALE,
+                     .type = sent->type,
+                     .is_active = sent->is_active};
+  }
+
+  for (int a = 0; a < NUM_ALLEGIANCES && !reader.has_failed; a++) {
+    ProjectilePool *pool = game_state->projectile_manager.pools + a;
+    slot = -1;
+    while (state_stream_read_record(&reader, &slot, &kind)) {
+      if (kind != STATE_STREAM_RECORD_SPAWN && kind != STATE_STREAM_RECORD_DESPAWN) return false;
+      if (slot >= pool->capacity) {
+        int capacity = pool->capacity * 2;
+        projectile_pool_resize(pool, slot < capacity ? capacity : slot + 1);
+        state_stream_mirror_fit(mirror, game_state);
+      }
+
+      StateStreamProjectile *sent = mirror->projectiles[a] + slot;
+      *sent = (StateStreamProjectile){0};
+      if (kind == STATE_STREAM_RECORD_SPAWN) {
+        sent->x = state_stream_read_delta(&reader, 0);
+        sent->y = state_stream_read_delta(&reader, 0);
+        sent->vx = state_stream_read_delta(&reader, 0);
+        sent->vy = state_stream_read_delta(&reader, 0);
+        sent->size = state_stream_read_delta(&reader, 0);
+        sent->spawn_time = state_stream_read_delta(&reader, values[STATE_STREAM_VALUE_TIME]);
+        sent->is_active = true;
+      }
+
+      Projectile *projectile = pool->projectiles + slot;
+      if (projectile->is_active != sent->is_active) pool->projectile_count += sent->is_active ? 1 : -1;
+      *projectile = (Projectile){
+          .spawn_pos = {sent->x / STATE_STREAM_POSITION_SCALE, sent->y / STATE_STREAM_POSITION_SCALE},
+          .vel = {sent->vx / STATE_STREAM_VELOCITY_SCALE, sent->vy / STATE_STREAM_VELOCITY_SCALE},
+          .spawn_time = sent->spawn_time / STATE_STREAM_TIME_SCALE,
+          .size = sent->size / STATE_STREAM_POSITION_SCALE,
+          .is_active = sent->is_active};
+    }
+  }
+
+  return !reader.has_failed && reader.position == reader.size;
+}
+
+#ifndef _WIN32
+// Get the CPU time used by the calling thread so far, in seconds
+double get_thread_cpu_time(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+#endif
+
+// Start listening for a viewer on a Unix domain socket at `path`, replacing any socket left there by an earlier
+// run. Streaming is off if `path` is NULL or the socket can't be set up, and the other functions then do nothing
+void state_stream_open(StateStream *stream, const char *path) {
+  *stream = (StateStream){.listen_fd = -1, .client_fd = -1, .path = path, .needs_reset = true};
+  if (!path) return;
+
+#ifndef _WIN32
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof address.sun_path) {
+    fprintf(stderr, "State stream socket path %s is too long.\n", path);
+    return;
+  }
+  strcpy(address.sun_path, path);
+
+  struct stat status;
+  if (lstat(path, &status) == 0 && S_ISSOCK(status.st_mode)) unlink(path);
+
+  stream->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (stream->listen_fd < 0 || fcntl(stream->listen_fd, F_SETFL, O_NONBLOCK) < 0 ||
+      bind(stream->listen_fd, (struct sockaddr *)&address, sizeof address) < 0 ||
+      listen(stream->listen_fd, 1) < 0) {
+    fprintf(stderr, "Unable to open state stream socket %s.\n", path);
+    if (stream->listen_fd >= 0) close(stream->listen_fd);
+    stream->listen_fd = -1;
+    return;
+  }
+  if (DEBUG >= 1) printf("Streaming the game state to %s\n", path);
+#else
+  fprintf(stderr, "State streaming is unavailable on this platform.\n");
+#endif
+}
+
+// Start a new game on the stream. The viewer is told to start over, and the stats are cleared
+void state_stream_reset(StateStream *stream) {
+  stream->needs_reset = true;
+  stream->num_ticks = 0;
+  stream->num_bytes = 0;
+  stream->export_seconds = 0;
+}
+
+#ifndef _WIN32
+// Disconnect the viewer, dropping anything it hasn't taken yet
+void state_stream_disconnect(StateStream *stream) {
+  close(stream->client_fd);
+  stream->client_fd = -1;
+  stream->pending_size = 0;
+}
+
+// Send the viewer as much of the pending bytes as its socket will take without blocking. Returns false if the
+// viewer has gone
+bool state_stream_send_pending(StateStream *stream) {
+  size_t sent = 0;
+  while (sent < stream->pending_size) {
+    ssize_t result = send(stream->client_fd, stream->pending + sent, stream->pending_size - sent, MSG_NOSIGNAL);
+    if (result < 0 && errno == EINTR) continue;
+    if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    if (result <= 0) return false;
+    sent += result;
+  }
+
+  memmove(stream->pending, stream->pending + sent, stream->pending_size - sent);
+  stream->pending_size -= sent;
+  return true;
+}
+#endif
+
+// Send what changed in the game since the last tick to the viewer, first taking a new viewer if none is connected.
+// Only checks for a viewer if there isn't one. Never blocks
+void state_stream_write_tick(StateStream *stream, const GameState *game_state) {
+#ifndef _WIN32
+  if (stream->listen_fd < 0) return;
+  if (stream->client_fd < 0) {
+    stream->client_fd = accept(stream->listen_fd, NULL, NULL);
+    if (stream->client_fd < 0) return;
+    fcntl(stream->client_fd, F_SETFL, O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+    setsockopt(stream->client_fd, SOL_SOCKET, SO_NOSIGPIPE, &(int){1}, sizeof(int));
+#endif
+    stream->needs_reset = true;  // The new viewer has nothing to apply deltas to
+  }
+  double start_time = get_thread_cpu_time();
+
+  // Each tick is sent as its length (a varint) followed by the tick. The tick is encoded after room for the
+  // longest length, which is then written just before it
+  state_stream_mirror_fit(&stream->mirror, game_state);
+  size_t max_message_size = 5 + state_stream_max_tick_size(&stream->mirror);
+  if (stream->message_capacity < max_message_size) {
+    stream->message = realloc(stream->message, max_message_size);
+    stream->message_capacity = max_message_size;
+  }
+  if (!stream->message) {
+    fprintf(stderr, "Unable to allocate state stream storage.\n");
+    exit(EXIT_FAILURE);
+  }
+  size_t tick_size =
+      state_stream_encode_tick(&stream->mirror, game_state, stream->needs_reset, stream->message + 5);
+  stream->needs_reset = false;
+  unsigned char length[5];
+  size_t length_size = write_varint(length, tick_size);
+  unsigned char *message = stream->message + 5 - length_size;
+  memcpy(message, length, length_size);
+  size_t message_size = length_size + tick_size;
+
+  if (stream->pending_capacity < stream->pending_size + message_size) {
+    stream->pending_capacity = 2 * (stream->pending_size + message_size);
+    stream->pending = realloc(stream->pending, stream->pending_capacity);
+    if (!stream->pending) {
+      fprintf(stderr, "Unable to allocate state stream storage.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  memcpy(stream->pending + stream->pending_size, message, message_size);
+  stream->pending_size += message_size;
+
+  if (!state_stream_send_pending(stream)) {
+    state_stream_disconnect(stream);
+  } else if (stream->pending_size > STATE_STREAM_MAX_PENDING) {
+    fprintf(stderr, "The state stream viewer fell too far behind, so it was disconnected.\n");
+    state_stream_disconnect(stream);
+  }
+
+  stream->num_ticks++;
+  stream->num_bytes += message_size;
+  stream->export_seconds += get_thread_cpu_time() - start_time;
+#endif
+}
+
+// Print the bandwidth and CPU cost of the stream this game, if any ticks were sent
+void state_stream_report(const StateStream *stream, const Constants *constants) {
+  if (stream->num_ticks == 0) return;
+
+  double bytes_per_tick = (double)stream->num_bytes / stream->num_ticks;
+  printf("State stream: %d ticks, %.1f bytes/tick (%.1f KB/s), %.2f us CPU/tick\n", stream->num_ticks,
+         bytes_per_tick, bytes_per_tick * constants->simulation_rate / 1000,
+         1e6 * stream->export_seconds / stream->num_ticks);
+}
+
+// Disconnect the viewer, stop listening and free the stream's storage
+void state_stream_close(StateStream *stream) {
+#ifndef _WIN32
+  if (stream->client_fd >= 0) close(stream->client_fd);
+  if (stream->listen_fd >= 0) {
+    close(stream->listen_fd);
+    unlink(stream->path);
+  }
+#endif
+  free(stream->message);
+  free(stream->pending);
+  state_stream_mirror_cleanup(&stream->mirror);
+  *stream = (StateStream){.listen_fd = -1, .client_fd = -1};
+}
+/*---------------------------------------------------------------------------------------------------------------*/
 
-        // If this enemy is already of the strongest type, don't try to upgrade it
-        if (this_enemy_type == constants->num_enemy_types - 1) continue;
+/*-------------------*/
+/* Simulation thread */
+/*---------------------------------------------------------------------------------------------------------------*/
 
-        int this_enemy_new_type = GetRandomValue(this_enemy_type + 1, constants->num_enemy_types - 1);
+// Add a message to the input queue. Only called by the render thread. Returns false (dropping the message) if the
+// simulation thread has fallen too far behind to take it
+bool input_queue_push(InputQueue *queue, const InputMessage *message) {
+  unsigned head = queue->head;
+  if (head - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) == INPUT_QUEUE_CAPACITY) return false;
 
-        // If upgrading this enemy to this type would be too expensive, don't upgrade it
-        float cost_increase =
-            enemy_types[this_enemy_new_type].credit_cost - enemy_types[this_enemy_type].credit_cost;
-        if (wave_cost + cost_increase > available_credits) continue;
+  queue->messages[head % INPUT_QUEUE_CAPACITY] = *message;
+  __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
 
-        // Otherwise, upgrade the enemy
-        wave_enemy_types[i] = this_enemy_new_type;
-        wave_cost += cost_increase;
-      }
-    } else {  // Add more enemies
-      int prev_wave_size = wave_size;
+// Take the oldest message from the input queue. Only called by the simulation thread. Returns false if it is empty
+bool input_queue_pop(InputQueue *queue, InputMessage *message) {
+  unsigned tail = queue->tail;
+  if (tail == __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)) return false;
 
-      // Add enemies in the same way as before, but now guarentee one additional enemy
-      do {
-        wave_size++;
-        wave_cost += enemy_types[0].credit_cost;
-      } while (wave_cost + enemy_types[0].credit_cost <= available_credits &&
-               get_random_float(0, 1) <= constants->enemy_spawn_additional_enemy_chance);
+  *message = queue->messages[tail % INPUT_QUEUE_CAPACITY];
+  __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+  return true;
+}
 
-      // Ensure that adding a type 0 enemy was in fact the cheapest action
-      assert((wave_cost <= available_credits) && "Enemies added to wave exceeded credits");
+// Grow a render frame's copy of some entity storage to at least `capacity` elements
+void *render_frame_reserve(void *storage, int *storage_capacity, int capacity, size_t element_size) {
+  if (*storage_capacity >= capacity) return storage;
 
-      // Increase wave array size and ensure the new enemies are of type 0
-      wave_enemy_types = realloc(wave_enemy_types, wave_size * sizeof *wave_enemy_types);
-      if (!wave_enemy_types) {
-        fprintf(stderr, "Error reallocating wave enemy types memory.\n");
-        exit(EXIT_FAILURE);
-      }
-      memset(wave_enemy_types + prev_wave_size, 0, (wave_size - prev_wave_size) * sizeof *wave_enemy_types);
-    }
-    // Further iterations randomly choose to either upgrade the current enemies or add more
-    upgrade_instead_of_add = GetRandomValue(0, 1);
+  storage = realloc(storage, capacity * element_size);
+  if (!storage) {
+    fprintf(stderr, "Unable to allocate render frame storage.\n");
+    exit(EXIT_FAILURE);
   }
+  *storage_capacity = capacity;
+  return storage;
+}
 
-  // Add the enemies from the wave to the enemy manager
-  for (int i = 0; i < wave_size; i++) {
-    Enemy this_enemy =
-        enemy_generate_offscreen(enemy_types + wave_enemy_types[i], player, camera_position, constants);
-    enemy_manager_add_enemy(enemy_manager, this_enemy);
+// Copy the game state (and the stats shown alongside it) into a render frame
+void render_frame_copy_game_state(RenderFrame *frame, const GameState *game_state,
+                                  const SnapshotRing *snapshot_ring) {
+  const EnemyManager *enemy_manager = &game_state->enemy_manager;
+  frame->enemies =
+      render_frame_reserve(frame->enemies, &frame->enemy_capacity, enemy_manager->capacity, sizeof(Enemy));
+  memcpy(frame->enemies, enemy_manager->enemies, enemy_manager->capacity * sizeof(Enemy));
+
+  for (int i = 0; i < NUM_ALLEGIANCES; i++) {
+    const ProjectilePool *pool = game_state->projectile_manager.pools + i;
+    frame->projectiles[i] = render_frame_reserve(frame->projectiles[i], frame->projectile_capacities + i,
+                                                 pool->capacity, sizeof(Projectile));
+    memcpy(frame->projectiles[i], pool->projectiles, pool->capacity * sizeof(Projectile));
   }
 
-  enemy_manager->credits_spent += wave_cost;
-  free(wave_enemy_types);
-  wave_enemy_types = NULL;
+  frame->game_state = *game_state;
+  frame->game_state.enemy_manager.enemies = frame->enemies;
+  for (int i = 0; i < NUM_ALLEGIANCES; i++) {
+    frame->game_state.projectile_manager.pools[i].projectiles = frame->projectiles[i];
+    frame->game_state.projectile_manager.pools[i].expiry_heap = NULL;
+  }
 
-  // Reset the enemy timer and generate a new interval length
-  enemy_manager->time_of_last_spawn = GetTime();
-  enemy_manager->enemy_spawn_interval =
-      get_random_float(constants->enemy_spawn_interval_min, constants->enemy_spawn_interval_max);
+  frame->snapshot_count = snapshot_ring->count;
+  frame->snapshot_memory = snapshot_ring_get_memory_usage(snapshot_ring);
 }
 
-// Update the enemies so that they move towards the player (when it is time to do so and with probability)
-void enemy_manager_update_desired_positions(EnemyManager *enemy_manager, const Player *player,
-                                            const Constants *constants) {
-  // If it is not time to update the enemies, do nothing
-  float time_since_last_update = GetTime() - enemy_manager->time_of_last_update;
-  if (time_since_last_update < constants->enemy_update_interval) return;
-
-  enemy_manager->time_of_last_update = GetTime();
-
-  // Otherwise, iterate through the enemies and (sometimes) update their desired positions
+// Index the render frame's entities in its spatial grids, so each draw pass only visits the entities near the
+// screen. The simulation keeps no spatial index of its own, and building the grids here keeps the work off the
+// render thread. With `cull_off_screen`, entities off the frame's screen are left out: the frame is drawn with its
+// own camera, so they can't be seen in it, and in big waves most of the entities are off screen
+void render_frame_build_grids(RenderFrame *frame, bool cull_off_screen, const Constants *constants) {
+  const EnemyManager *enemy_manager = &frame->game_state.enemy_manager;
+  Vector2 camera_position = frame->game_state.camera_position;
+  spatial_grid_clear(&frame->enemy_grid, constants);
   for (int i = 0; i < enemy_manager->capacity; i++) {
-    Enemy *this_enemy = enemy_manager->enemies + i;
+    const Enemy *this_enemy = enemy_manager->enemies + i;
     if (!this_enemy->is_active) continue;
+    if (cull_off_screen && !circle_is_on_screen(this_enemy->pos, this_enemy->size, camera_position, constants))
+      continue;
 
-    float r_num = get_random_float(0, 1);
-    if (r_num <= constants->enemy_update_chance) {
-      this_enemy->desired_pos = player->pos;  // Enemy will now move towards the current position of the player
+    spatial_grid_insert(&frame->enemy_grid, i, this_enemy->pos, this_enemy->size, constants);
+  }
+  spatial_grid_finish(&frame->enemy_grid);
+
+  for (int a = 0; a < NUM_ALLEGIANCES; a++) {
+    const ProjectilePool *pool = frame->game_state.projectile_manager.pools + a;
+    SpatialGrid *grid = frame->projectile_grids + a;
+    spatial_grid_clear(grid, constants);
+    for (int i = 0; i < pool->capacity; i++) {
+      const Projectile *this_projectile = pool->projectiles + i;
+      if (!this_projectile->is_active) continue;
+
+      Vector2 projectile_pos = projectile_get_position(this_projectile, frame->game_state.time);
+      bool is_on_screen = circle_is_on_screen(projectile_pos, this_projectile->size, camera_position, constants);
+      if (cull_off_screen && !is_on_screen) continue;
+      spatial_grid_insert(grid, i, projectile_pos, this_projectile->size, constants);
     }
+    spatial_grid_finish(grid);
   }
 }
 
-// Update the positions of active enemies and check for collisions with the player
-void enemy_manager_update_enemy_positions(EnemyManager *enemy_manager, Player *player) {
-  for (int i = 0, enemies_counted = 0; i < enemy_manager->capacity && enemies_counted < enemy_manager->enemy_count;
-       i++) {
-    Enemy *this_enemy = enemy_manager->enemies + i;
-    if (!this_enemy->is_active) continue;
+// Publish the simulation thread's back frame as the newest frame, and take the one it replaces to write into next
+void render_frame_buffer_publish(RenderFrameBuffer *buffer) {
+  int old_middle = __atomic_exchange_n(&buffer->middle, buffer->back | RENDER_FRAME_IS_NEW, __ATOMIC_ACQ_REL);
+  buffer->back = old_middle & ~RENDER_FRAME_IS_NEW;
+}
 
-    enemies_counted++;  // Keep track of enemies processed so we can exit the loop early
+// Get the newest published frame for the render thread. It stays untouched by the simulation thread until the next
+// call, however many frames are published in the meantime, so the render thread may change it (see LateLatch)
+RenderFrame *render_frame_buffer_acquire(RenderFrameBuffer *buffer) {
+  if (__atomic_load_n(&buffer->middle, __ATOMIC_RELAXED) & RENDER_FRAME_IS_NEW) {
+    int old_middle = __atomic_exchange_n(&buffer->middle, buffer->front, __ATOMIC_ACQ_REL);
+    buffer->front = old_middle & ~RENDER_FRAME_IS_NEW;
+  }
+  return buffer->frames + buffer->front;
+}
 
-    // Move the enemy towards its desired position according to its speed
-    Vector2 normalised_move_direction =
-        Vector2Normalize(Vector2Subtract(this_enemy->desired_pos, this_enemy->pos));
-    this_enemy->pos =
-        Vector2Add(this_enemy->pos, Vector2Scale(normalised_move_direction, this_enemy->speed * GetFrameTime()));
+// Copy the game state into the back frame and publish it
+void simulation_thread_publish_frame(SimulationThread *sim) {
+  RenderFrame *frame = sim->frame_buffer.frames + sim->frame_buffer.back;
+  render_frame_copy_game_state(frame, sim->game_state, sim->snapshot_ring);
+  render_frame_build_grids(frame, __atomic_load_n(&sim->cull_off_screen, __ATOMIC_RELAXED), sim->constants);
+  frame->update_times = frame_time_histogram_summarise(&sim->update_times);
+  frame->is_game_over = sim->game_state->player.is_defeated;
+  frame->input_sample_time = sim->input_sample_time;
+  frame->late_aim_sequence = sim->late_aim_sequence;
+  frame->publish_time = GetTime();
+  render_frame_buffer_publish(&sim->frame_buffer);
+}
 
-    // Check for the enemy colliding with the player
-    if (CheckCollisionCircles(this_enemy->pos, this_enemy->size, player->pos, player->size)) {
-      // Delete the enemy (not strictly necessary at the moment)
-      this_enemy->is_active = false;
-      enemy_manager->enemy_count--;
+// Body of the simulation thread. Runs updates of 1 / simulation_rate seconds, on schedule, with the latest input
+// from the render thread, until it is asked to stop or the player is defeated
+void *simulation_thread_run(void *arg) {
+  SimulationThread *sim = arg;
+  GameState *game_state = sim->game_state;
+  Player *player = &game_state->player;
+  const Constants *constants = sim->constants;
+
+  float update_time = 1 / constants->simulation_rate;  // Simulated seconds per update
+  float rewind_progress = 0;                            // Fraction of a snapshot rewound but not yet restored
+  InputMessage input = {0};                             // Latest input, which is reused until more arrives
+  double next_update_time = GetTime();
+
+  while (__atomic_load_n(&sim->is_running, __ATOMIC_ACQUIRE)) {
+    double update_start_time = GetTime();
+
+    // Steer with the newest input, but fire if any frame since the last update asked to, so quick clicks between
+    // updates aren't lost. Debug key presses since the last update are all applied
+    InputMessage message;
+    bool has_new_input = false;
+    bool is_firing = false;
+    UpdateInput update_input = {0};
+    while (input_queue_pop(&sim->input_queue, &message)) {
+      sim->input_sample_time = message.sample_time;
+      if (message.is_late_aim) {
+        // Late aims are only sent for consecutive frames, so their intervals are merged into one, and the newest
+        // aim is also used for anything fired until the next input arrives
+        const LateAim *late_aim = &message.late_aim;
+        float *after = &update_input.late_aim_spawned_after, *before = &update_input.late_aim_spawned_before;
+        bool has_late_aim = *after < *before;
+        *after = has_late_aim ? fminf(*after, late_aim->spawned_after) : late_aim->spawned_after;
+        *before = has_late_aim ? fmaxf(*before, late_aim->spawned_before) : late_aim->spawned_before;
+        update_input.late_aim_pos = late_aim->aim_pos;
+        input.player_input.aim_pos = late_aim->aim_pos;
+        sim->late_aim_sequence = late_aim->sequence;
+        continue;
+      }
 
-      player->is_defeated = true;
+      update_input.toggle_invincibility ^= message.toggle_invincibility;
+      update_input.num_score_bonuses += message.add_score;
+      is_firing = is_firing || message.player_input.is_firing;
+      input = message;
+      has_new_input = true;
+    }
+    if (has_new_input) input.player_input.is_firing = is_firing;
+    update_input.move_direction = input.player_input.move_direction;
+    update_input.aim_pos = input.player_input.aim_pos;
+    update_input.is_firing = input.player_input.is_firing;
+
+    if (input.is_rewinding) {
+      // The game is paused while rewinding, which runs at the speed the game was played
+      game_state_apply_debug_actions(game_state, &update_input);
+      rewind_progress += update_time * constants->snapshot_rate;
+      snapshot_ring_rewind(sim->snapshot_ring, (int)rewind_progress, game_state);
+      rewind_progress -= (int)rewind_progress;
+      replay_writer_jump(sim->replay_writer);
+    } else {
+      replay_writer_record(sim->replay_writer, game_state, &update_input);
+      game_state_play_update(game_state, &update_input, update_time, sim->enemy_types, sim->boss_types,
+                             &sim->events, constants);
+      game_events_send_particle_bursts(&sim->events, sim->enemy_types, sim->boss_types, &sim->particle_bursts);
+      snapshot_ring_try_to_take_snapshot(sim->snapshot_ring, game_state, constants);
     }
-  }
-}
 
-// If it is time to do so, spawn the boss
-void boss_try_to_spawn(Boss *boss, const Player *player, Vector2 camera_position, const Constants *constants) {
-  if (boss->is_active) return;
-  if (player->score < boss->score_for_next_spawn) return;
+    // Recorded before publishing, so that the frame's summary includes this update. Streaming isn't included,
+    // since its cost is reported separately
+    frame_time_histogram_record(&sim->update_times, GetTime() - update_start_time);
+    state_stream_write_tick(sim->state_stream, game_state);
+    simulation_thread_publish_frame(sim);
+    if (player->is_defeated) break;  // The render thread ends the game once it sees this frame
+
+    // Sleep until the next update is due. If the simulation has fallen more than a few updates behind (e.g. while
+    // the window is being dragged), skip ahead rather than running the backlog all at once
+    next_update_time += update_time;
+    double current_time = GetTime();
+    if (next_update_time > current_time)
+      WaitTime(next_update_time - current_time);
+    else if (current_time - next_update_time > 4 * update_time)
+      next_update_time = current_time;
+  }
 
-  boss->pos = get_random_enemy_start_position(boss->boss_type->size, camera_position, constants);
-  boss->desired_pos = player->pos;
-  boss->is_active = true;
-  boss->health = boss->boss_type->max_health;
-  boss->time_of_last_projectile = GetTime();
+  return NULL;
 }
 
-// If it is time to do so, change the boss between moving and being stationary
-void boss_try_to_switch_states(Boss *boss, const Player *player) {
-  if (!boss->is_active) return;
+// Set up a simulation thread for the given game. It isn't started until simulation_thread_start
+void simulation_thread_init(SimulationThread *sim, GameState *game_state, SnapshotRing *snapshot_ring,
+                            StateStream *state_stream, ReplayWriter *replay_writer, const EnemyType *enemy_types,
+                            const BossType *boss_types, const Constants *constants) {
+  *sim = (SimulationThread){.game_state = game_state,
+                            .snapshot_ring = snapshot_ring,
+                            .state_stream = state_stream,
+                            .replay_writer = replay_writer,
+                            .enemy_types = enemy_types,
+                            .boss_types = boss_types,
+                            .constants = constants,
+                            .frame_buffer = {.back = 0, .middle = 1, .front = 2}};
+}
 
-  if (boss->state == BOSS_STATE_MOVING &&
-      GetTime() - boss->time_of_last_state_switch >= boss->boss_type->moving_duration) {
-    boss->state = BOSS_STATE_STATIONARY;
-    boss->time_of_last_state_switch = GetTime();
-    boss->shots_left_in_burst = boss->boss_type->shots_per_burst;
-    boss->time_of_last_projectile = GetTime();
-  }
+// Start simulating the game from its current state. A frame of that state is published first, so there is always
+// something to draw, and any input left over from the last run is discarded
+void simulation_thread_start(SimulationThread *sim) {
+  sim->input_queue.tail = sim->input_queue.head;
+  sim->input_sample_time = 0;  // The first frame doesn't show any input
+  simulation_thread_publish_frame(sim);
 
-  if (boss->state == BOSS_STATE_STATIONARY &&
-      GetTime() - boss->time_of_last_state_switch >= boss->boss_type->stationary_duration) {
-    boss->state = BOSS_STATE_MOVING;
-    boss->time_of_last_state_switch = GetTime();
-    boss->desired_pos = player->pos;
+  sim->is_running = true;
+  if (pthread_create(&sim->thread, NULL, simulation_thread_run, sim) != 0) {
+    fprintf(stderr, "Unable to start the simulation thread.\n");
+    exit(EXIT_FAILURE);
   }
 }
 
-// If the boss is moving, update its position
-void boss_update_position(Boss *boss, Player *player) {
-  if (!boss->is_active) return;
+// Stop the simulation thread (if it hasn't already stopped by itself) and wait for it to exit. Afterwards the game
+// state and snapshot ring can be used from the calling thread again. Does nothing if the thread wasn't started
+void simulation_thread_stop(SimulationThread *sim) {
+  if (!sim->is_running) return;  // Only this thread writes is_running, so no atomic load is needed
 
-  // Check for the boss colliding with the player (even if the boss is stationary)
-  if (CheckCollisionCircles(boss->pos, boss->boss_type->size, player->pos, player->size)) {
-    boss->is_active = false;  // Deactivate the boss (not strictly necessary at the moment)
-    player->is_defeated = true;
+  __atomic_store_n(&sim->is_running, false, __ATOMIC_RELEASE);
+  pthread_join(sim->thread, NULL);
+}
+
+// Free the render frames' and event buffer's storage. The thread must be stopped
+void simulation_thread_cleanup(SimulationThread *sim) {
+  game_event_buffer_cleanup(&sim->events);
+  for (int i = 0; i < 3; i++) {
+    RenderFrame *frame = sim->frame_buffer.frames + i;
+    free(frame->enemies);
+    spatial_grid_cleanup(&frame->enemy_grid);
+    for (int j = 0; j < NUM_ALLEGIANCES; j++) {
+      free(frame->projectiles[j]);
+      spatial_grid_cleanup(frame->projectile_grids + j);
+    }
+    *frame = (RenderFrame){0};
   }
+}
 
-  if (boss->state != BOSS_STATE_MOVING) return;
+// Start late latching from `frame`, forgetting the late aims sent before it (the simulation discards any it hasn't
+// taken when it is restarted)
+void late_latch_reset(LateLatch *latch, const RenderFrame *frame) {
+  latch->sequence = frame->late_aim_sequence;
+  latch->pending_since = frame->game_state.time;
+  latch->last_latched_time = frame->game_state.time;
+  latch->aim_sample_time = 0;
+}
 
-  Vector2 normalised_move_direction = Vector2Normalize(Vector2Subtract(boss->desired_pos, boss->pos));
-  boss->pos =
-      Vector2Add(boss->pos, Vector2Scale(normalised_move_direction, boss->boss_type->speed * GetFrameTime()));
+// Re-read the aim just before `frame` (the render thread's) is submitted, and turn the player's projectiles fired
+// since the last frame latched towards it, both in the frame and, by sending a late aim, in the simulation. If the
+// simulation hadn't applied the late aims sent before when it published the frame, their projectiles are turned
+// again, so nothing snaps back to an older aim. The frame's grids are left as they are: the projectiles turned are
+// only a frame or two from the player, so they stay in the cells drawn
+void late_latch_aim(LateLatch *latch, RenderFrame *frame, InputQueue *input_queue, const Constants *constants) {
+  GameState *game_state = &frame->game_state;
+  if (game_state->time < latch->last_latched_time) late_latch_reset(latch, frame);  // The game was rewound
+
+  bool is_pending = frame->late_aim_sequence != latch->sequence;
+  LateAim late_aim = {.spawned_after = is_pending ? latch->pending_since : latch->last_latched_time,
+                      .spawned_before = game_state->time,
+                      .sequence = latch->sequence + 1};
+  if (late_aim.spawned_after >= late_aim.spawned_before) return;  // This frame has already been latched
+
+  double sample_time = GetTime();
+  late_aim.aim_pos = get_mouse_position_in_units_game(game_state->camera_position, constants);
+  InputMessage message = {.sample_time = sample_time, .is_late_aim = true, .late_aim = late_aim};
+  if (!input_queue_push(input_queue, &message)) return;
+
+  projectile_pool_apply_late_aim(game_state->projectile_manager.pools + ALLEGIANCE_PLAYER, late_aim.aim_pos,
+                                 late_aim.spawned_after, late_aim.spawned_before,
+                                 game_state->player.projectile_speed, constants);
+  if (!is_pending) latch->pending_since = late_aim.spawned_after;
+  latch->sequence = late_aim.sequence;
+  latch->last_latched_time = game_state->time;
+  latch->aim_sample_time = sample_time;
 }
+/*---------------------------------------------------------------------------------------------------------------*/
 
-// Generate a new boss projectile that moves towards the player
-Projectile projectile_generate_from_boss(const Boss *boss, const Player *player) {
-  // Spawn the projectile at the edge of the boss
-  Vector2 boss_to_player_norm = Vector2Normalize(Vector2Subtract(player->pos, boss->pos));
-  Vector2 position = Vector2Add(
-      boss->pos, Vector2Scale(boss_to_player_norm, boss->boss_type->size - boss->boss_type->projectile_size));
+/*--------------*/
+/* Frame pacing */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+// Switch how often frames are drawn. Continuous pacing draws at the target frame rate, for gameplay. Event driven
+// pacing only draws when there is input or the window changes, for the menus, which are static otherwise. Idle
+// pacing draws at a low rate, for when the game is paused in the background
+void frame_pacing_set(FramePacing *current_pacing, FramePacing pacing, const Constants *constants) {
+  if (*current_pacing == pacing) return;
+  *current_pacing = pacing;
 
-  return (Projectile){.pos = position,
-                      .dir = boss_to_player_norm,
-                      .is_active = true,
-                      .allegiance = ALLEGIANCE_ENEMIES,
-                      .speed = boss->boss_type->projectile_speed,
-                      .size = boss->boss_type->projectile_size,
-                      .colour = boss->boss_type->projectile_colour};
+  if (pacing == FRAME_PACING_EVENT_DRIVEN)
+    EnableEventWaiting();
+  else
+    DisableEventWaiting();
+  SetTargetFPS(pacing == FRAME_PACING_IDLE ? constants->idle_fps : constants->target_fps);
 }
 
-// If it is time to do so, fire projectiles at the player
-void boss_try_to_fire_projectile(Boss *boss, ProjectileManager *projectile_manager, const Player *player) {
-  // Note we can still fire while moving
-  if (!boss->is_active) return;
-  if (boss->shots_left_in_burst <= 0) return;
-  if (GetTime() - boss->time_of_last_projectile <= 1 / boss->boss_type->firerate) return;
+// Print the fraction of a core the game used between `cpu_start` (from clock) and `wall_start` (from GetTime) and
+// now. On Linux and macOS, clock counts the time of every thread in the process
+void print_cpu_usage(const char *label, clock_t cpu_start, double wall_start) {
+  double cpu_seconds = (double)(clock() - cpu_start) / CLOCKS_PER_SEC;
+  double wall_seconds = GetTime() - wall_start;
+  if (wall_seconds <= 0) return;
 
-  projectile_manager_add_projectile(projectile_manager, projectile_generate_from_boss(boss, player));
-  boss->time_of_last_projectile = GetTime();
-  boss->shots_left_in_burst--;
+  printf("CPU usage on %s: %.1f%% of a core over %.1f s\n", label, 100 * cpu_seconds / wall_seconds, wall_seconds);
 }
 
-// If the boss is defeated, perform death actions
-void boss_check_for_defeat(Boss *boss, Player *player, EnemyManager *enemy_manager) {
-  if (!boss->is_defeated) return;
+// Get the settings of a quality level, from 0 (full quality) to QUALITY_NUM_LEVELS - 1. Each level gives up a
+// little more than the one before, starting with what is least noticeable. Culling off-screen entities from the
+// render frames doesn't change what is drawn, it only saves the simulation thread indexing them
+QualitySettings quality_get_settings(int level) {
+  const QualitySettings levels[QUALITY_NUM_LEVELS] = {
+      {.name = "full", .circle_lod_bias = 0, .cull_off_screen = false, .draw_background = true,
+       .show_full_debug_text = true},
+      {.name = "high", .circle_lod_bias = 1, .cull_off_screen = false, .draw_background = true,
+       .show_full_debug_text = false},
+      {.name = "medium", .circle_lod_bias = 1, .cull_off_screen = true, .draw_background = true,
+       .show_full_debug_text = false},
+      {.name = "low", .circle_lod_bias = 2, .cull_off_screen = true, .draw_background = false,
+       .show_full_debug_text = false}};
+  return levels[level];
+}
 
-  boss->is_defeated = false;
-  boss->is_active = false;
-  player->score += boss->boss_type->score_on_defeat;
-  player->boss_points += boss->boss_type->boss_points_on_defeat;
-  // Successive bosses take twice as many points to spawn (starting from when the previous boss is defeated)
-  boss->score_for_next_spawn = 2 * boss->boss_type->initial_score_to_spawn + player->score;
+// Apply the settings of a quality level which aren't read while drawing
+void quality_settings_apply(const QualitySettings *settings, CircleLods *circle_lods, SimulationThread *sim) {
+  circle_lods->level_bias = settings->circle_lod_bias;
+  __atomic_store_n(&sim->cull_off_screen, settings->cull_off_screen, __ATOMIC_RELAXED);
+}
 
-  for (int i = 0; i < boss->boss_type->num_enemies_spawned_on_defeat; i++) {
-    Enemy enemy = enemy_generate_at_origin(boss->boss_type->enemy_type_spawned_on_defeat, player);
+// Set up a frame governor at full quality
+void frame_governor_init(FrameGovernor *governor) {
+  *governor = (FrameGovernor){.calm_windows_needed = FRAME_GOVERNOR_CALM_WINDOWS};
+}
 
-    // Position the enemy uniformly at random inside the boss
-    float max_radius = boss->boss_type->size - enemy.size;
-    assert((max_radius > 0) && "Boss should not be smaller than spawned enemies");
-    float radius = sqrtf(get_random_float(0, max_radius * max_radius));  // The sqrt ensures uniform distribution
-    float angle = get_random_float(0, 2 * PI);
-    enemy.pos = Vector2Add(boss->pos, (Vector2){radius * cosf(angle), radius * sinf(angle)});
+// Start a new window of frames
+void frame_governor_clear_window(FrameGovernor *governor) {
+  governor->num_frames = 0;
+  governor->num_slow_frames = 0;
+  governor->draw_time_sum = 0;
+}
 
-    enemy_manager_add_enemy(enemy_manager, enemy);
-  }
+// Discard the frames measured in the current window, e.g. when the game starts or resumes. The frame in progress
+// is discarded as well, since its GetFrameTime is that of the last frame on the menus or paused
+void frame_governor_restart_window(FrameGovernor *governor) {
+  frame_governor_clear_window(governor);
+  governor->is_skipping_frame = true;
 }
 
-/*---------------------------------------------------------------------------------------------------------------*/
+// Record a game frame which took `frame_time` seconds (from GetFrameTime), of which `draw_time` was spent drawing.
+// At the end of each window the quality level is stepped down if a fifth or more of its frames were over budget,
+// and stepped up after enough windows in a row with no slow frames and under half the budget spent drawing. The
+// gap between those thresholds keeps the level from flipping back and forth. Returns whether the level changed
+bool frame_governor_record(FrameGovernor *governor, double frame_time, double draw_time,
+                           const Constants *constants) {
+  if (governor->is_skipping_frame) {
+    governor->is_skipping_frame = false;
+    return false;
+  }
 
-/*---------------------*/
-/* Camera calculations */
-/*---------------------------------------------------------------------------------------------------------------*/
+  double budget = 1.0 / constants->target_fps;
+  governor->num_frames++;
+  governor->draw_time_sum += draw_time;
+  // A frame that took well over the budget missed its slot even if drawing was quick (e.g. if the simulation
+  // thread held the core)
+  if (frame_time > 1.2 * budget || draw_time > 0.9 * budget) governor->num_slow_frames++;
+  if (governor->num_frames < FRAME_GOVERNOR_WINDOW) return false;
+
+  int old_level = governor->level;
+  double mean_draw_time = governor->draw_time_sum / governor->num_frames;
+  if (5 * governor->num_slow_frames >= governor->num_frames) {
+    // A step up that is undone straight away means the machine is on the edge, so wait longer before the next
+    if (governor->was_just_stepped_up && governor->calm_windows_needed < 16 * FRAME_GOVERNOR_CALM_WINDOWS)
+      governor->calm_windows_needed *= 2;
+    if (governor->level < QUALITY_NUM_LEVELS - 1) governor->level++;
+    governor->num_calm_windows = 0;
+  } else if (governor->num_slow_frames == 0 && mean_draw_time < 0.5 * budget) {
+    governor->num_calm_windows++;
+    if (governor->level > 0 && governor->num_calm_windows >= governor->calm_windows_needed) {
+      governor->level--;
+      governor->num_calm_windows = 0;
+    }
+  } else {
+    governor->num_calm_windows = 0;
+  }
+  governor->was_just_stepped_up = governor->level < old_level;
 
-// Update the position of the camera (following the player without showing out of bounds area)
-void camera_update_position(Vector2 *camera_position, const Player *player, const Constants *constants) {
-  Vector2 minimum_position =
-      Vector2Scale(Vector2Subtract(constants->screen_dimensions, constants->game_area_dimensions), 0.5);
-  Vector2 maximum_position = Vector2Negate(minimum_position);
-  Vector2 offset_amount = Vector2Scale(constants->screen_dimensions, 0.5);
-  *camera_position = Vector2Subtract(Vector2Clamp(player->pos, minimum_position, maximum_position), offset_amount);
+  if (governor->level != old_level) {
+    printf("Quality %s -> %s: %d of %d frames over the %.1f ms budget, %.2f ms mean draw time\n",
+           quality_get_settings(old_level).name, quality_get_settings(governor->level).name,
+           governor->num_slow_frames, governor->num_frames, 1000 * budget, 1000 * mean_draw_time);
+  }
+  frame_governor_clear_window(governor);
+  return governor->level != old_level;
 }
+/*---------------------------------------------------------------------------------------------------------------*/
 
 /*---------------*/
 /* UI processing */
@@ -1007,8 +4912,8 @@ void button_check_user_interaction(Button *button, const Constants *constants) {
   }
 }
 
-// Check if the player can afford a given upgrade, purchasing it if they can
-void shop_try_to_purchase_upgrade(Shop *shop, Upgrade *upgrade, const Constants *constants) {
+// Check if the player can afford a given upgrade, purchasing it if they can. Returns whether it was purchased
+bool shop_try_to_purchase_upgrade(Shop *shop, Upgrade *upgrade, Player *player, const Constants *constants) {
   int rounded_cost = lroundf(upgrade->cost);
 
   int *balance;  // Pointer to the currency needed to purchase this upgrade
@@ -1021,11 +4926,12 @@ void shop_try_to_purchase_upgrade(Shop *shop, Upgrade *upgrade, const Constants
       break;
   }
 
-  if (*balance < rounded_cost) return;
+  if (*balance < rounded_cost) return false;
 
-  *balance -= rounded_cost;                                          // Deduct the upgrade cost
-  *(upgrade->stat) += upgrade->stat_increment * upgrade->base_stat;  // Increase the stat
-  upgrade->cost *= constants->upgrade_cost_multiplier;               // Set the next upgrade price
+  *balance -= rounded_cost;                         // Deduct the upgrade cost
+  upgrade->level++;                                 // Record the purchase
+  upgrade_apply_level(upgrade, player, constants);  // Increase the stat and set the next upgrade price
+  return true;
 }
 /*---------------------------------------------------------------------------------------------------------------*/
 
@@ -1033,52 +4939,137 @@ void shop_try_to_purchase_upgrade(Shop *shop, Upgrade *upgrade, const Constants
 /* Game object drawing */
 /*---------------------------------------------------------------------------------------------------------------*/
 
+// Fill in the unit circle vertex tables, along with the largest radius each level of detail can draw while its
+// edges stay within CIRCLE_MAX_ERROR_PIXELS of the true circle
+void circle_lods_init(CircleLods *circle_lods) {
+  for (int level = 0; level < CIRCLE_LOD_LEVELS; level++) {
+    int segments = CIRCLE_LOD_MIN_SEGMENTS << level;
+    for (int i = 0; i <= segments; i++) {
+      float angle = 2 * PI * (i % segments) / segments;
+      circle_lods->unit_vertices[level][i] = (Vector2){cosf(angle), sinf(angle)};
+    }
+    // Each segment's chord comes closest to the centre at its midpoint, which is radius * cos(PI / segments) away
+    circle_lods->max_radii[level] = CIRCLE_MAX_ERROR_PIXELS / (1 - cosf(PI / segments));
+  }
+  circle_lods->level_bias = 0;
+}
+
+// Same as DrawCircleV, but with the number of segments picked from the radius in pixels rather than always being
+// 36, so small projectiles take fewer vertices and large circles stay smooth at high resolutions. Circles drawn to
+// a software canvas are filled exactly instead
+void draw_circle(Vector2 centre, float radius, Color colour, const Constants *constants) {
+  if (constants->software_canvas) {
+    software_canvas_fill_circle(constants->software_canvas, centre, radius, colour);
+    return;
+  }
+
+  const CircleLods *circle_lods = constants->circle_lods;
+  int level = 0;
+  while (level < CIRCLE_LOD_LEVELS - 1 && radius > circle_lods->max_radii[level]) level++;
+  level -= circle_lods->level_bias;
+  if (level < 0) level = 0;
+  int segments = CIRCLE_LOD_MIN_SEGMENTS << level;
+  const Vector2 *unit_vertices = circle_lods->unit_vertices[level];
+
+  rlCheckRenderBatchLimit(3 * segments);  // Flush the batch now rather than part way through the circle
+  rlBegin(RL_TRIANGLES);
+  rlColor4ub(colour.r, colour.g, colour.b, colour.a);
+  for (int i = 0; i < segments; i++) {
+    rlVertex2f(centre.x, centre.y);
+    rlVertex2f(centre.x + unit_vertices[i + 1].x * radius, centre.y + unit_vertices[i + 1].y * radius);
+    rlVertex2f(centre.x + unit_vertices[i].x * radius, centre.y + unit_vertices[i].y * radius);
+  }
+  rlEnd();
+}
+
+// Same as DrawRectangleV, but drawn to the software canvas if there is one
+void draw_rectangle_v(Vector2 position, Vector2 dimensions, Color colour, const Constants *constants) {
+  if (constants->software_canvas) {
+    software_canvas_fill_rectangle(constants->software_canvas, position, dimensions, colour);
+  } else {
+    DrawRectangleV(position, dimensions, colour);
+  }
+}
+
+// Same as DrawTextEx, but drawn in the software renderer's font to the software canvas if there is one
+void draw_text_ex(Font font, const char *text, Vector2 position, float size, float spacing, Color colour,
+                  const Constants *constants) {
+  if (constants->software_canvas) {
+    software_canvas_draw_text(constants->software_canvas, text, position, size, spacing, colour);
+  } else {
+    DrawTextEx(font, text, position, size, spacing, colour);
+  }
+}
+
 // Draw the player to the canvas
 void draw_player(const Player *player, Vector2 camera_position, const Constants *constants) {
   Vector2 offset_position = Vector2Subtract(player->pos, camera_position);
-  DrawCircleV(get_draw_position_from_unit_position(offset_position, constants),
-              get_draw_length_from_unit_length(player->size, constants), player->colour);
+  draw_circle(get_draw_position_from_unit_position(offset_position, constants),
+              get_draw_length_from_unit_length(player->size, constants), player->colour, constants);
 }
 
-// Draw the active enemies to the canvas
-void draw_enemies(const EnemyManager *enemy_manager, Vector2 camera_position, const Constants *constants) {
-  for (int i = 0, enemies_counted = 0; i < enemy_manager->capacity && enemies_counted < enemy_manager->capacity;
-       i++) {
-    Enemy this_enemy = enemy_manager->enemies[i];
-    if (!this_enemy.is_active) continue;
-
-    enemies_counted++;
-    if (!circle_is_on_screen(this_enemy.pos, this_enemy.size, camera_position, constants)) continue;
-
-    Vector2 offset_position = Vector2Subtract(this_enemy.pos, camera_position);
-    DrawCircleV(get_draw_position_from_unit_position(offset_position, constants),
-                get_draw_length_from_unit_length(this_enemy.size, constants), this_enemy.type->colour);
+// Draw the enemies on screen, visiting only those in the grid cells around the screen
+void draw_enemies(const EnemyManager *enemy_manager, const SpatialGrid *enemy_grid, const EnemyType *enemy_types,
+                  Vector2 camera_position, const Constants *constants) {
+  int min_column, min_row, max_column, max_row;
+  Vector2 screen_end = Vector2Add(camera_position, constants->screen_dimensions);
+  if (!spatial_grid_get_cell_range(enemy_grid, camera_position, screen_end, &min_column, &min_row, &max_column,
+                                   &max_row, constants))
+    return;
+
+  for (int row = min_row; row <= max_row; row++) {
+    int first_cell = row * enemy_grid->columns + min_column;
+    int last_cell = row * enemy_grid->columns + max_column;
+    for (int k = enemy_grid->cell_starts[first_cell]; k < enemy_grid->cell_starts[last_cell + 1]; k++) {
+      Enemy this_enemy = enemy_manager->enemies[enemy_grid->entries[k]];
+      if (!circle_is_on_screen(this_enemy.pos, this_enemy.size, camera_position, constants)) continue;
+
+      Vector2 offset_position = Vector2Subtract(this_enemy.pos, camera_position);
+      draw_circle(get_draw_position_from_unit_position(offset_position, constants),
+                  get_draw_length_from_unit_length(this_enemy.size, constants),
+                  enemy_types[this_enemy.type].colour, constants);
+    }
   }
 }
 
-void draw_boss(const Boss *boss, Vector2 camera_position, const Constants *constants) {
+void draw_boss(const Boss *boss, const BossType *boss_types, Vector2 camera_position, const Constants *constants) {
   if (!boss->is_active) return;
-  if (!circle_is_on_screen(boss->pos, boss->boss_type->size, camera_position, constants)) return;
+  const BossType *boss_type = boss_types + boss->type;
+  if (!circle_is_on_screen(boss->pos, boss_type->size, camera_position, constants)) return;
 
   Vector2 offset_position = Vector2Subtract(boss->pos, camera_position);
-  DrawCircleV(get_draw_position_from_unit_position(offset_position, constants),
-              get_draw_length_from_unit_length(boss->boss_type->size, constants), boss->boss_type->colour);
+  draw_circle(get_draw_position_from_unit_position(offset_position, constants),
+              get_draw_length_from_unit_length(boss_type->size, constants), boss_type->colour, constants);
 }
 
-// Draw the active projectiles to the canvas
-void draw_projectiles(const ProjectileManager *projectile_manager, Vector2 camera_position,
+// Draw the projectiles on screen, coloured according to their allegiance. Only the projectiles in the grid cells
+// around the screen are visited, so the grids must have been built for the same time
+void draw_projectiles(const ProjectileManager *projectile_manager, const SpatialGrid grids[NUM_ALLEGIANCES],
+                      const Color allegiance_colours[NUM_ALLEGIANCES], float time, Vector2 camera_position,
                       const Constants *constants) {
-  for (int i = 0, projectiles_counted = 0;
-       i < projectile_manager->capacity && projectiles_counted < projectile_manager->projectile_count; i++) {
-    Projectile this_projectile = projectile_manager->projectiles[i];
-    if (!this_projectile.is_active) continue;
-
-    projectiles_counted++;
-    if (!circle_is_on_screen(this_projectile.pos, this_projectile.size, camera_position, constants)) continue;
-
-    Vector2 offset_position = Vector2Subtract(this_projectile.pos, camera_position);
-    DrawCircleV(get_draw_position_from_unit_position(offset_position, constants),
-                get_draw_length_from_unit_length(this_projectile.size, constants), this_projectile.colour);
+  Vector2 screen_end = Vector2Add(camera_position, constants->screen_dimensions);
+  for (int a = 0; a < NUM_ALLEGIANCES; a++) {
+    const ProjectilePool *pool = projectile_manager->pools + a;
+    const SpatialGrid *grid = grids + a;
+    int min_column, min_row, max_column, max_row;
+    if (!spatial_grid_get_cell_range(grid, camera_position, screen_end, &min_column, &min_row, &max_column,
+                                     &max_row, constants))
+      continue;
+
+    for (int row = min_row; row <= max_row; row++) {
+      int first_cell = row * grid->columns + min_column;
+      int last_cell = row * grid->columns + max_column;
+      for (int k = grid->cell_starts[first_cell]; k < grid->cell_starts[last_cell + 1]; k++) {
+        Projectile this_projectile = pool->projectiles[grid->entries[k]];
+        Vector2 projectile_pos = projectile_get_position(&this_projectile, time);
+        if (!circle_is_on_screen(projectile_pos, this_projectile.size, camera_position, constants)) continue;
+
+        Vector2 offset_position = Vector2Subtract(projectile_pos, camera_position);
+        draw_circle(get_draw_position_from_unit_position(offset_position, constants),
+                    get_draw_length_from_unit_length(this_projectile.size, constants), allegiance_colours[a],
+                    constants);
+      }
+    }
   }
 }
 
@@ -1102,9 +5093,9 @@ void draw_background_squares(Vector2 camera_position, const Constants *constants
           Vector2Subtract(Vector2Scale((Vector2){x, y}, constants->background_square_size), camera_remainder);
       Vector2 square_dimensions = Vector2Scale(Vector2One(), constants->background_square_size);
 
-      DrawRectangleV(get_draw_position_from_unit_position(square_position, constants),
-                     get_draw_dimensions_from_unit_dimensions(square_dimensions, constants),
-                     constants->background_square_colour);
+      draw_rectangle_v(get_draw_position_from_unit_position(square_position, constants),
+                       get_draw_dimensions_from_unit_dimensions(square_dimensions, constants),
+                       constants->background_square_colour, constants);
     }
   }
 }
@@ -1117,23 +5108,26 @@ void draw_background_squares(Vector2 camera_position, const Constants *constants
 // Draw black bars on the screen to maintain the desired aspect ratio
 void draw_black_bars(const Constants *constants) {
   // Note I haven't used get_black_bar_size since we still need the screen width and height to draw the bars
-  float screen_width = GetScreenWidth();
-  float screen_height = GetScreenHeight();
+  float screen_width = get_screen_width(constants);
+  float screen_height = get_screen_height(constants);
   float aspect_ratio = screen_width / screen_height;
 
   // Don't draw black bars if the aspect ratios are (approximately) equal
   if (FloatEquals(aspect_ratio, constants->aspect_ratio)) return;
 
+  // Bars are whole pixels wide, as DrawRectangle takes integer coordinates
   if (aspect_ratio > constants->aspect_ratio) {  // If the window is too wide
-    float black_bar_width = 0.5 * (screen_width - constants->aspect_ratio * screen_height);
-    DrawRectangle(0, 0, black_bar_width, screen_height, constants->game_colours->black);
-    DrawRectangle(screen_width - black_bar_width, 0, black_bar_width, screen_height,
-                  constants->game_colours->black);
+    int black_bar_width = 0.5 * (screen_width - constants->aspect_ratio * screen_height);
+    Vector2 black_bar_dimensions = {black_bar_width, screen_height};
+    draw_rectangle_v((Vector2){0, 0}, black_bar_dimensions, constants->game_colours->black, constants);
+    draw_rectangle_v((Vector2){(int)(screen_width - black_bar_width), 0}, black_bar_dimensions,
+                     constants->game_colours->black, constants);
   } else {  // If the window is too tall
-    float black_bar_height = 0.5 * (screen_height - (1 / constants->aspect_ratio) * screen_width);
-    DrawRectangle(0, 0, screen_width, black_bar_height, constants->game_colours->black);
-    DrawRectangle(0, screen_height - black_bar_height, screen_width, black_bar_height,
-                  constants->game_colours->black);
+    int black_bar_height = 0.5 * (screen_height - (1 / constants->aspect_ratio) * screen_width);
+    Vector2 black_bar_dimensions = {screen_width, black_bar_height};
+    draw_rectangle_v((Vector2){0, 0}, black_bar_dimensions, constants->game_colours->black, constants);
+    draw_rectangle_v((Vector2){0, (int)(screen_height - black_bar_height)}, black_bar_dimensions,
+                     constants->game_colours->black, constants);
   }
 }
 // Same as DrawTextEx but with the text anchored
@@ -1142,8 +5136,8 @@ void draw_text_anchored(Font font, const char *text, Vector2 anchored_pos, float
   Vector2 text_dimensions = measure_text_ex_in_units(font, text, size, spacing, constants);
   Vector2 adjusted_pos = get_pos_from_anchored_vectors(anchored_pos, text_dimensions, anchor_type, constants);
 
-  DrawTextEx(font, text, get_draw_position_from_unit_position(adjusted_pos, constants),
-             get_draw_length_from_unit_length(size, constants), spacing, colour);
+  draw_text_ex(font, text, get_draw_position_from_unit_position(adjusted_pos, constants),
+               get_draw_length_from_unit_length(size, constants), spacing, colour, constants);
 }
 
 // Same as DrawTextEx, but with the text centred
@@ -1152,8 +5146,8 @@ void draw_text_centred(Font font, const char *text, Vector2 pos, float size, flo
   Vector2 text_dimensions = measure_text_ex_in_units(font, text, size, spacing, constants);
   Vector2 adjusted_pos = {pos.x - 0.5 * text_dimensions.x, pos.y - 0.5 * text_dimensions.y};
 
-  DrawTextEx(font, text, get_draw_position_from_unit_position(adjusted_pos, constants),
-             get_draw_length_from_unit_length(size, constants), spacing, colour);
+  draw_text_ex(font, text, get_draw_position_from_unit_position(adjusted_pos, constants),
+               get_draw_length_from_unit_length(size, constants), spacing, colour, constants);
 }
 
 // Same as DrawRectangleV, but with the rectangle anchored
@@ -1161,8 +5155,8 @@ void draw_anchored_rectangle_v(Vector2 anchored_pos, Vector2 dimensions, Color c
                                const Constants *constants) {
   Vector2 adjusted_pos = get_pos_from_anchored_vectors(anchored_pos, dimensions, anchor_type, constants);
 
-  DrawRectangleV(get_draw_position_from_unit_position(adjusted_pos, constants),
-                 get_draw_dimensions_from_unit_dimensions(dimensions, constants), colour);
+  draw_rectangle_v(get_draw_position_from_unit_position(adjusted_pos, constants),
+                   get_draw_dimensions_from_unit_dimensions(dimensions, constants), colour, constants);
 }
 
 // Same as DrawRectangleRec, but with the rectangle anchored
@@ -1198,8 +5192,10 @@ void draw_button(const Button *button, const Constants *constants) {
 
 // Draw score (and other stats if debug text button was pressed)
 void draw_game_info(const Player *player, const EnemyManager *enemy_manager,
-                    const ProjectileManager *projectile_manager, const Boss *boss, const Constants *constants,
-                    bool show_debug_text) {
+                    const ProjectileManager *projectile_manager, const Boss *boss, int snapshot_count,
+                    size_t snapshot_memory, const FrameTimeSummary *update_times,
+                    const FrameTimeSummary *draw_times, const FrameTimeSummary *input_latency, float time,
+                    const Constants *constants, bool show_debug_text, const QualitySettings *quality) {
   draw_text_anchored(constants->game_font, TextFormat("Score: %d", player->score), (Vector2){0.25, 0.25}, 0.4,
                      constants->font_spacing, constants->game_colours->black, ANCHOR_TOP_LEFT, constants);
   draw_text_anchored(constants->game_font, TextFormat("Boss points: %d", player->boss_points),
@@ -1208,6 +5204,9 @@ void draw_game_info(const Player *player, const EnemyManager *enemy_manager,
 
   if (!show_debug_text) return;
 
+  draw_text_anchored(constants->game_font, TextFormat("%d", GetFPS()), (Vector2){-0.25, 0.25}, 0.35,
+                     constants->font_spacing, constants->game_colours->green_2, ANCHOR_TOP_RIGHT, constants);
+
   float y_pos = 1.15;            // Vertical position of debug text (to allow for easier insertion of new text)
   float y_pos_increment = 0.25;  // Space between lines of debug text
 
@@ -1222,19 +5221,45 @@ void draw_game_info(const Player *player, const EnemyManager *enemy_manager,
                      ANCHOR_TOP_LEFT, constants);
   y_pos += y_pos_increment;
 
+  const ProjectilePool *player_projectiles = projectile_manager->pools + ALLEGIANCE_PLAYER;
+  const ProjectilePool *enemy_projectiles = projectile_manager->pools + ALLEGIANCE_ENEMIES;
+  draw_text_anchored(constants->game_font,
+                     TextFormat("Projectile count: %2d/%d (player), %2d/%d (enemies)",
+                                player_projectiles->projectile_count, player_projectiles->capacity,
+                                enemy_projectiles->projectile_count, enemy_projectiles->capacity),
+                     (Vector2){0.25, y_pos}, 0.25, constants->font_spacing, constants->game_colours->grey_5,
+                     ANCHOR_TOP_LEFT, constants);
+  y_pos += y_pos_increment;
+
+  draw_text_anchored(constants->game_font, TextFormat("Quality: %s", quality->name), (Vector2){0.25, y_pos}, 0.25,
+                     constants->font_spacing, constants->game_colours->grey_5, ANCHOR_TOP_LEFT, constants);
+  y_pos += y_pos_increment;
+
+  if (!quality->show_full_debug_text) return;  // The rest are left out to save time when frames are running slow
+
+  const char *pool_names[] = {"Enemy", "Player projectile", "Enemy projectile"};
+  const PoolStats *pool_stats[] = {&enemy_manager->stats, &player_projectiles->stats, &enemy_projectiles->stats};
+  size_t projectile_slot_size = sizeof(Projectile) + sizeof(ProjectileExpiry);
+  size_t pool_sizes[] = {enemy_manager->capacity * sizeof(Enemy),
+                         player_projectiles->capacity * projectile_slot_size,
+                         enemy_projectiles->capacity * projectile_slot_size};
+  for (int i = 0; i < 3; i++) {
+    draw_text_anchored(constants->game_font,
+                       TextFormat("%s pool: peak %d, %.1f KB, grew %d times (+%.1f KB)", pool_names[i],
+                                  pool_stats[i]->high_water, pool_sizes[i] / 1024.0, pool_stats[i]->grow_count,
+                                  pool_stats[i]->grown_bytes / 1024.0),
+                       (Vector2){0.25, y_pos}, 0.25, constants->font_spacing, constants->game_colours->grey_5,
+                       ANCHOR_TOP_LEFT, constants);
+    y_pos += y_pos_increment;
+  }
+
   draw_text_anchored(
       constants->game_font,
-      TextFormat("Projectile count: %2d/%d", projectile_manager->projectile_count, projectile_manager->capacity),
+      TextFormat("Enemy credits: %5.2f", enemy_manager_calculate_credits(enemy_manager, time, constants)),
       (Vector2){0.25, y_pos}, 0.25, constants->font_spacing, constants->game_colours->grey_5, ANCHOR_TOP_LEFT,
       constants);
   y_pos += y_pos_increment;
 
-  draw_text_anchored(constants->game_font,
-                     TextFormat("Enemy credits: %5.2f", enemy_manager_calculate_credits(enemy_manager, constants)),
-                     (Vector2){0.25, y_pos}, 0.25, constants->font_spacing, constants->game_colours->grey_5,
-                     ANCHOR_TOP_LEFT, constants);
-  y_pos += y_pos_increment;
-
   draw_text_anchored(constants->game_font, TextFormat("Score for next boss: %d", boss->score_for_next_spawn),
                      (Vector2){0.25, y_pos}, 0.25, constants->font_spacing, constants->game_colours->grey_5,
                      ANCHOR_TOP_LEFT, constants);
@@ -1257,14 +5282,30 @@ void draw_game_info(const Player *player, const EnemyManager *enemy_manager,
                      ANCHOR_TOP_LEFT, constants);
   y_pos += y_pos_increment;
 
-  draw_text_anchored(constants->game_font, TextFormat("%d", GetFPS()), (Vector2){-0.25, 0.25}, 0.35,
-                     constants->font_spacing, constants->game_colours->green_2, ANCHOR_TOP_RIGHT, constants);
+  draw_text_anchored(constants->game_font,
+                     TextFormat("Rewind snapshots: %d (%.1f KB)", snapshot_count, snapshot_memory / 1024.0),
+                     (Vector2){0.25, y_pos}, 0.25, constants->font_spacing, constants->game_colours->grey_5,
+                     ANCHOR_TOP_LEFT, constants);
+  y_pos += y_pos_increment;
+
+  const char *frame_time_labels[] = {"Update", "Draw",
+                                     constants->late_latch_aim ? "Latency (late latched)" : "Latency"};
+  const FrameTimeSummary *frame_time_summaries[] = {update_times, draw_times, input_latency};
+  for (int i = 0; i < 3; i++) {
+    const FrameTimeSummary *summary = frame_time_summaries[i];
+    draw_text_anchored(constants->game_font,
+                       TextFormat("%s ms: p50 %.2f, p95 %.2f, p99 %.2f, max %.2f", frame_time_labels[i],
+                                  summary->p50, summary->p95, summary->p99, summary->max),
+                       (Vector2){0.25, y_pos}, 0.25, constants->font_spacing, constants->game_colours->grey_5,
+                       ANCHOR_TOP_LEFT, constants);
+    y_pos += y_pos_increment;
+  }
 }
 
-void draw_boss_health_bar(const Boss *boss, const Constants *constants) {
+void draw_boss_health_bar(const Boss *boss, const BossType *boss_types, const Constants *constants) {
   if (!boss->is_active) return;
 
-  float health_fraction = boss->health / boss->boss_type->max_health;
+  float health_fraction = boss->health / boss_types[boss->type].max_health;
 
   Color health_colour = constants->boss_health_bar_colour;
   Color background_colour = constants->boss_health_bar_background_colour;
@@ -1351,6 +5392,12 @@ void draw_shop_purchase_buttons(Button *buttons_shop_purchase, const Shop *shop,
   }
 }
 
+// Draw the text shown over the game while it is paused
+void draw_paused_text(const Constants *constants) {
+  draw_text_anchored(constants->game_font, "PAUSED", (Vector2){0, 0}, 0.8, constants->font_spacing,
+                     constants->game_colours->grey_5, ANCHOR_CENTRE, constants);
+}
+
 // Draw the text in the game over screen
 void draw_game_over_text(const Player *player, const Constants *constants) {
   draw_text_anchored(constants->game_font, "GAME OVER", (Vector2){0, -3}, 0.8, constants->font_spacing,
@@ -1362,139 +5409,52 @@ void draw_game_over_text(const Player *player, const Constants *constants) {
 }
 /*---------------------------------------------------------------------------------------------------------------*/
 
+// Headless tools (such as the balance runner) include this file for the simulation and provide their own main
+#ifndef LOOP_SHOOTER_NO_MAIN
 int main() {
   /*--------------------------*/
   /* Constants initialisation */
   /*-------------------------------------------------------------------------------------------------------------*/
-  GameColours game_colours = {
-      .red_1 = GetColor(0xEF3939FF),
-      .red_2 = GetColor(0xCB1A1AFF),
-      .red_3 = GetColor(0x841616FF),
-
-      .blue_1 = GetColor(0x7BE0F7FF),
-      .blue_2 = GetColor(0x42A2E3FF),
-      .blue_3 = GetColor(0x344CC6FF),
-      .blue_4 = GetColor(0x2C257FFF),
-
-      .green_1 = GetColor(0xC9D844FF),
-      .green_2 = GetColor(0x89B431FF),
-      .green_3 = GetColor(0x38801DFF),
-      .yellow_1 = GetColor(0xFFD92FFF),
-      .yellow_2 = GetColor(0xDFB51CFF),
-      .yellow_3 = GetColor(0xC48C13FF),
-
-      .pink_1 = GetColor(0xF89EA9FF),
-      .pink_2 = GetColor(0xF26273FF),
-
-      .brown_1 = GetColor(0x7F4511FF),
-      .brown_2 = GetColor(0x5C3208FF),
-
-      .white = GetColor(0xF6F9FFFF),
-      .grey_1 = GetColor(0xDDE1E9FF),
-      .grey_2 = GetColor(0xBAC1CEFF),
-      .grey_3 = GetColor(0x90959DFF),
-      .grey_4 = GetColor(0x66696EFF),
-      .grey_5 = GetColor(0x45474AFF),
-      .grey_6 = GetColor(0x313133FF),
-      .black = GetColor(0x1A1B1BFF),
-  };
-
+  // Everything other than the layout of the screen comes from the content pack (see content/content.txt)
+  GameColours game_colours = {0};
+  CircleLods circle_lods;
+  circle_lods_init(&circle_lods);
   Constants constants = {.game_colours = &game_colours,
+                         .circle_lods = &circle_lods,
                          .initial_window_resolution = {1280, 720},
                          .aspect_ratio = 16.0 / 9.0,
-                         .screen_dimensions = {16, 9},
-                         .game_area_dimensions = {64, 64},
-                         .target_fps = 240,
-
-                         .player_start_pos = {0},
-                         .player_base_speed = 7,
-                         .player_base_size = 0.33,
-                         .player_colour = game_colours.brown_1,
-
-                         .player_base_firerate = 2,
-                         .player_base_projectile_speed = 8,
-                         .player_base_projectile_size = 0.12,
-                         .player_base_projectile_damage = 1.0,
-                         .player_projectile_colour = game_colours.grey_5,
-
-                         .upgrade_cost_multiplier = 1.5,
-
-                         .initial_max_enemies = 100,
-                         .num_enemy_types = 5,
-                         .enemy_spawn_interval_min = 3.5,
-                         .enemy_spawn_interval_max = 4.5,
-                         .enemy_first_spawn_interval = 1.0,
-                         .enemy_spawn_min_wave_size = 3,
-                         .enemy_spawn_additional_enemy_chance = 0.3,
-                         .initial_enemy_credits = 2.8,
-                         .enemy_credit_multiplier = 0.3,
-                         .enemy_credit_exponent = 1.7,
-
-                         .enemy_update_interval = 0.1,
-                         .enemy_update_chance = 0.4,
-
-                         .initial_max_projectiles = 40,
-
-                         .font_spacing = 2,
-                         .background_square_size = 2,
-                         .background_colour = game_colours.white,
-                         .background_square_colour = game_colours.grey_1,
-                         .boss_health_bar_colour = game_colours.red_3,
-                         .boss_health_bar_background_colour = game_colours.black,
-                         .boss_health_bar_opacity = 180};
-
-  const EnemyType enemy_types[] = {{.credit_cost = 1,
-                                    .min_speed = 2.5,
-                                    .max_speed = 3,
-                                    .min_size = 0.27,
-                                    .max_size = 0.29,
-                                    .colour = game_colours.red_1,
-                                    .turns_into = NULL},
-                                   {.credit_cost = 3,
-                                    .min_speed = 3,
-                                    .max_speed = 3.5,
-                                    .min_size = 0.28,
-                                    .max_size = 0.31,
-                                    .colour = game_colours.blue_2,
-                                    .turns_into = enemy_types + 0},
-                                   {.credit_cost = 7,
-                                    .min_speed = 3.5,
-                                    .max_speed = 4,
-                                    .min_size = 0.30,
-                                    .max_size = 0.34,
-                                    .colour = game_colours.green_2,
-                                    .turns_into = enemy_types + 1},
-                                   {.credit_cost = 12,
-                                    .min_speed = 4,
-                                    .max_speed = 4.5,
-                                    .min_size = 0.35,
-                                    .max_size = 0.4,
-                                    .colour = game_colours.yellow_2,
-                                    .turns_into = enemy_types + 2},
-                                   {.credit_cost = 19,
-                                    .min_speed = 4.5,
-                                    .max_speed = 5.5,
-                                    .min_size = 0.37,
-                                    .max_size = 0.44,
-                                    .colour = game_colours.pink_2,
-                                    .turns_into = enemy_types + 3}};
-
-  const BossType red_boss = {.initial_score_to_spawn = 50,
-                             .max_health = 20,
-                             .speed = 5,
-                             .size = 2.5,
-                             .colour = game_colours.red_2,
-                             .firerate = 4,
-                             .shots_per_burst = 7,
-                             .projectile_speed = 6,
-                             .projectile_size = 0.2,
-                             .projectile_colour = game_colours.red_3,
-                             .moving_duration = 2,
-                             .stationary_duration = 2,
-                             .num_enemies_spawned_on_defeat = 4,
-                             .enemy_type_spawned_on_defeat = enemy_types + 4,
-                             .boss_points_on_defeat = 3,
-                             .score_on_defeat = 20};
+                         .screen_dimensions = {16, 9}};
+  EnemyType enemy_types[MAX_ENEMY_TYPES] = {0};
+  BossType boss_types[1] = {0};  // Only the red boss for now
+
+  // The game state and shop are set up here since upgrades change the player's stats
+  GameState game_state = {0};
+  Player *player = &game_state.player;
+  Upgrade shop_upgrades[PACK_NUM_UPGRADE_STATS] = {0};
+  Shop shop = {.money = 0,
+               .boss_points = 0,
+               .upgrades = shop_upgrades,
+               .num_upgrades = sizeof shop_upgrades / sizeof *shop_upgrades};
+
+  if (!content_pack_load(CONTENT_PACK_PATH, &game_colours, &constants, enemy_types, boss_types, &shop, player,
+                         false)) {
+    fprintf(stderr, "Unable to load content from %s.\n", CONTENT_PACK_PATH);
+    exit(EXIT_FAILURE);
+  }
+
+  // Settings for the simulation and rewinding, which aren't part of the content pack
+  constants.simulation_rate = 120;
+  constants.idle_fps = 10;
+  constants.rewind_duration = 5;
+  constants.snapshot_rate = 60;
+  constants.snapshot_keyframe_interval = 30;
+  constants.replay_keyframe_interval = 10;
+
+  // Setting LOOP_SHOOTER_LATE_LATCH turns on late latching of the aim (debug builds can also toggle it with L)
+  constants.late_latch_aim = getenv("LOOP_SHOOTER_LATE_LATCH") != NULL;
+
+  ContentPackWatcher content_pack_watcher;
+  content_pack_watcher_init(&content_pack_watcher, CONTENT_PACK_PATH);
   /*-------------------------------------------------------------------------------------------------------------*/
 
   /*-------------------*/
@@ -1583,33 +5543,96 @@ int main() {
   /*----------------------------*/
   /* Game object initialisation */
   /*-------------------------------------------------------------------------------------------------------------*/
-  Player player = {0};
-  EnemyManager enemy_manager = {0};
-  ProjectileManager projectile_manager = {0};
-  Boss boss = {.boss_type = &red_boss};
-
-  Upgrade shop_upgrades[] = {
-      {UPGRADE_TYPE_MONEY, 100, 0.25, constants.player_base_firerate, &player.firerate},
-      {UPGRADE_TYPE_MONEY, 50, 0.3, constants.player_base_projectile_speed, &player.projectile_speed},
-      {UPGRADE_TYPE_MONEY, 30, 0.2, constants.player_base_projectile_size, &player.projectile_size},
-      {UPGRADE_TYPE_BOSS_POINTS, 3, 0.5, constants.player_base_projectile_damage, &player.projectile_damage}};
-  Shop shop = {.money = 0,
-               .boss_points = 0,
-               .upgrades = shop_upgrades,
-               .num_upgrades = sizeof shop_upgrades / sizeof *shop_upgrades};
+  EnemyManager *enemy_manager = &game_state.enemy_manager;
+  ProjectileManager *projectile_manager = &game_state.projectile_manager;
+
+  initialise_game(player, enemy_manager, projectile_manager, &constants);
+  save_load(SAVE_PATH, &shop, player, &constants);  // Needs to come after the player's base stats are set
+
+  SaveWriter save_writer;
+  save_writer_init(&save_writer);
+
+  PoolSizing pool_sizing = {0};  // Pool usage in recent games, for sizing the pools in the next one
 
-  initialise_game(&player, &enemy_manager, &projectile_manager, &constants);
+  SnapshotRing snapshot_ring;
+  snapshot_ring_init(&snapshot_ring, &constants);
 
-  Vector2 camera_position;
+  // Setting LOOP_SHOOTER_STREAM to a socket path streams each game to a viewer there (see stream_viewer.c)
+  StateStream state_stream;
+  state_stream_open(&state_stream, getenv("LOOP_SHOOTER_STREAM"));
+
+  // Each game is recorded to a replay, along with the content pack it is played with
+  ReplayWriter replay_writer = {0};
+  replay_writer_set_content(&replay_writer, CONTENT_PACK_PATH);
+
+  // While the game screen is shown the simulation runs on its own thread, and this thread only draws its frames
+  SimulationThread simulation_thread;
+  simulation_thread_init(&simulation_thread, &game_state, &snapshot_ring, &state_stream, &replay_writer,
+                         enemy_types, boss_types, &constants);
+  RenderFrame *game_frame = NULL;        // Most recent frame from the simulation thread
+  FrameTimeHistogram draw_times = {0};   // Time taken to build each game screen frame this game
+  InputLatency input_latency = {0};      // Latency of each game screen frame this game
+  LateLatch late_latch = {0};            // Late aims sent this game (see Constants.late_latch_aim)
+  bool is_rewinding = false;             // Whether the debug rewind key is held
+
+  // Particles are only drawn, so they are simulated on this thread from the bursts the simulation thread sends
+  ParticleSystem particles;
+  particle_system_init(&particles, PARTICLE_CAPACITY, GetRandomValue(0, INT_MAX));
+
+  // Quality is stepped down while frames are running over budget, and kept between games
+  FrameGovernor frame_governor;
+  frame_governor_init(&frame_governor);
+  QualitySettings quality = quality_get_settings(frame_governor.level);
 
   bool show_debug_text = false;
   GameScreen game_screen = GAME_SCREEN_START;
+  bool is_game_paused = false;  // Whether the game is paused because the window is minimised or in the background
+  FramePacing frame_pacing = FRAME_PACING_CONTINUOUS;
+
+  // CPU usage is measured for each screen (with pausing counted separately) and printed in debug builds
+  GameScreen measured_screen = game_screen;
+  bool measured_is_paused = is_game_paused;
+  clock_t measurement_cpu_start = clock();
+  double measurement_wall_start = GetTime();
   /*-------------------------------------------------------------------------------------------------------------*/
 
   while (!WindowShouldClose()) {
+    /*--------------------*/
+    /* Content hot reload */
+    /*-----------------------------------------------------------------------------------------------------------*/
+    if (content_pack_watcher_poll(&content_pack_watcher)) {
+      // The simulation thread reads the content while it runs, so it is stopped while the pack is reloaded
+      bool is_simulating = simulation_thread.is_running;
+      simulation_thread_stop(&simulation_thread);
+
+      if (content_pack_load(CONTENT_PACK_PATH, &game_colours, &constants, enemy_types, boss_types, &shop, player,
+                            true)) {
+        // Stats that can't be upgraded are taken straight from the new constants (upgraded ones were recomputed)
+        player->speed = constants.player_base_speed;
+        player->size = constants.player_base_size;
+        player->colour = constants.player_colour;
+        player->projectile_colour = constants.player_projectile_colour;
+        SetTargetFPS(frame_pacing == FRAME_PACING_IDLE ? constants.idle_fps : constants.target_fps);
+        frame_governor_restart_window(&frame_governor);  // The frame budget may have changed
+
+        // A replay can only hold one content pack, so the current game's recording ends here
+        replay_writer_finish(&replay_writer);
+        replay_writer_set_content(&replay_writer, CONTENT_PACK_PATH);
+        if (DEBUG >= 1) printf("Reloaded content from %s\n", CONTENT_PACK_PATH);
+      }
+
+      if (is_simulating) {
+        simulation_thread_start(&simulation_thread);
+        game_frame = render_frame_buffer_acquire(&simulation_thread.frame_buffer);
+      }
+    }
+    /*-----------------------------------------------------------------------------------------------------------*/
+
     /*--------*/
     /* Update */
     /*-----------------------------------------------------------------------------------------------------------*/
+    bool is_window_in_background = IsWindowMinimized() || !IsWindowFocused();
+
     switch (game_screen) {
       /*---------------------*/
       /* Start screen update */
@@ -1620,7 +5643,20 @@ int main() {
           button_start_screen_start.was_pressed = false;
 
           game_screen = GAME_SCREEN_GAME;
-          start_game(&player, &enemy_manager, &projectile_manager, &boss, &constants);
+          uint64_t seed = ((uint64_t)GetRandomValue(0, INT_MAX) << 31) ^ GetRandomValue(0, INT_MAX);
+          start_game(&game_state, boss_types, seed, &pool_sizing, &constants);
+          snapshot_ring_clear(&snapshot_ring);
+          state_stream_reset(&state_stream);
+          replay_writer_start(&replay_writer, REPLAY_PATH, &constants);
+          simulation_thread.update_times = (FrameTimeHistogram){0};
+          draw_times = (FrameTimeHistogram){0};
+          input_latency = (InputLatency){0};
+          frame_governor_restart_window(&frame_governor);
+          particles.count = 0;
+          simulation_thread.particle_bursts.tail = simulation_thread.particle_bursts.head;  // From the last game
+          simulation_thread_start(&simulation_thread);
+          game_frame = render_frame_buffer_acquire(&simulation_thread.frame_buffer);
+          late_latch_reset(&late_latch, game_frame);
         }
 
         button_check_user_interaction(&button_start_screen_shop, &constants);
@@ -1636,38 +5672,55 @@ int main() {
       /* Game screen update */
       /*---------------------------------------------------------------------------------------------------------*/
       case GAME_SCREEN_GAME:
-        player_update_position(&player, &constants);
-        camera_update_position(&camera_position, &player, &constants);
-        player_try_to_fire_projectile(&player, &projectile_manager, camera_position, &constants);
-
-        enemy_manager_try_to_spawn_enemies(&enemy_manager, enemy_types, &player, camera_position, &constants);
-        enemy_manager_update_desired_positions(&enemy_manager, &player, &constants);
-        enemy_manager_update_enemy_positions(&enemy_manager, &player);
-
-        boss_try_to_spawn(&boss, &player, camera_position, &constants);
-        boss_try_to_switch_states(&boss, &player);
-        boss_update_position(&boss, &player);
-        boss_try_to_fire_projectile(&boss, &projectile_manager, &player);
-
-        projectile_manager_check_for_collisions(&projectile_manager, &enemy_manager, &player, &boss);
-        projectile_manager_update_projectile_positions(&projectile_manager, camera_position, &constants);
-
-        boss_check_for_defeat(&boss, &player, &enemy_manager);
-        player_check_for_defeat(&player, game_screen);
-
-        if (player.is_defeated) {
-          if (player.is_invincible) {
-            player.is_defeated = false;
+        // The simulation is stopped while the window is minimised or in the background, and resumes when it's back
+        if (is_window_in_background != is_game_paused) {
+          is_game_paused = is_window_in_background;
+          if (is_game_paused) {
+            simulation_thread_stop(&simulation_thread);
           } else {
-            end_game(&player, &enemy_manager, &projectile_manager, &shop);
-            game_screen = GAME_SCREEN_END;
+            simulation_thread_start(&simulation_thread);
+            game_frame = render_frame_buffer_acquire(&simulation_thread.frame_buffer);
+            late_latch_reset(&late_latch, game_frame);
+            frame_governor_restart_window(&frame_governor);
           }
         }
 
+        // Input is sent to the simulation thread (mouse positions are relative to the frame the player can see)
+        if (!is_game_paused) {
+          Vector2 camera_position = game_frame->game_state.camera_position;
+          is_rewinding = IsKeyDown(KEY_R) && DEBUG >= 1;
+          input_queue_push(&simulation_thread.input_queue,
+                           &(InputMessage){.player_input = player_input_read(camera_position, &constants),
+                                           .is_rewinding = is_rewinding,
+                                           .toggle_invincibility = IsKeyPressed(KEY_I) && DEBUG >= 1,
+                                           .add_score = IsKeyPressed(KEY_P) && DEBUG >= 1,
+                                           .sample_time = GetTime()});
+        }
+
+        game_frame = render_frame_buffer_acquire(&simulation_thread.frame_buffer);
+        if (!is_game_paused) {
+          ParticleBurst burst;
+          while (particle_burst_queue_pop(&simulation_thread.particle_bursts, &burst))
+            particle_system_spawn_burst(&particles, &burst);
+          particle_system_update(&particles, GetFrameTime());
+        }
+        if (game_frame->is_game_over) {
+          simulation_thread_stop(&simulation_thread);
+          end_game(player, enemy_manager, projectile_manager, &shop, &pool_sizing, &constants);
+          save_writer_request(&save_writer, &shop);
+          if (!frame_time_report_write(FRAME_TIME_REPORT_PATH, &simulation_thread.update_times, &draw_times,
+                                       player, game_state.time))
+            fprintf(stderr, "Unable to write frame time report %s.\n", FRAME_TIME_REPORT_PATH);
+          if (DEBUG >= 1) state_stream_report(&state_stream, &constants);
+          if (DEBUG >= 1) input_latency_report(&input_latency);
+          replay_writer_finish(&replay_writer);
+          game_screen = GAME_SCREEN_END;
+          is_game_paused = false;
+        }
+
         // Debug keymaps
         if (IsKeyPressed(KEY_B) && DEBUG >= 1) show_debug_text = !show_debug_text;
-        if (IsKeyPressed(KEY_I) && DEBUG >= 1) player.is_invincible = !player.is_invincible;
-        if (IsKeyPressed(KEY_P) && DEBUG >= 1) player.score += 50;
+        if (IsKeyPressed(KEY_L) && DEBUG >= 1) constants.late_latch_aim = !constants.late_latch_aim;
         break;
       /*---------------------------------------------------------------------------------------------------------*/
 
@@ -1688,7 +5741,8 @@ int main() {
           if (this_purchase_button->was_pressed) {
             this_purchase_button->was_pressed = false;
 
-            shop_try_to_purchase_upgrade(&shop, shop.upgrades + i, &constants);
+            if (shop_try_to_purchase_upgrade(&shop, shop.upgrades + i, player, &constants))
+              save_writer_request(&save_writer, &shop);
           }
         }
 
@@ -1711,11 +5765,35 @@ int main() {
         break;
         /*-------------------------------------------------------------------------------------------------------*/
     }
+
+    // Menus are static unless the user does something, so they are only redrawn on input (content pack changes are
+    // then picked up with the next input too). The window being in the background only slows drawing down during a
+    // game, since the menus already don't draw without input
+    if (game_screen != GAME_SCREEN_GAME) {
+      frame_pacing_set(&frame_pacing, FRAME_PACING_EVENT_DRIVEN, &constants);
+    } else {
+      frame_pacing_set(&frame_pacing, is_game_paused ? FRAME_PACING_IDLE : FRAME_PACING_CONTINUOUS, &constants);
+    }
+
+    if (DEBUG >= 1 && (game_screen != measured_screen || is_game_paused != measured_is_paused)) {
+      const char *screen_names[] = {[GAME_SCREEN_START] = "start screen",
+                                    [GAME_SCREEN_GAME] = "game screen",
+                                    [GAME_SCREEN_SHOP] = "shop screen",
+                                    [GAME_SCREEN_END] = "end screen"};
+      print_cpu_usage(measured_is_paused ? "game screen (paused)" : screen_names[measured_screen],
+                      measurement_cpu_start, measurement_wall_start);
+      measured_screen = game_screen;
+      measured_is_paused = is_game_paused;
+      measurement_cpu_start = clock();
+      measurement_wall_start = GetTime();
+    }
     /*-----------------------------------------------------------------------------------------------------------*/
 
     /*---------*/
     /* Drawing */
     /*-----------------------------------------------------------------------------------------------------------*/
+    // Only the time spent building the frame is measured, not EndDrawing waiting for the next frame to be due
+    double draw_start_time = GetTime();
     BeginDrawing();
     {
       ClearBackground(constants.background_colour);
@@ -1733,23 +5811,45 @@ int main() {
         /*---------------------*/
         /* Game screen drawing */
         /*-------------------------------------------------------------------------------------------------------*/
-        case GAME_SCREEN_GAME:
-          draw_background_squares(camera_position, &constants);
-          draw_projectiles(&projectile_manager, camera_position, &constants);
-          draw_enemies(&enemy_manager, camera_position, &constants);
-          draw_boss(&boss, camera_position, &constants);
-          draw_player(&player, camera_position, &constants);
-
-          draw_game_info(&player, &enemy_manager, &projectile_manager, &boss, &constants, show_debug_text);
-          draw_boss_health_bar(&boss, &constants);
+        case GAME_SCREEN_GAME: {
+          // Latching is done before anything is drawn, since raylib only submits its batch in EndDrawing
+          if (constants.late_latch_aim && !is_game_paused && !is_rewinding)
+            late_latch_aim(&late_latch, game_frame, &simulation_thread.input_queue, &constants);
+          else
+            late_latch_reset(&late_latch, game_frame);
+
+          const GameState *drawn = &game_frame->game_state;  // The game state belongs to the simulation thread
+          if (quality.draw_background) draw_background_squares(drawn->camera_position, &constants);
+          draw_projectiles(&drawn->projectile_manager, game_frame->projectile_grids,
+                           (Color[]){[ALLEGIANCE_PLAYER] = drawn->player.projectile_colour,
+                                     [ALLEGIANCE_ENEMIES] = boss_types[drawn->boss.type].projectile_colour},
+                           drawn->time, drawn->camera_position, &constants);
+          draw_enemies(&drawn->enemy_manager, &game_frame->enemy_grid, enemy_types, drawn->camera_position,
+                       &constants);
+          draw_boss(&drawn->boss, boss_types, drawn->camera_position, &constants);
+          particle_system_draw(&particles, drawn->camera_position, &constants);
+          draw_player(&drawn->player, drawn->camera_position, &constants);
+
+          FrameTimeSummary draw_time_summary = {0}, input_latency_summary = {0};
+          if (show_debug_text && quality.show_full_debug_text) {
+            draw_time_summary = frame_time_histogram_summarise(&draw_times);
+            input_latency_summary = frame_time_histogram_summarise(&input_latency.total);
+          }
+          draw_game_info(&drawn->player, &drawn->enemy_manager, &drawn->projectile_manager, &drawn->boss,
+                         game_frame->snapshot_count, game_frame->snapshot_memory, &game_frame->update_times,
+                         &draw_time_summary, &input_latency_summary, drawn->time, &constants, show_debug_text,
+                         &quality);
+          draw_boss_health_bar(&drawn->boss, boss_types, &constants);
+          if (is_game_paused) draw_paused_text(&constants);
           break;
+        }
         /*-------------------------------------------------------------------------------------------------------*/
 
         /*---------------------*/
         /* Shop screen drawing */
         /*-------------------------------------------------------------------------------------------------------*/
         case GAME_SCREEN_SHOP:
-          draw_shop_text(&shop, &player, &constants);
+          draw_shop_text(&shop, player, &constants);
           draw_shop_purchase_buttons(buttons_shop_purchase, &shop, &constants);
           draw_button(&button_shop_screen_back, &constants);
           break;
@@ -1759,7 +5859,7 @@ int main() {
         /* End screen drawing */
         /*-------------------------------------------------------------------------------------------------------*/
         case GAME_SCREEN_END:
-          draw_game_over_text(&player, &constants);
+          draw_game_over_text(player, &constants);
           draw_button(&button_end_screen_back, &constants);
           break;
           /*-----------------------------------------------------------------------------------------------------*/
@@ -1767,17 +5867,41 @@ int main() {
 
       draw_black_bars(&constants);
     }
+    bool is_measuring_game_frame = game_screen == GAME_SCREEN_GAME && !is_game_paused;
+    double submit_time = GetTime();
+    if (is_measuring_game_frame) {
+      double draw_time = submit_time - draw_start_time;
+      frame_time_histogram_record(&draw_times, draw_time);
+      if (frame_governor_record(&frame_governor, GetFrameTime(), draw_time, &constants)) {
+        quality = quality_get_settings(frame_governor.level);
+        quality_settings_apply(&quality, &circle_lods, &simulation_thread);
+      }
+    }
     EndDrawing();
+
+    // EndDrawing swaps the frame's buffer, then waits out the rest of the frame for SetTargetFPS and polls input
+    // before returning. The swap can't be timed on its own here, so this stage includes the frame limiter wait
+    if (is_measuring_game_frame)
+      input_latency_record(&input_latency, game_frame, late_latch.aim_sample_time, submit_time, GetTime());
     /*-----------------------------------------------------------------------------------------------------------*/
   }
 
   /*---------*/
   /* Cleanup */
   /*-------------------------------------------------------------------------------------------------------------*/
+  simulation_thread_stop(&simulation_thread);
   CloseWindow();
 
-  cleanup_game(&enemy_manager, &projectile_manager);
+  simulation_thread_cleanup(&simulation_thread);
+  cleanup_game(enemy_manager, projectile_manager);
+  snapshot_ring_cleanup(&snapshot_ring);
+  state_stream_close(&state_stream);
+  replay_writer_cleanup(&replay_writer);
+  particle_system_cleanup(&particles);
+  content_pack_watcher_cleanup(&content_pack_watcher);
+  save_writer_cleanup(&save_writer);
 
   return EXIT_SUCCESS;
   /*-------------------------------------------------------------------------------------------------------------*/
 }
+#endif
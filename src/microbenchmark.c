@@ -0,0 +1,330 @@
+// Times helper functions which are called thousands of times per frame, on randomised inputs, and compares each
+// against a baseline from an earlier run. Exits with failure if any is slower than its baseline by more than the
+// threshold, so it can run as a test, e.g.
+//
+//   microbenchmark -b microbenchmark_baselines.txt -t 0.3
+//
+// Kernels with no baseline yet have theirs recorded, and the run exits with BENCHMARK_SKIPPED rather than success,
+// since nothing was compared (CTest reports it as skipped). -u rewrites every baseline (after an intentional
+// change) and succeeds. Each kernel is timed in many short runs and the fastest kept, since noise only ever makes
+// runs slower. Run with -h for options
+#define LOOP_SHOOTER_NO_MAIN
+#include "game.c"
+
+#include <time.h>
+
+#define BENCHMARK_INPUTS 4096          // Randomised inputs per kernel, which calls cycle through. Power of two
+#define BENCHMARK_CALLS (1 << 18)      // Calls to a kernel in each timed run
+#define BENCHMARK_REPETITIONS 41       // Timed runs of each kernel
+#define BENCHMARK_ATTEMPTS 3           // Most times a kernel is timed before it is reported as a regression
+#define BENCHMARK_MAX_KERNELS 32       // Most kernels a baseline file can hold
+#define BENCHMARK_MAX_NAME_LENGTH 63   // Longest kernel name in a baseline file
+#define BENCHMARK_SKIPPED 77           // Exit status when baselines were missing and have been recorded
+
+// Inputs for the kernels, generated once so every run sees the same values
+typedef struct BenchmarkInputs {
+  Vector2 positions[BENCHMARK_INPUTS];         // Positions spread over and a little beyond the game area
+  Vector2 camera_positions[BENCHMARK_INPUTS];  // Camera positions within the game area
+  float radii[BENCHMARK_INPUTS];               // Radii of the sizes used for projectiles up to the boss
+  float times[BENCHMARK_INPUTS];               // Game times from the first ten minutes
+  Constants constants;  // Copy of the game's constants, at the same offset every run (unlike the stack)
+  EnemyManager enemy_manager;  // Enemy manager part way through a game (only the credit fields are used)
+  RandomState random;
+} BenchmarkInputs;
+
+// A kernel makes `num_calls` calls to the function it times, cycling through the inputs, and returns a sum of the
+// results so the calls can't be optimised away
+typedef struct Kernel {
+  const char *name;
+  double (*run)(BenchmarkInputs *inputs, int num_calls);
+} Kernel;
+
+// Time per call for each kernel in a baseline file
+typedef struct Baselines {
+  char names[BENCHMARK_MAX_KERNELS][BENCHMARK_MAX_NAME_LENGTH + 1];
+  double nanoseconds[BENCHMARK_MAX_KERNELS];
+  int count;
+} Baselines;
+
+volatile double benchmark_sink;  // Where the kernels' results go, so the calls aren't optimised away
+
+/*-----------*/
+/* Utilities */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+double get_wall_time() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void benchmark_inputs_init(BenchmarkInputs *inputs, const Constants *constants) {
+  RandomState random;
+  random_seed(&random, 1);
+
+  Vector2 max_position = Vector2Scale(constants->game_area_dimensions, 0.55);
+  Vector2 min_camera = Vector2Scale(constants->game_area_dimensions, -0.5);
+  Vector2 max_camera = Vector2Subtract(Vector2Negate(min_camera), constants->screen_dimensions);
+  for (int i = 0; i < BENCHMARK_INPUTS; i++) {
+    inputs->positions[i] = (Vector2){get_random_float(&random, -max_position.x, max_position.x),
+                                     get_random_float(&random, -max_position.y, max_position.y)};
+    inputs->camera_positions[i] = (Vector2){get_random_float(&random, min_camera.x, max_camera.x),
+                                            get_random_float(&random, min_camera.y, max_camera.y)};
+    inputs->radii[i] = get_random_float(&random, 0.1, 2.5);
+    inputs->times[i] = get_random_float(&random, 0, 600);
+  }
+  inputs->constants = *constants;
+  inputs->enemy_manager = (EnemyManager){.credits_spent = 500, .time_of_initialisation = 0};
+  random_seed(&inputs->random, 2);
+}
+/*---------------------------------------------------------------------------------------------------------------*/
+
+/*---------*/
+/* Kernels */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+// Without a window the screen size is 0, so this times the function's path for that case rather than a real one
+double run_get_draw_position_from_unit_position(BenchmarkInputs *inputs, int num_calls) {
+  double sum = 0;
+  for (int i = 0; i < num_calls; i++) {
+    Vector2 draw_position =
+        get_draw_position_from_unit_position(inputs->positions[i & (BENCHMARK_INPUTS - 1)], &inputs->constants);
+    sum += draw_position.x + draw_position.y;
+  }
+  return sum;
+}
+
+double run_circle_is_on_screen(BenchmarkInputs *inputs, int num_calls) {
+  int count = 0;
+  for (int i = 0; i < num_calls; i++) {
+    int j = i & (BENCHMARK_INPUTS - 1);
+    count += circle_is_on_screen(inputs->positions[j], inputs->radii[j], inputs->camera_positions[j],
+                                 &inputs->constants);
+  }
+  return count;
+}
+
+double run_circle_is_in_game_area(BenchmarkInputs *inputs, int num_calls) {
+  int count = 0;
+  for (int i = 0; i < num_calls; i++) {
+    int j = i & (BENCHMARK_INPUTS - 1);
+    count += circle_is_in_game_area(inputs->positions[j], inputs->radii[j], &inputs->constants);
+  }
+  return count;
+}
+
+double run_get_random_float(BenchmarkInputs *inputs, int num_calls) {
+  double sum = 0;
+  for (int i = 0; i < num_calls; i++) sum += get_random_float(&inputs->random, -1, 1);
+  return sum;
+}
+
+double run_enemy_manager_calculate_credits(BenchmarkInputs *inputs, int num_calls) {
+  double sum = 0;
+  for (int i = 0; i < num_calls; i++) {
+    sum += enemy_manager_calculate_credits(&inputs->enemy_manager, inputs->times[i & (BENCHMARK_INPUTS - 1)],
+                                           &inputs->constants);
+  }
+  return sum;
+}
+
+// Time a kernel, returning the fastest time per call of its runs (in nanoseconds)
+double kernel_time(const Kernel *kernel, BenchmarkInputs *inputs) {
+  benchmark_sink = kernel->run(inputs, BENCHMARK_CALLS);  // Warm up the caches and branch predictors
+
+  double fastest = INFINITY;
+  for (int i = 0; i < BENCHMARK_REPETITIONS; i++) {
+    double start_time = get_wall_time();
+    benchmark_sink = kernel->run(inputs, BENCHMARK_CALLS);
+    double seconds = get_wall_time() - start_time;
+    if (seconds < fastest) fastest = seconds;
+  }
+  return 1e9 * fastest / BENCHMARK_CALLS;
+}
+/*---------------------------------------------------------------------------------------------------------------*/
+
+/*-----------*/
+/* Baselines */
+/*---------------------------------------------------------------------------------------------------------------*/
+
+// Read a baseline file, made of lines of a kernel name and its time per call in nanoseconds. A missing file is
+// treated as empty, so the first run on a machine records the baselines. Returns false if the file is malformed
+bool baselines_load(const char *path, Baselines *baselines) {
+  *baselines = (Baselines){0};
+  FILE *file = fopen(path, "r");
+  if (!file) return true;
+
+  char name[BENCHMARK_MAX_NAME_LENGTH + 1];
+  double nanoseconds;
+  int num_read;
+  bool is_valid = true;
+  while ((num_read = fscanf(file, "%63s %lf", name, &nanoseconds)) == 2) {
+    if (baselines->count == BENCHMARK_MAX_KERNELS) {
+      is_valid = false;
+      break;
+    }
+    strcpy(baselines->names[baselines->count], name);
+    baselines->nanoseconds[baselines->count] = nanoseconds;
+    baselines->count++;
+  }
+  if (num_read != EOF) is_valid = false;
+
+  fclose(file);
+  return is_valid;
+}
+
+// Write every baseline to a file, replacing it. Returns whether it was written successfully
+bool baselines_save(const char *path, const Baselines *baselines) {
+  FILE *file = fopen(path, "w");
+  if (!file) return false;
+
+  for (int i = 0; i < baselines->count; i++)
+    fprintf(file, "%s %.4f\n", baselines->names[i], baselines->nanoseconds[i]);
+  return fclose(file) == 0;
+}
+
+// Get the index of a kernel's baseline, or -1 if it has none
+int baselines_find(const Baselines *baselines, const char *name) {
+  for (int i = 0; i < baselines->count; i++) {
+    if (strcmp(baselines->names[i], name) == 0) return i;
+  }
+  return -1;
+}
+
+// Set a kernel's baseline, adding it if it has none. Returns false if there is no room for another
+bool baselines_set(Baselines *baselines, const char *name, double nanoseconds) {
+  int i = baselines_find(baselines, name);
+  if (i < 0) {
+    if (baselines->count == BENCHMARK_MAX_KERNELS) return false;
+    i = baselines->count++;
+    snprintf(baselines->names[i], sizeof baselines->names[i], "%s", name);
+  }
+  baselines->nanoseconds[i] = nanoseconds;
+  return true;
+}
+/*---------------------------------------------------------------------------------------------------------------*/
+
+void print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -b <path>      Baseline file (default microbenchmark_baselines.txt)\n"
+          "  -t <fraction>  Fraction slower than its baseline a kernel can be before failing (default 0.3)\n"
+          "  -p <path>      Content pack to load (default " CONTENT_PACK_PATH ")\n"
+          "  -u             Replace the baselines with this run's times\n"
+          "  -h             Show this help\n"
+          "Exits with status %d if any kernel had no baseline to compare with (its time is recorded as one).\n",
+          program, BENCHMARK_SKIPPED);
+}
+
+int main(int argc, char **argv) {
+  const char *baselines_path = "microbenchmark_baselines.txt";
+  const char *pack_path = CONTENT_PACK_PATH;
+  double threshold = 0.3;
+  bool should_update = false;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (strcmp(arg, "-b") == 0 && has_value) {
+      baselines_path = argv[++i];
+    } else if (strcmp(arg, "-t") == 0 && has_value) {
+      threshold = strtod(argv[++i], NULL);
+    } else if (strcmp(arg, "-p") == 0 && has_value) {
+      pack_path = argv[++i];
+    } else if (strcmp(arg, "-u") == 0) {
+      should_update = true;
+    } else if (strcmp(arg, "-h") == 0) {
+      print_usage(argv[0]);
+      return EXIT_SUCCESS;
+    } else {
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (threshold <= 0) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  Baselines baselines;
+  if (!baselines_load(baselines_path, &baselines)) {
+    fprintf(stderr, "Unable to read baseline file %s.\n", baselines_path);
+    return EXIT_FAILURE;
+  }
+
+  // The kernels use the same constants as the game
+  GameColours game_colours = {0};
+  Constants constants = {.game_colours = &game_colours, .aspect_ratio = 16.0 / 9.0, .screen_dimensions = {16, 9}};
+  EnemyType enemy_types[MAX_ENEMY_TYPES] = {0};
+  BossType boss_types[1] = {0};
+  Player player = {0};
+  Upgrade upgrades[PACK_NUM_UPGRADE_STATS] = {0};
+  Shop shop = {.upgrades = upgrades, .num_upgrades = PACK_NUM_UPGRADE_STATS};
+  if (!content_pack_load(pack_path, &game_colours, &constants, enemy_types, boss_types, &shop, &player, false)) {
+    fprintf(stderr, "Unable to load content from %s.\n", pack_path);
+    return EXIT_FAILURE;
+  }
+  BenchmarkInputs *inputs = malloc(sizeof *inputs);
+  if (!inputs) {
+    fprintf(stderr, "Unable to allocate benchmark inputs.\n");
+    return EXIT_FAILURE;
+  }
+  benchmark_inputs_init(inputs, &constants);
+
+  const Kernel kernels[] = {
+      {"get_draw_position_from_unit_position", run_get_draw_position_from_unit_position},
+      {"circle_is_on_screen", run_circle_is_on_screen},
+      {"circle_is_in_game_area", run_circle_is_in_game_area},
+      {"get_random_float", run_get_random_float},
+      {"enemy_manager_calculate_credits", run_enemy_manager_calculate_credits},
+  };
+  int num_kernels = sizeof kernels / sizeof kernels[0];
+
+  printf("%-38s %9s %9s %8s\n", "Kernel", "ns/call", "baseline", "change");
+  int num_regressions = 0;
+  int num_missing_baselines = 0;
+  bool are_baselines_changed = false;
+  for (int i = 0; i < num_kernels; i++) {
+    const Kernel *kernel = kernels + i;
+    double nanoseconds = kernel_time(kernel, inputs);
+
+    int baseline_index = baselines_find(&baselines, kernel->name);
+    if (baseline_index < 0 || should_update) {
+      printf("%-38s %9.3f %9s %8s\n", kernel->name, nanoseconds, "-", "recorded");
+      if (!baselines_set(&baselines, kernel->name, nanoseconds)) {
+        fprintf(stderr, "Too many kernels for baseline file (the maximum is %d).\n", BENCHMARK_MAX_KERNELS);
+        return EXIT_FAILURE;
+      }
+      are_baselines_changed = true;
+      if (baseline_index < 0) num_missing_baselines++;
+      continue;
+    }
+
+    // A kernel that looks slower is timed again, so that a burst of load from something else can't fail the run
+    double baseline = baselines.nanoseconds[baseline_index];
+    for (int attempt = 1; attempt < BENCHMARK_ATTEMPTS && nanoseconds > (1 + threshold) * baseline; attempt++)
+      nanoseconds = fmin(nanoseconds, kernel_time(kernel, inputs));
+    double change = nanoseconds / baseline - 1;
+    bool is_regression = change > threshold;
+    printf("%-38s %9.3f %9.3f %+7.1f%%%s\n", kernel->name, nanoseconds, baseline, 100 * change,
+           is_regression ? "  REGRESSED" : "");
+    if (is_regression) num_regressions++;
+  }
+
+  if (are_baselines_changed && !baselines_save(baselines_path, &baselines)) {
+    fprintf(stderr, "Unable to write baseline file %s.\n", baselines_path);
+    return EXIT_FAILURE;
+  }
+
+  free(inputs);
+  if (num_regressions > 0) {
+    printf("%d kernel(s) more than %.0f%% slower than their baselines\n", num_regressions, 100 * threshold);
+    return EXIT_FAILURE;
+  }
+  if (num_missing_baselines > 0 && !should_update) {
+    printf("%d kernel(s) had no baseline in %s, so their times were recorded rather than checked\n",
+           num_missing_baselines, baselines_path);
+    return BENCHMARK_SKIPPED;
+  }
+  return EXIT_SUCCESS;
+}
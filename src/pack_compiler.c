@@ -0,0 +1,438 @@
+// Compiles a text content pack source (see content/content.txt) into the binary format read by the game.
+// Usage: pack_compiler <source.txt> <output.pack>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include "content_pack.h"
+
+#define MAX_LINE_LENGTH 256
+#define MAX_NAME_LENGTH 32
+#define MAX_FIELDS 40
+
+typedef enum FieldKind {
+  FIELD_FLOAT,       // A single float
+  FIELD_VECTOR,      // Two floats separated by whitespace
+  FIELD_INT,         // A single integer
+  FIELD_COLOUR,      // The name of a colour from the [colours] section
+  FIELD_ENEMY_TYPE,  // The name of a previously defined enemy type, or "none"
+  FIELD_CURRENCY     // Either "money" or "boss_points"
+} FieldKind;
+
+typedef struct Field {
+  const char *name;  // Key used for the field in the source file
+  size_t offset;     // Offset of the field in its pack record
+  FieldKind kind;    // How to parse the value of the field
+} Field;
+
+typedef enum SectionType {
+  SECTION_NONE,
+  SECTION_COLOURS,
+  SECTION_CONSTANTS,
+  SECTION_ENEMY_TYPE,
+  SECTION_BOSS,
+  SECTION_UPGRADE
+} SectionType;
+
+#define CONSTANT_FIELD(field, kind) {#field, offsetof(PackConstants, field), kind}
+static const Field constant_fields[] = {CONSTANT_FIELD(game_area_dimensions, FIELD_VECTOR),
+                                        CONSTANT_FIELD(target_fps, FIELD_INT),
+                                        CONSTANT_FIELD(player_start_pos, FIELD_VECTOR),
+                                        CONSTANT_FIELD(player_base_speed, FIELD_FLOAT),
+                                        CONSTANT_FIELD(player_base_size, FIELD_FLOAT),
+                                        CONSTANT_FIELD(player_colour, FIELD_COLOUR),
+                                        CONSTANT_FIELD(player_base_firerate, FIELD_FLOAT),
+                                        CONSTANT_FIELD(player_base_projectile_speed, FIELD_FLOAT),
+                                        CONSTANT_FIELD(player_base_projectile_size, FIELD_FLOAT),
+                                        CONSTANT_FIELD(player_base_projectile_damage, FIELD_FLOAT),
+                                        CONSTANT_FIELD(player_projectile_colour, FIELD_COLOUR),
+                                        CONSTANT_FIELD(upgrade_cost_multiplier, FIELD_FLOAT),
+                                        CONSTANT_FIELD(initial_max_enemies, FIELD_INT),
+                                        CONSTANT_FIELD(enemy_spawn_interval_min, FIELD_FLOAT),
+                                        CONSTANT_FIELD(enemy_spawn_interval_max, FIELD_FLOAT),
+                                        CONSTANT_FIELD(enemy_first_spawn_interval, FIELD_FLOAT),
+                                        CONSTANT_FIELD(enemy_spawn_min_wave_size, FIELD_INT),
+                                        CONSTANT_FIELD(enemy_spawn_additional_enemy_chance, FIELD_FLOAT),
+                                        CONSTANT_FIELD(initial_enemy_credits, FIELD_FLOAT),
+                                        CONSTANT_FIELD(enemy_credit_multiplier, FIELD_FLOAT),
+                                        CONSTANT_FIELD(enemy_credit_exponent, FIELD_FLOAT),
+                                        CONSTANT_FIELD(enemy_update_interval, FIELD_FLOAT),
+                                        CONSTANT_FIELD(enemy_update_chance, FIELD_FLOAT),
+                                        CONSTANT_FIELD(enemy_lod_radius, FIELD_FLOAT),
+                                        CONSTANT_FIELD(enemy_lod_interval, FIELD_INT),
+                                        CONSTANT_FIELD(initial_max_projectiles, FIELD_INT),
+                                        CONSTANT_FIELD(font_spacing, FIELD_FLOAT),
+                                        CONSTANT_FIELD(background_square_size, FIELD_FLOAT),
+                                        CONSTANT_FIELD(background_square_colour, FIELD_COLOUR),
+                                        CONSTANT_FIELD(background_colour, FIELD_COLOUR),
+                                        CONSTANT_FIELD(boss_health_bar_colour, FIELD_COLOUR),
+                                        CONSTANT_FIELD(boss_health_bar_background_colour, FIELD_COLOUR),
+                                        CONSTANT_FIELD(boss_health_bar_opacity, FIELD_INT)};
+
+#define ENEMY_TYPE_FIELD(field, kind) {#field, offsetof(PackEnemyType, field), kind}
+static const Field enemy_type_fields[] = {
+    ENEMY_TYPE_FIELD(credit_cost, FIELD_FLOAT), ENEMY_TYPE_FIELD(min_speed, FIELD_FLOAT),
+    ENEMY_TYPE_FIELD(max_speed, FIELD_FLOAT),   ENEMY_TYPE_FIELD(min_size, FIELD_FLOAT),
+    ENEMY_TYPE_FIELD(max_size, FIELD_FLOAT),    ENEMY_TYPE_FIELD(colour, FIELD_COLOUR),
+    ENEMY_TYPE_FIELD(turns_into, FIELD_ENEMY_TYPE)};
+
+#define BOSS_FIELD(field, kind) {#field, offsetof(PackBossType, field), kind}
+static const Field boss_fields[] = {BOSS_FIELD(initial_score_to_spawn, FIELD_INT),
+                                    BOSS_FIELD(max_health, FIELD_FLOAT),
+                                    BOSS_FIELD(speed, FIELD_FLOAT),
+                                    BOSS_FIELD(size, FIELD_FLOAT),
+                                    BOSS_FIELD(colour, FIELD_COLOUR),
+                                    BOSS_FIELD(firerate, FIELD_FLOAT),
+                                    BOSS_FIELD(shots_per_burst, FIELD_INT),
+                                    BOSS_FIELD(projectile_speed, FIELD_FLOAT),
+                                    BOSS_FIELD(projectile_size, FIELD_FLOAT),
+                                    BOSS_FIELD(projectile_colour, FIELD_COLOUR),
+                                    BOSS_FIELD(moving_duration, FIELD_FLOAT),
+                                    BOSS_FIELD(stationary_duration, FIELD_FLOAT),
+                                    BOSS_FIELD(num_enemies_spawned_on_defeat, FIELD_INT),
+                                    BOSS_FIELD(enemy_type_spawned_on_defeat, FIELD_ENEMY_TYPE),
+                                    BOSS_FIELD(boss_points_on_defeat, FIELD_INT),
+                                    BOSS_FIELD(score_on_defeat, FIELD_INT)};
+
+#define UPGRADE_FIELD(field, kind) {#field, offsetof(PackUpgrade, field), kind}
+static const Field upgrade_fields[] = {UPGRADE_FIELD(type, FIELD_CURRENCY), UPGRADE_FIELD(cost, FIELD_FLOAT),
+                                       UPGRADE_FIELD(stat_increment, FIELD_FLOAT)};
+
+#define PACK_COLOUR_NAME(name) #name,
+static const char *const colour_names[PACK_NUM_COLOURS] = {PACK_COLOURS(PACK_COLOUR_NAME)};
+
+// Names of the upgradeable stats (as used in [upgrade <stat>] section headers), in PackUpgradeStat order
+static const char *const upgrade_stat_names[PACK_NUM_UPGRADE_STATS] = {"firerate", "projectile_speed",
+                                                                       "projectile_size", "projectile_damage"};
+
+// State of the compilation of a single source file
+typedef struct Compiler {
+  const char *source_path;  // Path of the source file (for error messages)
+  int line_number;          // Line currently being parsed (for error messages)
+
+  uint32_t colours[PACK_NUM_COLOURS];
+  bool colour_set[PACK_NUM_COLOURS];
+
+  PackConstants constants;
+  PackEnemyType enemy_types[MAX_ENEMY_TYPES];
+  char enemy_type_names[MAX_ENEMY_TYPES][MAX_NAME_LENGTH];
+  int num_enemy_types;
+  PackBossType boss;
+  int num_bosses;
+  PackUpgrade upgrades[PACK_NUM_UPGRADE_STATS];
+  bool upgrade_set[PACK_NUM_UPGRADE_STATS];
+
+  SectionType section;               // Type of the section currently being parsed
+  const char *section_name;          // Name of the current section (for error messages)
+  unsigned char *record;             // Record that fields in the current section are written to
+  const Field *fields;               // Fields available in the current section
+  int num_fields;                    // Number of fields available in the current section
+  bool field_set[MAX_FIELDS];        // Which fields of the current section have been set
+  char current_name[MAX_NAME_LENGTH];  // Name given in the current section header
+} Compiler;
+
+// Print an error message prefixed with the current source position and exit
+static void compile_error(const Compiler *compiler, const char *message, const char *detail) {
+  fprintf(stderr, "%s:%d: %s", compiler->source_path, compiler->line_number, message);
+  if (detail) fprintf(stderr, " '%s'", detail);
+  fprintf(stderr, "\n");
+  exit(EXIT_FAILURE);
+}
+
+// Remove leading and trailing whitespace from a string in place, returning the new start of the string
+static char *trim(char *str) {
+  while (isspace((unsigned char)*str)) str++;
+
+  char *end = str + strlen(str);
+  while (end > str && isspace((unsigned char)end[-1])) end--;
+  *end = '\0';
+
+  return str;
+}
+
+static int find_colour(const char *name) {
+  for (int i = 0; i < PACK_NUM_COLOURS; i++) {
+    if (strcmp(colour_names[i], name) == 0) return i;
+  }
+  return -1;
+}
+
+static int find_enemy_type(const Compiler *compiler, const char *name) {
+  for (int i = 0; i < compiler->num_enemy_types; i++) {
+    if (strcmp(compiler->enemy_type_names[i], name) == 0) return i;
+  }
+  return -1;
+}
+
+static float parse_float(const Compiler *compiler, const char *str, char **end) {
+  errno = 0;
+  float value = strtof(str, end);
+  if (*end == str || errno) compile_error(compiler, "Expected a number but found", str);
+  return value;
+}
+
+// Check that the current section set all of its fields. Called when a section ends
+static void finish_section(Compiler *compiler) {
+  for (int i = 0; i < compiler->num_fields; i++) {
+    if (!compiler->field_set[i]) {
+      fprintf(stderr, "%s: section [%s] is missing field '%s'\n", compiler->source_path, compiler->section_name,
+              compiler->fields[i].name);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (compiler->section == SECTION_ENEMY_TYPE) compiler->num_enemy_types++;
+}
+
+// Parse a section header of the form "[kind]" or "[kind name]" and switch to that section
+static void begin_section(Compiler *compiler, char *header) {
+  finish_section(compiler);
+
+  char *close = strchr(header, ']');
+  if (!close || *trim(close + 1) != '\0') compile_error(compiler, "Malformed section header", header);
+  *close = '\0';
+
+  char *kind = trim(header + 1);
+  char *name = kind + strcspn(kind, " \t");
+  if (*name) *name++ = '\0';
+  name = trim(name);
+  if (strlen(name) >= MAX_NAME_LENGTH) compile_error(compiler, "Section name is too long", name);
+  strcpy(compiler->current_name, name);
+
+  memset(compiler->field_set, 0, sizeof compiler->field_set);
+  compiler->section_name = kind;
+  compiler->fields = NULL;
+  compiler->num_fields = 0;
+
+  if (strcmp(kind, "colours") == 0) {
+    compiler->section = SECTION_COLOURS;
+    compiler->section_name = "colours";
+  } else if (strcmp(kind, "constants") == 0) {
+    compiler->section = SECTION_CONSTANTS;
+    compiler->section_name = "constants";
+    compiler->record = (unsigned char *)&compiler->constants;
+    compiler->fields = constant_fields;
+    compiler->num_fields = sizeof constant_fields / sizeof *constant_fields;
+  } else if (strcmp(kind, "enemy_type") == 0) {
+    if (!*name) compile_error(compiler, "Enemy types must be given a name", NULL);
+    if (find_enemy_type(compiler, name) >= 0) compile_error(compiler, "Duplicate enemy type", name);
+    if (compiler->num_enemy_types == MAX_ENEMY_TYPES) compile_error(compiler, "Too many enemy types", NULL);
+
+    compiler->section = SECTION_ENEMY_TYPE;
+    compiler->section_name = "enemy_type";
+    strcpy(compiler->enemy_type_names[compiler->num_enemy_types], name);
+    compiler->record = (unsigned char *)(compiler->enemy_types + compiler->num_enemy_types);
+    compiler->fields = enemy_type_fields;
+    compiler->num_fields = sizeof enemy_type_fields / sizeof *enemy_type_fields;
+  } else if (strcmp(kind, "boss") == 0) {
+    if (compiler->num_bosses++) compile_error(compiler, "Only one boss may be defined", NULL);
+
+    compiler->section = SECTION_BOSS;
+    compiler->section_name = "boss";
+    compiler->record = (unsigned char *)&compiler->boss;
+    compiler->fields = boss_fields;
+    compiler->num_fields = sizeof boss_fields / sizeof *boss_fields;
+  } else if (strcmp(kind, "upgrade") == 0) {
+    int stat = -1;
+    for (int i = 0; i < PACK_NUM_UPGRADE_STATS; i++) {
+      if (strcmp(upgrade_stat_names[i], name) == 0) stat = i;
+    }
+    if (stat < 0) compile_error(compiler, "Unknown upgrade stat", name);
+    if (compiler->upgrade_set[stat]) compile_error(compiler, "Duplicate upgrade", name);
+
+    compiler->section = SECTION_UPGRADE;
+    compiler->section_name = "upgrade";
+    compiler->upgrade_set[stat] = true;
+    compiler->upgrades[stat].stat = stat;
+    compiler->record = (unsigned char *)(compiler->upgrades + stat);
+    compiler->fields = upgrade_fields;
+    compiler->num_fields = sizeof upgrade_fields / sizeof *upgrade_fields;
+  } else {
+    compile_error(compiler, "Unknown section type", kind);
+  }
+}
+
+// Parse a "key = value" line and store the value in the current section
+static void parse_assignment(Compiler *compiler, char *line) {
+  char *equals = strchr(line, '=');
+  if (!equals) compile_error(compiler, "Expected 'key = value' but found", line);
+  *equals = '\0';
+  char *key = trim(line);
+  char *value = trim(equals + 1);
+
+  if (compiler->section == SECTION_NONE) compile_error(compiler, "Value given outside of a section", key);
+
+  if (compiler->section == SECTION_COLOURS) {
+    int colour = find_colour(key);
+    if (colour < 0) compile_error(compiler, "Unknown colour", key);
+
+    char *end;
+    unsigned long hex = strtoul(value, &end, 16);
+    if (strlen(value) != 8 || *end != '\0') compile_error(compiler, "Expected colour as RRGGBBAA but found", value);
+
+    compiler->colours[colour] = hex;
+    compiler->colour_set[colour] = true;
+    return;
+  }
+
+  int field_index = -1;
+  for (int i = 0; i < compiler->num_fields; i++) {
+    if (strcmp(compiler->fields[i].name, key) == 0) field_index = i;
+  }
+  if (field_index < 0) compile_error(compiler, "Unknown field", key);
+  if (compiler->field_set[field_index]) compile_error(compiler, "Field set twice", key);
+  compiler->field_set[field_index] = true;
+
+  const Field *field = compiler->fields + field_index;
+  unsigned char *dest = compiler->record + field->offset;
+  char *end = value;
+  int32_t int_value;
+  float float_value;
+
+  switch (field->kind) {
+    case FIELD_FLOAT:
+      float_value = parse_float(compiler, value, &end);
+      memcpy(dest, &float_value, sizeof float_value);
+      break;
+    case FIELD_VECTOR:
+      for (int i = 0; i < 2; i++) {
+        float_value = parse_float(compiler, end, &end);
+        memcpy(dest + i * sizeof float_value, &float_value, sizeof float_value);
+      }
+      break;
+    case FIELD_INT:
+      int_value = strtol(value, &end, 10);
+      if (end == value) compile_error(compiler, "Expected an integer but found", value);
+      memcpy(dest, &int_value, sizeof int_value);
+      break;
+    case FIELD_COLOUR:
+      int_value = find_colour(value);
+      if (int_value < 0) compile_error(compiler, "Unknown colour", value);
+      end = value + strlen(value);
+      memcpy(dest, &int_value, sizeof int_value);
+      break;
+    case FIELD_ENEMY_TYPE:
+      int_value = strcmp(value, "none") == 0 ? -1 : find_enemy_type(compiler, value);
+      if (int_value < 0 && strcmp(value, "none") != 0)
+        compile_error(compiler, "Unknown enemy type (enemy types must be defined before use)", value);
+      end = value + strlen(value);
+      memcpy(dest, &int_value, sizeof int_value);
+      break;
+    case FIELD_CURRENCY:
+      if (strcmp(value, "money") == 0)
+        int_value = 0;
+      else if (strcmp(value, "boss_points") == 0)
+        int_value = 1;
+      else
+        compile_error(compiler, "Expected 'money' or 'boss_points' but found", value);
+      end = value + strlen(value);
+      memcpy(dest, &int_value, sizeof int_value);
+      break;
+  }
+
+  if (*trim(end) != '\0') compile_error(compiler, "Unexpected text after value", end);
+}
+
+// Check the values which can't be checked while parsing
+static void validate(const Compiler *compiler) {
+  for (int i = 0; i < PACK_NUM_COLOURS; i++) {
+    if (!compiler->colour_set[i]) {
+      fprintf(stderr, "%s: colour '%s' is not defined\n", compiler->source_path, colour_names[i]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (int i = 0; i < PACK_NUM_UPGRADE_STATS; i++) {
+    if (!compiler->upgrade_set[i]) {
+      fprintf(stderr, "%s: upgrade '%s' is not defined\n", compiler->source_path, upgrade_stat_names[i]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (compiler->num_enemy_types == 0 || compiler->num_bosses != 1) {
+    fprintf(stderr, "%s: a pack needs at least one enemy type and exactly one boss\n", compiler->source_path);
+    exit(EXIT_FAILURE);
+  }
+  if (compiler->boss.enemy_type_spawned_on_defeat < 0) {
+    fprintf(stderr, "%s: the boss must spawn an enemy type on defeat\n", compiler->source_path);
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Write the compiled pack to a temporary file and rename it over the output, so that a running game never sees a
+// partially written pack
+static void write_pack(const Compiler *compiler, const char *output_path) {
+  PackHeader header = {.magic = CONTENT_PACK_MAGIC,
+                       .version = CONTENT_PACK_VERSION,
+                       .size = content_pack_expected_size(compiler->num_enemy_types),
+                       .num_colours = PACK_NUM_COLOURS,
+                       .num_enemy_types = compiler->num_enemy_types,
+                       .num_upgrades = PACK_NUM_UPGRADE_STATS};
+
+  char temp_path[4096];
+  if (snprintf(temp_path, sizeof temp_path, "%s.tmp", output_path) >= (int)sizeof temp_path) {
+    fprintf(stderr, "Output path is too long.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  FILE *file = fopen(temp_path, "wb");
+  if (!file) {
+    fprintf(stderr, "Unable to open %s for writing.\n", temp_path);
+    exit(EXIT_FAILURE);
+  }
+
+  bool ok = fwrite(&header, sizeof header, 1, file) == 1 &&
+            fwrite(compiler->colours, sizeof compiler->colours, 1, file) == 1 &&
+            fwrite(&compiler->constants, sizeof compiler->constants, 1, file) == 1 &&
+            fwrite(compiler->enemy_types, sizeof *compiler->enemy_types, compiler->num_enemy_types, file) ==
+                (size_t)compiler->num_enemy_types &&
+            fwrite(&compiler->boss, sizeof compiler->boss, 1, file) == 1 &&
+            fwrite(compiler->upgrades, sizeof compiler->upgrades, 1, file) == 1;
+  ok = (fclose(file) == 0) && ok;
+
+  if (!ok || rename(temp_path, output_path) != 0) {
+    fprintf(stderr, "Unable to write %s.\n", output_path);
+    remove(temp_path);
+    exit(EXIT_FAILURE);
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <source.txt> <output.pack>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  FILE *source = fopen(argv[1], "r");
+  if (!source) {
+    fprintf(stderr, "Unable to open %s.\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  static Compiler compiler = {0};
+  compiler.source_path = argv[1];
+
+  char buffer[MAX_LINE_LENGTH];
+  while (fgets(buffer, sizeof buffer, source)) {
+    compiler.line_number++;
+
+    if (!strchr(buffer, '\n') && !feof(source)) compile_error(&compiler, "Line is too long", NULL);
+    buffer[strcspn(buffer, "#")] = '\0';  // Strip comments
+    char *line = trim(buffer);
+
+    if (*line == '\0') continue;
+    if (*line == '[')
+      begin_section(&compiler, line);
+    else
+      parse_assignment(&compiler, line);
+  }
+  fclose(source);
+
+  finish_section(&compiler);
+  validate(&compiler);
+  write_pack(&compiler, argv[2]);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,110 @@
+// Times the particle system with a large number of live particles (100000 by default, far more than a game ever
+// has), e.g.
+//
+//   particle_benchmark -n 100000 -f 1000
+//
+// The steady state run keeps every particle alive, so it measures the update on its own. The churn run gives the
+// particles short lifetimes and respawns them in bursts each frame, so it measures spawning and releasing as well.
+// Drawing isn't timed, since it needs a window. Run with -h for options
+#define LOOP_SHOOTER_NO_MAIN
+#include "game.c"
+
+#include <time.h>
+
+#define BENCHMARK_FRAME_TIME (1.0f / 60)  // Particles are updated at a fixed 60 frames per second
+
+double get_wall_time() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Burst out particles at random points until there are `num_particles`, with lifetimes scaled by
+// `lifetime_scale` (so a large scale keeps them alive for the whole run)
+void fill_particles(ParticleSystem *particles, int num_particles, float lifetime_scale, RandomState *random) {
+  while (particles->count < num_particles) {
+    ParticleBurst burst = {.type = PARTICLE_BURST_ENEMY_DEATH,
+                           .pos = {get_random_float(random, -16, 16), get_random_float(random, -9, 9)},
+                           .radius = 0.3,
+                           .colour = {255, 255, 255, 255}};
+    int first = particles->count;
+    particle_system_spawn_burst(particles, &burst);
+    for (int i = first; i < particles->count; i++) {
+      particles->lives[i] *= lifetime_scale;
+      particles->inverse_lifetimes[i] /= lifetime_scale;
+    }
+  }
+}
+
+// Print the time taken per frame and per particle, where `particle_updates` is the total number of particles
+// updated over all the frames
+void print_timing(const char *label, double seconds, int num_frames, double particle_updates) {
+  printf("  %-13s %8.3f ms/frame  %6.2f ns/particle\n", label, 1e3 * seconds / num_frames,
+         1e9 * seconds / particle_updates);
+}
+
+void print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -n <particles>  Live particles (default 100000)\n"
+          "  -f <frames>     Frames to update for in each run (default 1000)\n"
+          "  -h              Show this help\n",
+          program);
+}
+
+int main(int argc, char **argv) {
+  int num_particles = 100000;
+  int num_frames = 1000;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (strcmp(arg, "-n") == 0 && has_value) {
+      num_particles = atoi(argv[++i]);
+    } else if (strcmp(arg, "-f") == 0 && has_value) {
+      num_frames = atoi(argv[++i]);
+    } else if (strcmp(arg, "-h") == 0) {
+      print_usage(argv[0]);
+      return EXIT_SUCCESS;
+    } else {
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (num_particles <= 0 || num_frames <= 0) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  ParticleSystem particles;
+  particle_system_init(&particles, num_particles, 1);
+  RandomState random;
+  random_seed(&random, 2);
+
+  printf("Updating %d particles for %d frames\n", num_particles, num_frames);
+
+  // Steady state: nothing expires, so this is just the vector update and the scan for expired particles
+  fill_particles(&particles, num_particles, 1e6, &random);
+  double start_time = get_wall_time();
+  for (int frame = 0; frame < num_frames; frame++) particle_system_update(&particles, BENCHMARK_FRAME_TIME);
+  print_timing("steady state", get_wall_time() - start_time, num_frames, (double)num_particles * num_frames);
+
+  // Churn: each particle lives for 18 to 30 frames, and the pool is topped back up before every update
+  particles.count = 0;
+  fill_particles(&particles, num_particles, 1, &random);
+  double particle_updates = 0;
+  int num_spawned = 0;
+  start_time = get_wall_time();
+  for (int frame = 0; frame < num_frames; frame++) {
+    int count_before = particles.count;
+    fill_particles(&particles, num_particles, 1, &random);
+    num_spawned += particles.count - count_before;
+    particle_updates += particles.count;
+    particle_system_update(&particles, BENCHMARK_FRAME_TIME);
+  }
+  print_timing("churn", get_wall_time() - start_time, num_frames, particle_updates);
+  printf("  %-13s %8.0f particles/frame spawned and released\n", "", (double)num_spawned / num_frames);
+
+  particle_system_cleanup(&particles);
+  return EXIT_SUCCESS;
+}
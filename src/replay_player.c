@@ -0,0 +1,153 @@
+// Plays back a replay recorded by the game (last_game.replay by default) headlessly, to check and time seeking,
+// e.g.
+//
+//   replay_player -s 36000 -n 600 last_game.replay
+//
+// seeks to the update at 5 minutes (at 120 updates per second) and times the next 600 updates. With -v the whole
+// replay is played from the start instead, and each keyframe is compared with the game the updates before it led
+// to, which finds any way the simulation doesn't replay exactly. Run with -h for options (POSIX only)
+#define LOOP_SHOOTER_NO_MAIN
+#include "game.c"
+
+#include <time.h>
+
+#define REPLAY_NUM_SLOWEST 5  // Number of slowest updates reported after seeking
+
+double get_wall_time(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options] [replay path (default %s)]\n"
+          "  -s <update>   Seek to just before this update, and report how long it took (default 0)\n"
+          "  -n <updates>  Time this many updates after seeking (default 0)\n"
+          "  -v            Play the whole replay, checking the game matches every keyframe\n"
+          "  -h            Show this help\n",
+          program, REPLAY_PATH);
+}
+
+// Play the whole replay from the start. Returns the number of keyframes the game didn't match
+int replay_verify(Replay *replay, GameState *game_state, GameEventBuffer *events, const EnemyType *enemy_types,
+                  const BossType *boss_types, const Constants *constants) {
+  int num_mismatches = 0;
+  double start_time = get_wall_time();
+  replay->position = sizeof replay->header + replay->header.content_pack_size;
+  replay->tick = 0;
+  while (replay->tick < replay->footer.num_ticks) {
+    if (!replay_play_tick(replay, game_state, events, enemy_types, boss_types, constants, &num_mismatches)) {
+      fprintf(stderr, "Replay is malformed at update %u.\n", replay->tick);
+      exit(EXIT_FAILURE);
+    }
+  }
+  printf("Played %u updates (%u keyframes) in %.3f s: %d keyframe%s did not match\n", replay->footer.num_ticks,
+         replay->footer.num_keyframes, get_wall_time() - start_time, num_mismatches,
+         num_mismatches == 1 ? "" : "s");
+  return num_mismatches;
+}
+
+int main(int argc, char **argv) {
+  uint32_t seek_tick = 0;
+  int num_timed_ticks = 0;
+  bool verify = false;
+  const char *path = REPLAY_PATH;
+  bool has_path = false;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (strcmp(arg, "-s") == 0 && has_value) {
+      seek_tick = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "-n") == 0 && has_value) {
+      num_timed_ticks = atoi(argv[++i]);
+    } else if (strcmp(arg, "-v") == 0) {
+      verify = true;
+    } else if (strcmp(arg, "-h") == 0) {
+      print_usage(argv[0]);
+      return EXIT_SUCCESS;
+    } else if (arg[0] == '-' || has_path) {
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    } else {
+      path = arg;
+      has_path = true;
+    }
+  }
+  if (num_timed_ticks < 0) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  Replay replay;
+  if (!replay_open(&replay, path)) return EXIT_FAILURE;
+  if (replay.header.sim_fixed_point != SIM_FIXED_POINT) {
+    fprintf(stderr, "Warning: the replay was recorded %s fixed point simulation maths, so it may not play back "
+                    "exactly.\n",
+            replay.header.sim_fixed_point ? "with" : "without");
+  }
+
+  GameColours game_colours = {0};
+  Constants constants = {.game_colours = &game_colours};
+  EnemyType enemy_types[MAX_ENEMY_TYPES] = {0};
+  BossType boss_types[1] = {0};
+  replay_load_content(&replay, &game_colours, &constants, enemy_types, boss_types);
+  printf("%s: %u updates (%.1f s), %u keyframes, %zu bytes\n", path, replay.footer.num_ticks,
+         replay.footer.num_ticks / constants.simulation_rate, replay.footer.num_keyframes, replay.size);
+
+  GameState game_state = {0};
+  GameEventBuffer events = {0};
+  int exit_status = EXIT_SUCCESS;
+  if (verify) {
+    if (replay_verify(&replay, &game_state, &events, enemy_types, boss_types, &constants) > 0) {
+      exit_status = EXIT_FAILURE;
+    }
+  } else {
+    double start_time = get_wall_time();
+    if (!replay_seek(&replay, seek_tick, &game_state, &events, enemy_types, boss_types, &constants)) {
+      fprintf(stderr, "Unable to seek to update %u.\n", seek_tick);
+      return EXIT_FAILURE;
+    }
+    printf("Seeking to update %u (%.2f s into the game) took %.3f ms\n", seek_tick, game_state.time,
+           (get_wall_time() - start_time) * 1e3);
+
+    // Time the updates one by one, keeping the slowest in descending order
+    double total_time = 0;
+    double slowest_times[REPLAY_NUM_SLOWEST] = {0};
+    uint32_t slowest_ticks[REPLAY_NUM_SLOWEST] = {0};
+    int num_played = 0;
+    while (num_played < num_timed_ticks && replay.tick < replay.footer.num_ticks) {
+      uint32_t tick = replay.tick;
+      double tick_start = get_wall_time();
+      if (!replay_play_tick(&replay, &game_state, &events, enemy_types, boss_types, &constants, NULL)) {
+        fprintf(stderr, "Replay is malformed at update %u.\n", tick);
+        return EXIT_FAILURE;
+      }
+      double tick_time = get_wall_time() - tick_start;
+      total_time += tick_time;
+      num_played++;
+
+      int slot = REPLAY_NUM_SLOWEST;
+      while (slot > 0 && slowest_times[slot - 1] < tick_time) slot--;
+      if (slot == REPLAY_NUM_SLOWEST) continue;
+      memmove(slowest_times + slot + 1, slowest_times + slot, (REPLAY_NUM_SLOWEST - slot - 1) * sizeof(double));
+      memmove(slowest_ticks + slot + 1, slowest_ticks + slot, (REPLAY_NUM_SLOWEST - slot - 1) * sizeof(uint32_t));
+      slowest_times[slot] = tick_time;
+      slowest_ticks[slot] = tick;
+    }
+
+    if (num_played > 0) {
+      printf("Played %d updates: mean %.1f us, slowest", num_played, total_time / num_played * 1e6);
+      for (int i = 0; i < REPLAY_NUM_SLOWEST && i < num_played; i++) {
+        printf(" %.1f us (update %u)%s", slowest_times[i] * 1e6, slowest_ticks[i],
+               i + 1 < REPLAY_NUM_SLOWEST && i + 1 < num_played ? "," : "\n");
+      }
+    }
+  }
+
+  replay_close(&replay);
+  cleanup_game(&game_state.enemy_manager, &game_state.projectile_manager);
+  game_event_buffer_cleanup(&events);
+  return exit_status;
+}
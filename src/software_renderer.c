@@ -0,0 +1,261 @@
+// Draws a game screen frame on the CPU, with no GPU or display, and writes it to an image, e.g.
+//
+//   software_renderer -r last_game.replay -u 36000 -o frame.png
+//
+// draws the game as it was at update 36000 of a replay. Without a replay, a seeded game is played for a while with
+// the player standing still and firing. The frame goes through the same drawing functions as the game, drawn to a
+// software canvas, so it can be compared with a golden image (-c) to check the drawing code, and timed (-b) to
+// benchmark frame composition. Run with -h for options (POSIX only)
+#define LOOP_SHOOTER_NO_MAIN
+#include "game.c"
+
+#define RENDERER_PARTICLE_SECONDS 1.5f  // Updates before the frame that spawn particles (they live up to 1.2 s)
+
+double get_wall_time(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -r <replay>   Draw a frame of this replay\n"
+          "  -u <update>   Update of the replay to draw the frame at (default: the end)\n"
+          "  -s <seed>     Seed of the game to play without a replay (default 1)\n"
+          "  -t <seconds>  Seconds to play the game for without a replay, if the player survives (default 20)\n"
+          "  -W <pixels>   Width of the frame (default 1280)\n"
+          "  -H <pixels>   Height of the frame (default 720)\n"
+          "  -d            Draw the debug text too\n"
+          "  -o <path>     Image to write the frame to, PPM or (with raylib) PNG (default frame.ppm)\n"
+          "  -c <path>     PPM image to compare the frame with. Fails if any pixel differs\n"
+          "  -b <frames>   Time drawing the frame this many times\n"
+          "  -h            Show this help\n",
+          program);
+}
+
+// Play one update from the replay or of the seeded game, and spawn the particles it sets off
+bool renderer_play_update(Replay *replay, GameState *game_state, GameEventBuffer *events,
+                          ParticleBurstQueue *burst_queue, ParticleSystem *particles, const EnemyType *enemy_types,
+                          const BossType *boss_types, const Constants *constants) {
+  if (replay) {
+    if (!replay_play_tick(replay, game_state, events, enemy_types, boss_types, constants, NULL)) return false;
+  } else {
+    UpdateInput input = {.aim_pos = Vector2Add(game_state->player.pos, (Vector2){1, 0}), .is_firing = true};
+    game_state_play_update(game_state, &input, 1 / constants->simulation_rate, enemy_types, boss_types, events,
+                           constants);
+  }
+
+  game_events_send_particle_bursts(events, enemy_types, boss_types, burst_queue);
+  ParticleBurst burst;
+  while (particle_burst_queue_pop(burst_queue, &burst)) particle_system_spawn_burst(particles, &burst);
+  particle_system_update(particles, 1 / constants->simulation_rate);
+  return true;
+}
+
+// Draw the game screen the way the game does, minus the pause text
+void renderer_draw_frame(SoftwareCanvas *canvas, const RenderFrame *frame, const ParticleSystem *particles,
+                         const EnemyType *enemy_types, const BossType *boss_types, bool show_debug_text,
+                         const Constants *constants) {
+  const GameState *game_state = &frame->game_state;
+  Vector2 camera_position = game_state->camera_position;
+  QualitySettings quality = quality_get_settings(0);
+  FrameTimeSummary no_times = {0};
+
+  software_canvas_clear(canvas, constants->background_colour);
+  draw_background_squares(camera_position, constants);
+  draw_projectiles(&game_state->projectile_manager, frame->projectile_grids,
+                   (Color[]){[ALLEGIANCE_PLAYER] = game_state->player.projectile_colour,
+                             [ALLEGIANCE_ENEMIES] = boss_types[game_state->boss.type].projectile_colour},
+                   game_state->time, camera_position, constants);
+  draw_enemies(&game_state->enemy_manager, &frame->enemy_grid, enemy_types, camera_position, constants);
+  draw_boss(&game_state->boss, boss_types, camera_position, constants);
+  particle_system_draw(particles, camera_position, constants);
+  draw_player(&game_state->player, camera_position, constants);
+  draw_game_info(&game_state->player, &game_state->enemy_manager, &game_state->projectile_manager,
+                 &game_state->boss, 0, 0, &no_times, &no_times, &no_times, game_state->time, constants,
+                 show_debug_text, &quality);
+  draw_boss_health_bar(&game_state->boss, boss_types, constants);
+  draw_black_bars(constants);
+}
+
+// Count the pixels of the canvas which differ from the binary PPM at `path`. Returns -1 if it can't be read or
+// has different dimensions
+long renderer_compare_with_image(const SoftwareCanvas *canvas, const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (!file) return -1;
+
+  int width, height, max_value;
+  long num_differences = -1;
+  if (fscanf(file, "P6 %d %d %d", &width, &height, &max_value) == 3 && fgetc(file) != EOF &&
+      width == canvas->width && height == canvas->height && max_value == 255) {
+    num_differences = 0;
+    size_t num_pixels = (size_t)width * height;
+    for (size_t i = 0; i < num_pixels; i++) {
+      unsigned char rgb[3];
+      if (fread(rgb, 1, 3, file) != 3) {
+        num_differences = -1;
+        break;
+      }
+      Color pixel = canvas->pixels[i];
+      if (rgb[0] != pixel.r || rgb[1] != pixel.g || rgb[2] != pixel.b) num_differences++;
+    }
+  }
+  fclose(file);
+  return num_differences;
+}
+
+int main(int argc, char **argv) {
+  const char *replay_path = NULL;
+  long update = -1;
+  uint64_t seed = 1;
+  float play_time = 20;
+  int width = 1280;
+  int height = 720;
+  bool show_debug_text = false;
+  const char *output_path = "frame.ppm";
+  const char *golden_path = NULL;
+  int num_benchmark_frames = 0;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (strcmp(arg, "-r") == 0 && has_value) {
+      replay_path = argv[++i];
+    } else if (strcmp(arg, "-u") == 0 && has_value) {
+      update = strtol(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "-s") == 0 && has_value) {
+      seed = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "-t") == 0 && has_value) {
+      play_time = strtof(argv[++i], NULL);
+    } else if (strcmp(arg, "-W") == 0 && has_value) {
+      width = atoi(argv[++i]);
+    } else if (strcmp(arg, "-H") == 0 && has_value) {
+      height = atoi(argv[++i]);
+    } else if (strcmp(arg, "-d") == 0) {
+      show_debug_text = true;
+    } else if (strcmp(arg, "-o") == 0 && has_value) {
+      output_path = argv[++i];
+    } else if (strcmp(arg, "-c") == 0 && has_value) {
+      golden_path = argv[++i];
+    } else if (strcmp(arg, "-b") == 0 && has_value) {
+      num_benchmark_frames = atoi(argv[++i]);
+    } else if (strcmp(arg, "-h") == 0) {
+      print_usage(argv[0]);
+      return EXIT_SUCCESS;
+    } else {
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (width <= 0 || height <= 0 || play_time < 0 || num_benchmark_frames < 0) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  // Content comes from the replay, or else the content pack with the game's other constants
+  GameColours game_colours = {0};
+  CircleLods circle_lods;
+  circle_lods_init(&circle_lods);
+  SoftwareCanvas canvas;
+  software_canvas_init(&canvas, width, height);
+  Constants constants = {.game_colours = &game_colours,
+                         .circle_lods = &circle_lods,
+                         .software_canvas = &canvas,
+                         .screen_dimensions = {16, 9},
+                         .simulation_rate = 120};
+  EnemyType enemy_types[MAX_ENEMY_TYPES] = {0};
+  BossType boss_types[1] = {0};
+  Replay replay;
+  if (replay_path) {
+    if (!replay_open(&replay, replay_path)) return EXIT_FAILURE;
+    replay_load_content(&replay, &game_colours, &constants, enemy_types, boss_types);
+  } else {
+    Player loaded_player = {0};
+    Upgrade upgrades[PACK_NUM_UPGRADE_STATS] = {0};
+    Shop shop = {.upgrades = upgrades, .num_upgrades = PACK_NUM_UPGRADE_STATS};
+    if (!content_pack_load(CONTENT_PACK_PATH, &game_colours, &constants, enemy_types, boss_types, &shop,
+                           &loaded_player, false)) {
+      fprintf(stderr, "Unable to load content from %s.\n", CONTENT_PACK_PATH);
+      return EXIT_FAILURE;
+    }
+  }
+  constants.aspect_ratio = constants.screen_dimensions.x / constants.screen_dimensions.y;
+
+  // The game is played straight into a render frame, whose grids the drawing functions use for culling. Only the
+  // last updates before the frame spawn particles, as earlier ones would have expired
+  RenderFrame frame = {0};
+  GameState *game_state = &frame.game_state;
+  GameEventBuffer events = {0};
+  ParticleBurstQueue burst_queue = {0};
+  ParticleSystem particles;
+  particle_system_init(&particles, PARTICLE_CAPACITY, seed);
+  int num_particle_updates = RENDERER_PARTICLE_SECONDS * constants.simulation_rate;
+  uint32_t last_update;
+  if (replay_path) {
+    last_update = update < 0 || update > replay.footer.num_ticks ? replay.footer.num_ticks : update;
+    uint32_t first_update = last_update > num_particle_updates ? last_update - num_particle_updates : 0;
+    if (!replay_seek(&replay, first_update, game_state, &events, enemy_types, boss_types, &constants)) {
+      fprintf(stderr, "Unable to seek to update %u.\n", first_update);
+      return EXIT_FAILURE;
+    }
+    while (replay.tick < last_update) {
+      if (!renderer_play_update(&replay, game_state, &events, &burst_queue, &particles, enemy_types, boss_types,
+                                &constants)) {
+        fprintf(stderr, "Replay is malformed at update %u.\n", replay.tick);
+        return EXIT_FAILURE;
+      }
+    }
+  } else {
+    initialise_game(&game_state->player, &game_state->enemy_manager, &game_state->projectile_manager, &constants);
+    start_game(game_state, boss_types, seed, NULL, &constants);
+    last_update = play_time * constants.simulation_rate;
+    for (uint32_t i = 0; i < last_update && !game_state->player.is_defeated; i++) {
+      renderer_play_update(NULL, game_state, &events, &burst_queue, &particles, enemy_types, boss_types,
+                           &constants);
+    }
+  }
+  render_frame_build_grids(&frame, false, &constants);
+
+  renderer_draw_frame(&canvas, &frame, &particles, enemy_types, boss_types, show_debug_text, &constants);
+  printf("Drew the frame at %.2f s into the game (%d enemies, %d particles) at %dx%d\n", game_state->time,
+         game_state->enemy_manager.enemy_count, particles.count, width, height);
+
+  int exit_status = EXIT_SUCCESS;
+  if (!software_canvas_export(&canvas, output_path)) {
+    fprintf(stderr, "Unable to write the frame to %s.\n", output_path);
+    exit_status = EXIT_FAILURE;
+  }
+
+  if (golden_path) {
+    long num_differences = renderer_compare_with_image(&canvas, golden_path);
+    if (num_differences < 0) {
+      fprintf(stderr, "Unable to read %s as a %dx%d PPM image.\n", golden_path, width, height);
+      exit_status = EXIT_FAILURE;
+    } else {
+      printf("%ld pixels differ from %s\n", num_differences, golden_path);
+      if (num_differences > 0) exit_status = EXIT_FAILURE;
+    }
+  }
+
+  if (num_benchmark_frames > 0) {
+    FrameTimeHistogram draw_times = {0};
+    for (int i = 0; i < num_benchmark_frames; i++) {
+      double start_time = get_wall_time();
+      renderer_draw_frame(&canvas, &frame, &particles, enemy_types, boss_types, show_debug_text, &constants);
+      frame_time_histogram_record(&draw_times, get_wall_time() - start_time);
+    }
+    FrameTimeSummary summary = frame_time_histogram_summarise(&draw_times);
+    printf("Drew %u frames: mean %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", summary.count, summary.mean,
+           summary.p50, summary.p99, summary.max);
+  }
+
+  if (replay_path) replay_close(&replay);
+  software_canvas_cleanup(&canvas);
+  particle_system_cleanup(&particles);
+  game_event_buffer_cleanup(&events);
+  cleanup_game(&game_state->enemy_manager, &game_state->projectile_manager);
+  spatial_grid_cleanup(&frame.enemy_grid);
+  for (int a = 0; a < NUM_ALLEGIANCES; a++) spatial_grid_cleanup(frame.projectile_grids + a);
+  return exit_status;
+}
@@ -0,0 +1,213 @@
+// Follows a game from another process through its state stream, rebuilding the game from each tick's deltas and
+// drawing it, e.g.
+//
+//   LOOP_SHOOTER_STREAM=loop_shooter.sock ./loop_shooter
+//   ./stream_viewer loop_shooter.sock
+//
+// The viewer (re)connects whenever the game is listening, so either can be started first. Colours and the other
+// content that isn't streamed come from the viewer's own content pack, which should match the game's. The bytes
+// per tick received this game are shown in the corner (POSIX only)
+#define LOOP_SHOOTER_NO_MAIN
+#include "game.c"
+
+#define VIEWER_RECONNECT_INTERVAL 0.5   // Seconds between attempts to connect to the game
+#define VIEWER_RECEIVE_CHUNK (1 << 16)  // Bytes of room made in the receive buffer before each read
+
+// Connection to the game's state stream
+typedef struct StreamConnection {
+  int fd;                 // Socket connected to the game, or -1 if not connected
+  unsigned char *buffer;  // Bytes received but not yet decoded
+  size_t size;            // Number of bytes in `buffer`
+  size_t capacity;        // Number of bytes allocated for `buffer`
+  bool is_in_sync;        // Whether the viewer's copy of the game matches the stream (it waits for a reset if not)
+  double last_attempt;    // Time of the last attempt to connect
+  int num_ticks;          // Number of ticks received this game
+  uint64_t num_bytes;     // Number of bytes received this game
+} StreamConnection;
+
+// Try to connect to the game if it has been long enough since the last attempt
+void stream_connection_try_to_connect(StreamConnection *connection, const char *path) {
+  if (GetTime() - connection->last_attempt < VIEWER_RECONNECT_INTERVAL) return;
+  connection->last_attempt = GetTime();
+
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  snprintf(address.sun_path, sizeof address.sun_path, "%s", path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return;
+  if (connect(fd, (struct sockaddr *)&address, sizeof address) < 0 || fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+    close(fd);
+    return;
+  }
+
+  connection->fd = fd;
+  connection->size = 0;
+  connection->is_in_sync = false;  // The game starts every connection with a reset
+}
+
+// Read everything that has arrived from the game without blocking. Disconnects if the game has gone
+void stream_connection_receive(StreamConnection *connection) {
+  for (;;) {
+    if (connection->capacity - connection->size < VIEWER_RECEIVE_CHUNK) {
+      connection->capacity = 2 * connection->capacity + VIEWER_RECEIVE_CHUNK;
+      connection->buffer = realloc(connection->buffer, connection->capacity);
+      if (!connection->buffer) {
+        fprintf(stderr, "Unable to allocate the receive buffer.\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    ssize_t result = recv(connection->fd, connection->buffer + connection->size,
+                          connection->capacity - connection->size, 0);
+    if (result > 0) {
+      connection->size += result;
+    } else if (result < 0 && errno == EINTR) {
+      continue;
+    } else {
+      if (result == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+        close(connection->fd);
+        connection->fd = -1;
+        connection->size = 0;            // A partial tick can't be finished on the next connection
+        connection->is_in_sync = false;  // Show that the game has gone rather than freezing on its last frame
+      }
+      return;
+    }
+  }
+}
+
+// Apply every complete tick received to the viewer's copy of the game. Returns whether any were applied
+bool stream_connection_apply_ticks(StreamConnection *connection, StateStreamMirror *mirror, GameState *game_state,
+                                   int num_boss_types) {
+  bool has_applied = false;
+  size_t position = 0;
+  for (;;) {
+    StateStreamReader reader = {.data = connection->buffer + position, .size = connection->size - position};
+    uint32_t tick_size = state_stream_read_varint(&reader);
+    if (reader.has_failed || reader.size - reader.position < tick_size) break;  // The rest hasn't arrived yet
+
+    const unsigned char *tick = reader.data + reader.position;
+    if (tick_size > 0 && (tick[0] & STATE_STREAM_FLAG_RESET)) {
+      connection->is_in_sync = true;
+      connection->num_ticks = 0;
+      connection->num_bytes = 0;
+    }
+    if (connection->is_in_sync) {
+      connection->is_in_sync = state_stream_decode_tick(mirror, tick, tick_size, game_state) &&
+                               (!game_state->boss.is_active || game_state->boss.type < num_boss_types);
+      has_applied = true;
+    }
+
+    connection->num_ticks++;
+    connection->num_bytes += reader.position + tick_size;
+    position += reader.position + tick_size;
+  }
+
+  memmove(connection->buffer, connection->buffer + position, connection->size - position);
+  connection->size -= position;
+  return has_applied;
+}
+
+void print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options] [socket path (default %s)]\n"
+          "  -h  Show this help\n",
+          program, STATE_STREAM_SOCKET_PATH);
+}
+
+int main(int argc, char **argv) {
+  if (argc == 2 && strcmp(argv[1], "-h") == 0) {
+    print_usage(argv[0]);
+    return EXIT_SUCCESS;
+  } else if (argc > 2 || (argc == 2 && argv[1][0] == '-')) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  const char *path = argc == 2 ? argv[1] : STATE_STREAM_SOCKET_PATH;
+
+  GameColours game_colours = {0};
+  CircleLods circle_lods;
+  circle_lods_init(&circle_lods);
+  Constants constants = {.game_colours = &game_colours,
+                         .circle_lods = &circle_lods,
+                         .initial_window_resolution = {1280, 720},
+                         .aspect_ratio = 16.0 / 9.0,
+                         .screen_dimensions = {16, 9}};
+  EnemyType enemy_types[MAX_ENEMY_TYPES] = {0};
+  BossType boss_types[1] = {0};
+  Player loaded_player = {0};
+  Upgrade upgrades[PACK_NUM_UPGRADE_STATS] = {0};
+  Shop shop = {.upgrades = upgrades, .num_upgrades = PACK_NUM_UPGRADE_STATS};
+  if (!content_pack_load(CONTENT_PACK_PATH, &game_colours, &constants, enemy_types, boss_types, &shop,
+                         &loaded_player, false)) {
+    fprintf(stderr, "Unable to load content from %s.\n", CONTENT_PACK_PATH);
+    return EXIT_FAILURE;
+  }
+
+  // The game is rebuilt into a render frame, whose grids the drawing functions use for culling
+  RenderFrame frame = {0};
+  GameState *game_state = &frame.game_state;
+  game_state->player.colour = constants.player_colour;
+  StateStreamMirror mirror = {0};
+  StreamConnection connection = {.fd = -1, .last_attempt = -VIEWER_RECONNECT_INTERVAL};
+
+  SetConfigFlags(FLAG_WINDOW_RESIZABLE);
+  InitWindow(constants.initial_window_resolution.x, constants.initial_window_resolution.y, "Loop Shooter Viewer");
+  SetTargetFPS(constants.target_fps);
+  constants.game_font = GetFontDefault();  // Needs to come after window initialisation
+
+  while (!WindowShouldClose()) {
+    if (connection.fd < 0) stream_connection_try_to_connect(&connection, path);
+    if (connection.fd >= 0) stream_connection_receive(&connection);
+    if (stream_connection_apply_ticks(&connection, &mirror, game_state, sizeof boss_types / sizeof *boss_types)) {
+      camera_update_position(&game_state->camera_position, &game_state->player, &constants);
+      render_frame_build_grids(&frame, false, &constants);
+    }
+
+    BeginDrawing();
+    {
+      ClearBackground(constants.background_colour);
+      if (connection.is_in_sync) {
+        Vector2 camera_position = game_state->camera_position;
+        draw_background_squares(camera_position, &constants);
+        draw_projectiles(&game_state->projectile_manager, frame.projectile_grids,
+                         (Color[]){[ALLEGIANCE_PLAYER] = constants.player_projectile_colour,
+                                   [ALLEGIANCE_ENEMIES] = boss_types[game_state->boss.type].projectile_colour},
+                         game_state->time, camera_position, &constants);
+        draw_enemies(&game_state->enemy_manager, &frame.enemy_grid, enemy_types, camera_position, &constants);
+        draw_boss(&game_state->boss, boss_types, camera_position, &constants);
+        draw_player(&game_state->player, camera_position, &constants);
+        draw_boss_health_bar(&game_state->boss, boss_types, &constants);
+
+        draw_text_anchored(constants.game_font, TextFormat("Score: %d", game_state->player.score),
+                           (Vector2){0.25, 0.25}, 0.4, constants.font_spacing, game_colours.black, ANCHOR_TOP_LEFT,
+                           &constants);
+        draw_text_anchored(constants.game_font,
+                           TextFormat("%.1f bytes/tick", (double)connection.num_bytes / connection.num_ticks),
+                           (Vector2){0.25, 0.65}, 0.25, constants.font_spacing, game_colours.grey_5,
+                           ANCHOR_TOP_LEFT, &constants);
+        if (game_state->player.is_defeated) {
+          draw_text_anchored(constants.game_font, "GAME OVER", (Vector2){0, -3}, 0.8, constants.font_spacing,
+                             game_colours.red_2, ANCHOR_CENTRE, &constants);
+        }
+      } else {
+        draw_text_anchored(constants.game_font,
+                           TextFormat(connection.fd < 0 ? "Waiting for a game on %s" : "Waiting for a new game",
+                                      path),
+                           (Vector2){0, 0}, 0.4, constants.font_spacing, game_colours.grey_5, ANCHOR_CENTRE,
+                           &constants);
+      }
+
+      draw_black_bars(&constants);
+    }
+    EndDrawing();
+  }
+
+  CloseWindow();
+  if (connection.fd >= 0) close(connection.fd);
+  free(connection.buffer);
+  state_stream_mirror_cleanup(&mirror);
+  cleanup_game(&game_state->enemy_manager, &game_state->projectile_manager);
+  spatial_grid_cleanup(&frame.enemy_grid);
+  for (int a = 0; a < NUM_ALLEGIANCES; a++) spatial_grid_cleanup(frame.projectile_grids + a);
+
+  return EXIT_SUCCESS;
+}